@@ -9,7 +9,29 @@
 #include <cstring>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
+#include <type_traits>
 #include <functional>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <list>
+#include <deque>
+#include <condition_variable>
+#include <cstdlib>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
 //------------------------------------RLL-------------------------------------//
 #define RLL_VERSION_MAJOR 1
 #define RLL_VERSION_MINOR 0
@@ -22,6 +44,28 @@
 	#define RLL_PLATFORM_IS_WINDOWS
 #else
 	#define RLL_PLATFORM_IS_UNIX
+	#ifdef __ELF__
+		#define RLL_PLATFORM_IS_ELF
+	#endif
+#endif
+
+//Without exceptions (`-fno-exceptions`) errors are only reported through the
+//`return_errors` policy.
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+	#define RLL_HAS_EXCEPTIONS
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+#include <link.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/auxv.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 #endif
 
 namespace rll {
@@ -79,8 +123,62 @@ enum windows_flag {
 
 } //windows_flag
 
+namespace rll_flags {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A enum of the flags that are handled by RLL itself rather than the
+/// platform backend.
+///
+/// @details These flags opt into extra work around loading. Features that
+/// aren't available on the current platform are ignored.
+////////////////////////////////////////////////////////////////////////////////
+enum rll_flag {
+    RECORD_LOAD_REPORT = 0x00001,
+    //Map the library with RLL's own ELF loader instead of `dlopen`, so loads
+    //of different libraries run in parallel. Only for self-contained
+    //libraries: no TLS, and all their dependencies already loaded. The
+    //platform flags are ignored. x86-64 and AArch64 only.
+    USERSPACE_LOADER = 0x00002,
+    //Add the library's exported symbols to `symbol_index::global()` while it
+    //is loaded. Only for `shared_library` (the default policies). ELF only.
+    INDEX_SYMBOLS = 0x00004,
+    //Answer `get_symbol` from a file of symbol offsets kept in the directory
+    //set with `shared_library::set_offset_cache_directory`, keyed by the
+    //library's build-id. Symbols missing from it are added when the library
+    //is unloaded. ELF only.
+    CACHE_SYMBOL_OFFSETS = 0x00008,
+    //Hash the file with XXH64 before loading it and refuse to load it unless
+    //the digest was passed to `shared_library::set_trusted_digests`. Digests
+    //are cached by the file's device, inode, size, mtime and ctime (see
+    //`shared_library::set_integrity_cache_file`), and the library is loaded
+    //through the descriptor that was hashed. The path must name the file, the
+    //library search path isn't used. Linux only: elsewhere loads with this
+    //flag throw `not_supported` rather than skip the check.
+    VERIFY_INTEGRITY = 0x00010,
+    //Fault every page of the library's loadable segments in right after
+    //loading, copy-on-write pages included, so the first calls don't take
+    //page faults. ELF only.
+    PREFAULT = 0x00020,
+    //`mlock` the library's loadable segments (implies PREFAULT). Segments
+    //that can't be locked (see `RLIMIT_MEMLOCK`) are left unlocked, the
+    //load report says how much was. ELF only.
+    LOCK_MEMORY = 0x00040,
+    //Bind every function the library imports while loading it (like
+    //`LOAD_NOW`) instead of on the first call through each PLT entry.
+    WARM_BINDINGS = 0x00080,
+    //Load the library, and a copy of each of its dependencies, into a new
+    //link-map namespace (`dlmopen(LM_ID_NEWLM)`), so it gets its own copy
+    //even if the same file is already loaded. Code in the namespace has its
+    //own C++ runtime: exceptions can't be thrown across it. glibc allows 16
+    //namespaces per process. The warm pool isn't used. glibc only: elsewhere
+    //loads with this flag throw `not_supported`.
+    NEW_NAMESPACE = 0x00100,
+};
+
+} //rll_flag
+
 using windows_flag = windows_flags::windows_flag;
 using unix_flag = unix_flags::unix_flag;
+using rll_flag = rll_flags::rll_flag;
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief A container for library loader flags. 
@@ -100,15 +198,20 @@ class loader_flags {
         /// @brief The internal Windows loader flags that are modified by methods.
         ////////////////////////////////////////////////////////////////////////////////
         unsigned int wflags;
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief The internal RLL flags that are modified by methods.
+        ////////////////////////////////////////////////////////////////////////////////
+        unsigned int rflags;
     public:
-        loader_flags() : uflags(unix_flags::LOAD_LAZY), wflags(0){}
+        loader_flags() : uflags(unix_flags::LOAD_LAZY), wflags(0), rflags(0){}
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Construct a new loader flags object.
         /// 
         /// @param unix_flags All the Unix loader flags you want enabled.
         /// @param windows_flags All the Windows loader flags you want enabled.
+        /// @param rll_flags All the RLL flags you want enabled.
         ////////////////////////////////////////////////////////////////////////////////
-        loader_flags(std::initializer_list<unix_flag> unix_flags, std::initializer_list<windows_flag> windows_flags);
+        loader_flags(std::initializer_list<unix_flag> unix_flags, std::initializer_list<windows_flag> windows_flags, std::initializer_list<rll_flag> rll_flags = {});
 
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Add a Unix loader flag to the internal flags.
@@ -120,6 +223,11 @@ class loader_flags {
         /// @param flag The flag.
         ////////////////////////////////////////////////////////////////////////////////
         void add_flag(windows_flag flag);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Add an RLL flag to the internal flags.
+        /// @param flag The flag.
+        ////////////////////////////////////////////////////////////////////////////////
+        void add_flag(rll_flag flag);
 
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Remove an Unix loader flag.
@@ -131,6 +239,11 @@ class loader_flags {
         /// @param flag The flag.
         ////////////////////////////////////////////////////////////////////////////////
         void remove_flag(windows_flag flag);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Remove an RLL flag.
+        /// @param flag The flag.
+        ////////////////////////////////////////////////////////////////////////////////
+        void remove_flag(rll_flag flag);
 
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Looks for a Unix loader flag in the internal flags.
@@ -144,6 +257,12 @@ class loader_flags {
         /// @return bool Whether the flag is present.
         ////////////////////////////////////////////////////////////////////////////////
         bool has_flag(windows_flag flag);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Looks for an RLL flag in the internal flags.
+        /// @param flag The flag that is searched for.
+        /// @return bool Whether the flag is present.
+        ////////////////////////////////////////////////////////////////////////////////
+        bool has_flag(rll_flag flag);
 
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Get the Unix loader flags.
@@ -155,6 +274,11 @@ class loader_flags {
         /// @return unsigned int The stored Windows loader flags.
         ////////////////////////////////////////////////////////////////////////////////
         unsigned int get_windows_flags();
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the RLL flags.
+        /// @return unsigned int The stored RLL flags.
+        ////////////////////////////////////////////////////////////////////////////////
+        unsigned int get_rll_flags();
 
         ////////////////////////////////////////////////////////////////////////////////
         /// @brief Clear all the Unix loader flags.
@@ -164,186 +288,1263 @@ class loader_flags {
         /// @brief Clear all the Windows loader flags.
         ////////////////////////////////////////////////////////////////////////////////
         void clear_windows_flags();
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Clear all the RLL flags.
+        ////////////////////////////////////////////////////////////////////////////////
+        void clear_rll_flags();
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief One object in the dependency tree of a loaded shared library.
+////////////////////////////////////////////////////////////////////////////////
+struct dependency_entry {
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The name it was requested by (the `DT_NEEDED` entry, or the load
+    /// path for the root).
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string name;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The path the loader resolved it to. Empty if it wasn't resolved.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string path;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether a mapped object was found for the name.
+    ////////////////////////////////////////////////////////////////////////////////
+    bool resolved = false;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether the object was mapped by this load rather than already
+    /// being resident.
+    ////////////////////////////////////////////////////////////////////////////////
+    bool newly_mapped = false;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The load base (bias) of the object.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::uintptr_t base = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The page-rounded size of all the object's loadable segments.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t mapped_size = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Indices (into `load_report::entries`) of its direct dependencies.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::vector<std::size_t> needed;
+};
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief An interface for loading shared libraries at run-time.
+/// @brief What a load cost and which objects it pulled in.
 ///
-/// @warning RLL doesn't support (at least at this time) the checking of symbol
-/// types. This means that RLL doesn't know the type of a symbol and can't
-/// safeguard against segmentation faults. This must be debugged and caught by
-/// you.
+/// @details The load time is always recorded. The dependency tree is only
+/// recorded when the library was loaded with `rll_flags::RECORD_LOAD_REPORT`
+/// on an ELF platform. `entries[0]` is the library itself.
 ///
-/// @details Hey! This is a simple class that allows for simple yet powerful
-/// interface for loading and processing shared libraries (dynamic libraries) at
-/// run-time. It is completely multi-platform (for the operating systems you
-/// have actually heard of at least, :P) and the API is too! 
+/// Newly mapped objects are found by diffing the loaded objects before and
+/// after the load, so an object mapped by another thread at the same time is
+/// counted as newly mapped too. Constructors run inside the platform loader, so
+/// their cost is part of `load_time` and can't be split per object.
+////////////////////////////////////////////////////////////////////////////////
+struct load_report {
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The path that was loaded.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string path;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The wall time spent in the platform loader (mapping, relocation
+    /// and constructors).
+    ////////////////////////////////////////////////////////////////////////////////
+    std::chrono::nanoseconds load_time{0};
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The wall time spent prefaulting and locking the library
+    /// (`rll_flags::PREFAULT` and `rll_flags::LOCK_MEMORY`).
+    ////////////////////////////////////////////////////////////////////////////////
+    std::chrono::nanoseconds warm_time{0};
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The bytes of the library's segments that were prefaulted.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t prefaulted_size = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The bytes of the library's segments that were locked.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t locked_size = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The dependency tree, breadth first.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::vector<dependency_entry> entries;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The mapped size of all the objects that this load mapped.
+    /// @return std::size_t The size in bytes.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t newly_mapped_size() const;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Serialize the report as a JSON object.
+    /// @return std::string The JSON text.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string to_json() const;
+};
+
+
+namespace segment_kinds {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief What a part of a loaded library's memory holds.
+////////////////////////////////////////////////////////////////////////////////
+enum segment_kind {
+    TEXT,
+    RODATA,
+    DATA,
+    BSS
+};
+} //segment_kinds
+
+using segment_kind = segment_kinds::segment_kind;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The memory behind one part of a loaded library.
 ///
-/// It has an exception-based way of processing errors (no more error codes,
-/// yay!). This means if you haven't properly loaded a library before you try to
-/// get a symbol or something it will throw an error.
+/// @details The range is page-rounded. Resident figures come from the kernel's
+/// accounting of the mappings that overlap the range.
+////////////////////////////////////////////////////////////////////////////////
+struct segment_usage {
+    segment_kind kind = segment_kinds::TEXT;
+    std::uintptr_t address = 0;
+    std::size_t size = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Resident bytes.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t rss = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Proportional resident bytes (shared pages divided by sharers).
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t pss = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Dirty bytes, shared and private.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t dirty = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief The memory footprint of one loaded library.
 ///
-/// Better than anything is a code example:
-/// ```cpp
-/// //Contains a function add two integers:
-/// rll::shared_library test_lib;
-/// try {
-///     test_lib.load("test_lib.so");
-/// } catch(rll::exception::library_loading_error& e) {
-///     std::cout << "Oh noes! We had an issue loading the shared library:\n" << e.what() << "\n"; 
-/// }
+/// @details Writable segments are split into `DATA` (backed by the file) and
+/// `BSS` (zero filled past the end of the file). The totals are the sums over
+/// `segments`.
+////////////////////////////////////////////////////////////////////////////////
+struct library_memory_usage {
+    std::string path;
+    std::vector<segment_usage> segments;
+    std::size_t text = 0;
+    std::size_t rodata = 0;
+    std::size_t data = 0;
+    std::size_t bss = 0;
+    std::size_t rss = 0;
+    std::size_t pss = 0;
+    std::size_t dirty = 0;
+};
+
+namespace unload_blockers {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A reason a library can stay mapped after it was unloaded.
+////////////////////////////////////////////////////////////////////////////////
+enum unload_blocker {
+    //The library was linked with `-z nodelete` (`DF_1_NODELETE`).
+    NODELETE_FLAG = 0x01,
+    //It was loaded with `LOAD_NODELETE`, by RLL or anyone else.
+    NODELETE_LOAD = 0x02,
+    //It defines `STB_GNU_UNIQUE` symbols, which make the platform loader keep
+    //it once they are bound.
+    UNIQUE_SYMBOLS = 0x04,
+    //Other loaded objects list it in their `DT_NEEDED`.
+    DEPENDENTS = 0x08,
+    //Its handle is parked in the warm pool.
+    WARM_POOL = 0x10,
+    //None of the above explain it, so other handles (other `shared_library`
+    //objects or direct `dlopen` calls) still hold it open.
+    OTHER_REFERENCES = 0x20,
+};
+} //unload_blockers
+
+using unload_blocker = unload_blockers::unload_blocker;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Whether unloading a library actually unmapped it, and if not, why.
 ///
-/// std::function<int(int, int)> add_function;
+/// @details Returned by `shared_library::unload_and_verify()`. The flags that
+/// can be read off the library (`NODELETE_FLAG`, `UNIQUE_SYMBOLS`) are only
+/// reported if it stayed mapped, since they don't always keep it mapped.
+////////////////////////////////////////////////////////////////////////////////
+struct unload_verification {
+    std::string path;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether the library's mappings are gone.
+    ////////////////////////////////////////////////////////////////////////////////
+    bool unmapped = false;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The `unload_blocker` flags that apply.
+    ////////////////////////////////////////////////////////////////////////////////
+    unsigned int blockers = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The paths of the loaded objects that need the library.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::vector<std::string> dependents;
+
+    bool has_blocker(unload_blocker blocker) const { return (blockers & blocker) != 0; }
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Describe the result in one line of text.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string describe() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A sorted, immutable index from addresses to the exported symbols of
+/// one library.
 ///
-/// if(test_lib.has_symbol("add")){
-///     add_function = test_lib.get_function_symbol<int(int, int)>("add"));
-/// }
+/// @details Built by `shared_library::get_address_index()`. The index owns
+/// copies of all the names it returns and is never modified after it is built,
+/// so lookups take no locks and can run from any number of threads (e.g. a
+/// sampling profiler's handler) at the same time.
 ///
-/// std::cout << add_function(2, 4) << "\n"; //returns "6";
+/// A symbol covers `[address, address + size)`. Symbols without a size cover
+/// everything up to the next symbol.
+////////////////////////////////////////////////////////////////////////////////
+class address_index {
+    public:
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief The result of a lookup. All pointers are null if nothing was found.
+        ////////////////////////////////////////////////////////////////////////////////
+        struct symbol_info {
+            const char * library = nullptr;
+            const char * name = nullptr;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Only set if the index was built with demangling, otherwise null.
+            ////////////////////////////////////////////////////////////////////////////////
+            const char * demangled_name = nullptr;
+            std::uintptr_t symbol_address = 0;
+            std::size_t offset = 0;
+            explicit operator bool() const { return name != nullptr; }
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Adds a symbol. Only used while building the index.
+        ////////////////////////////////////////////////////////////////////////////////
+        void add(std::uintptr_t address, std::size_t size, const char * name, const std::string& demangled_name);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Sorts the symbols. Only used while building the index.
+        ////////////////////////////////////////////////////////////////////////////////
+        void finish(const std::string& library);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Find the symbol an address falls in.
+        /// @param address Any address, e.g. a sampled instruction pointer.
+        /// @return symbol_info The symbol and the offset of `address` into it.
+        ////////////////////////////////////////////////////////////////////////////////
+        symbol_info lookup(const void * address) const noexcept;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief The number of indexed symbols.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::size_t size() const noexcept { return starts.size(); }
+    private:
+        //Kept as separate arrays so the search only touches `starts`.
+        std::vector<std::uintptr_t> starts;
+        std::vector<std::uintptr_t> ends;
+        std::vector<std::uint32_t> names;
+        std::vector<std::uint32_t> demangled_names;
+        std::string strings;
+        std::string library_name;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A log-bucketed (HDR style) latency histogram that many threads can
+/// record into at once.
 ///
-/// test_lib.unload(); //Clears object and closes the shared library.
+/// @details Every power of two is split into 16 linear sub-buckets, so a
+/// recorded value is off by at most ~6%. Values from 2^44ns (~4.9 hours) up
+/// land in the last bucket.
 ///
-/// //Repeat...
-/// ```
+/// Each thread records into one of a fixed set of cache-line aligned shards
+/// (picked once per thread), so threads don't contend on the same counters.
+/// `merge()` sums the shards on demand.
+///
+/// A disabled histogram costs a single relaxed load and branch per call of the
+/// functions that record into it.
 ////////////////////////////////////////////////////////////////////////////////
-class shared_library {
-	private:
-		shared_library(const shared_library&);
-		shared_library& operator=(const shared_library&);
-		//
-		std::string lib_path;
-		void * lib_handle;
-		static std::mutex _mutex;
-		//
-		void load(const std::string& path, int flags);
-	public:
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Construct a new shared library object.
-		////////////////////////////////////////////////////////////////////////////////
-		shared_library();
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Destroy the shared library object.
-		////////////////////////////////////////////////////////////////////////////////
-		virtual ~shared_library();
+class latency_histogram {
+    public:
+        static constexpr std::size_t sub_bucket_bits = 4;
+        static constexpr std::size_t max_value_bits = 44;
+        static constexpr std::size_t bucket_count = (max_value_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+        static constexpr std::size_t shard_count = 16;
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Loads a shared library from a given path. 
-		///
-		/// @details This ctor takes the path to a shared library and then loads
-		/// it with no flags on Windows or the default flag
-		/// (RTLD_LAZY/LOAD_LAZY) on Unix. If it fails to load the shared
-		/// library it will throw a `library_not_loaded` exception with the
-		/// relevant information. If a library is already loaded into the object
-		/// then it throws a `library_already_loaded` exception.
-		///
-		/// @param path The path to the shared library.
-		///
-		/// @throw rll::exception::library_loading_error 
-		/// @throw rll::exception::library_already_loaded
-		////////////////////////////////////////////////////////////////////////////////
-		void load(const std::string& path){ load(path, loader_flags()); }
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief The merged contents of a histogram.
+        ////////////////////////////////////////////////////////////////////////////////
+        struct snapshot {
+            std::array<std::uint64_t, bucket_count> counts{};
+            std::uint64_t count = 0;
+            std::uint64_t total_ns = 0;
+            std::uint64_t max_ns = 0;
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Loads a shared library from a path with flags.
-		///
-		/// @details This ctor takes the path to shared library and also
-		/// loader_flags. These flags tell the platform backend how to load the
-		/// library. It also throws the same exception as the other overload
-		/// (`load(std::string)`).
-		///
-		/// @param path The path to the shared library. 
-		/// @param flags The flags that are used by the platform backend.
-		///
-		/// @see load
-		///
-		/// @throw rll::exception::library_loading_error 
-		/// @throw rll::exception::library_already_loaded
-		////////////////////////////////////////////////////////////////////////////////
-		void load(const std::string& path, loader_flags flags);
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Get the value at a percentile.
+            /// @param percentile From 0 to 100.
+            /// @return std::chrono::nanoseconds The upper bound of the bucket
+            /// holding the percentile, or 0 if nothing was recorded.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::chrono::nanoseconds percentile(double percentile) const;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Get the mean of the recorded values.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::chrono::nanoseconds mean() const;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Add another snapshot to this one.
+            ////////////////////////////////////////////////////////////////////////////////
+            void add(const snapshot& other);
+        };
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Unloads the loaded if there is one loaded.
-		////////////////////////////////////////////////////////////////////////////////
-		void unload();
+        latency_histogram(bool enabled = true) : enabled(enabled){}
+        latency_histogram(const latency_histogram&) = delete;
+        latency_histogram& operator=(const latency_histogram&) = delete;
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Returns whether a shared library has been loaded into the object.
-		/// @return true A shared library is loaded.
-		/// @return false A shared library isn't loaded.
-		////////////////////////////////////////////////////////////////////////////////
-		bool is_loaded();
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Record one value into the calling thread's shard.
+        ////////////////////////////////////////////////////////////////////////////////
+        void record(std::chrono::nanoseconds value) noexcept;
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Returns whether the loaded shared library has a symbol in it.
-		///
-		/// @details It looks for a symbol. Simple as that. But if a library
-		/// hasn't been loaded it throws an `library_not_loaded` exception.
-		///
-		/// @param name The name of the symbol.
-		/// @return true The symbol was found.
-		/// @return false The symbol wasn't found.
-		///
-		/// @throw rll::exception::library_not_loaded
-		////////////////////////////////////////////////////////////////////////////////
-		bool has_symbol(const std::string& name){ return get_symbol_fast(name) != nullptr; }
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Sum all the shards.
+        ///
+        /// @details Values recorded while merging may or may not be included.
+        ////////////////////////////////////////////////////////////////////////////////
+        snapshot merge() const;
 
-		////////////////////////////////////////////////////////////////////////////////
-		/// @brief Attempts to retrieve a symbol.
-		///
-		/// @details It attempts to find a symbol but if it can't find a symbol
-		/// it throws a `symbol_not_found` error. If a shared library has not
-		/// been loaded into the object then it throws a `library_not_loaded`
-		/// exception. 
-		///
-		/// @warning C++ library symbols are NOT demangled! If you dislike this
-		/// enough open a Github issue and I will re-visit it. 
-		///
-		/// @param name The name of the symbol. 
-		/// @return void * The pointer to the retrieved symbol.
-		///
-		/// @throw rll::exception::library_not_loaded 
-		/// @throw rll::exception::symbol_not_found
-		////////////////////////////////////////////////////////////////////////////////
-		void * get_symbol(const std::string& name);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Zero all the shards.
+        ////////////////////////////////////////////////////////////////////////////////
+        void reset() noexcept;
+
+        void enable() noexcept { enabled.store(true, std::memory_order_relaxed); }
+        void disable() noexcept { enabled.store(false, std::memory_order_relaxed); }
+        bool is_enabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
 
         ////////////////////////////////////////////////////////////////////////////////
-        /// @brief Attempts to get a pointer to the object at a symbol.
-        /// 
-        /// @tparam object_type The type of the symbol being accessed.
-        /// @param name The name of the symbol.
-        /// @return object_type* A pointer to the object being accessed.
+        /// @brief Get the bucket a value is counted in.
         ////////////////////////////////////////////////////////////////////////////////
-        template<typename object_type>
-        object_type * get_object_symbol(const std::string& name){
-            return reinterpret_cast<object_type *>(get_symbol(name));
+        static std::size_t bucket_of(std::uint64_t value) noexcept;
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the largest value that is counted in a bucket.
+        ////////////////////////////////////////////////////////////////////////////////
+        static std::uint64_t bucket_upper_bound(std::size_t bucket) noexcept;
+    private:
+        struct alignas(64) shard {
+            std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+            std::atomic<std::uint64_t> total_ns{0};
+            std::atomic<std::uint64_t> max_ns{0};
+        };
+        std::atomic<bool> enabled;
+        std::array<shard, shard_count> shards;
+
+        static std::size_t thread_shard() noexcept;
+};
+
+template<typename signature>
+class timed_function;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A function symbol that records how long each call takes.
+///
+/// @details Returned by `shared_library::get_timed_function_symbol`. It doesn't
+/// own the histogram or keep the library loaded.
+///
+/// @tparam return_type The function's return type.
+/// @tparam argument_types The function's parameter types.
+////////////////////////////////////////////////////////////////////////////////
+template<typename return_type, typename... argument_types>
+class timed_function<return_type(argument_types...)> {
+    public:
+        using function_type = return_type(*)(argument_types...);
+
+        timed_function() : function(nullptr), histogram(nullptr){}
+        timed_function(function_type function, latency_histogram& histogram) : function(function), histogram(&histogram){}
+
+        return_type operator()(argument_types... arguments) const {
+            if(!histogram->is_enabled()){
+                return function(std::forward<argument_types>(arguments)...);
+            }
+            //Records on the way out so void functions and exceptions are timed too.
+            struct timer {
+                latency_histogram * histogram;
+                std::chrono::steady_clock::time_point start;
+                ~timer(){ histogram->record(std::chrono::steady_clock::now() - start); }
+            } timer { histogram, std::chrono::steady_clock::now() };
+            return function(std::forward<argument_types>(arguments)...);
         }
 
         ////////////////////////////////////////////////////////////////////////////////
-        /// @brief Attempts to get a std::function pointing to function symbol.
-        /// 
-        /// @tparam signature The function signature.
-        /// @param name The name of the symbol.
-        /// @return std::function<signature> The returned function symbol.
+        /// @brief Get the raw, untimed function pointer.
         ////////////////////////////////////////////////////////////////////////////////
-        template<typename signature>
-        std::function<signature> get_function_symbol(const std::string& name){
-            return reinterpret_cast<signature *>(get_symbol(name));
-        }
+        function_type get() const noexcept { return function; }
+        explicit operator bool() const noexcept { return function != nullptr; }
+    private:
+        function_type function;
+        latency_histogram * histogram;
+};
 
+#ifdef RLL_ENABLE_TRACING
+namespace tracing {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Records a begin event now and the matching end event when it goes
+/// out of scope.
+///
+/// @details Only exists when RLL is built with `RLL_ENABLE_TRACING`. Each
+/// thread records into its own fixed-size ring that only it writes to and only
+/// the exporter reads from, so recording takes no locks. Events that don't fit
+/// in a full ring are dropped and counted. Applications can use it for their
+/// own spans to see them on the same timeline.
+///
+/// The timestamps come from `std::chrono::steady_clock`.
+////////////////////////////////////////////////////////////////////////////////
+class scope {
+    public:
         ////////////////////////////////////////////////////////////////////////////////
-        /// @brief Get a symbol without exception handling.
-        ///
-        /// @details A fast symbol accessor that doesn't handle exception states
-        /// for faster runtimes. This is only to be used if you know what you
-        /// are doing. You can get any errors with the corresponding platform
-        /// backends.
-        ///
-        /// @param name The name of the symbol attempting to be accessed.
-        /// @return void* A pointer to the accessed symbol (typically a nullptr
-        /// if it failed.)
+        /// @param name The event name. It must outlive the export (a literal).
+        /// @param detail Shown as the event's argument, cut to 63 characters.
         ////////////////////////////////////////////////////////////////////////////////
-        void * get_symbol_fast(const std::string& name) noexcept;
+        scope(const char * name, const char * detail = nullptr) noexcept;
+        scope(const char * name, const std::string& detail) noexcept : scope(name, detail.c_str()){}
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+        ~scope();
+    private:
+        const char * name;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Removes every recorded event and returns them as Chrome trace event
+/// JSON (loadable by `chrome://tracing` and Perfetto).
+////////////////////////////////////////////////////////////////////////////////
+std::string export_chrome_json();
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the number of events dropped because a thread's ring was full.
+////////////////////////////////////////////////////////////////////////////////
+std::size_t dropped_events() noexcept;
+} //tracing
+
+//RLL_TRACE_SCOPE records a span until the end of the enclosing block and
+//RLL_TRACE_LOCK locks a mutex, recording a span only if it had to wait, and
+//RLL_TRACE_SHARED_LOCK does the same for shared ownership.
+#define RLL_TRACE_CONCAT_(a, b) a##b
+#define RLL_TRACE_CONCAT(a, b) RLL_TRACE_CONCAT_(a, b)
+#define RLL_TRACE_SCOPE(name, detail) ::rll::tracing::scope RLL_TRACE_CONCAT(rll_trace_scope_, __LINE__)(name, detail)
+#define RLL_TRACE_LOCK(lock_name, mutex_name) \
+    std::unique_lock<std::remove_reference_t<decltype(mutex_name)>> lock_name(mutex_name, std::try_to_lock); \
+    if(!lock_name.owns_lock()){ \
+        RLL_TRACE_SCOPE("lock wait", #mutex_name); \
+        lock_name.lock(); \
+    }
+#define RLL_TRACE_SHARED_LOCK(lock_name, mutex_name) \
+    std::shared_lock<std::remove_reference_t<decltype(mutex_name)>> lock_name(mutex_name, std::try_to_lock); \
+    if(!lock_name.owns_lock()){ \
+        RLL_TRACE_SCOPE("lock wait", #mutex_name); \
+        lock_name.lock(); \
+    }
+#else
+#define RLL_TRACE_SCOPE(name, detail)
+#define RLL_TRACE_LOCK(lock_name, mutex_name) std::lock_guard<std::remove_reference_t<decltype(mutex_name)>> lock_name(mutex_name)
+#define RLL_TRACE_SHARED_LOCK(lock_name, mutex_name) std::shared_lock<std::remove_reference_t<decltype(mutex_name)>> lock_name(mutex_name)
+#endif
+
+namespace lock_policies {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief No locking, for libraries only used from one thread.
+///
+/// @details This is the lock-free choice: with it symbol lookups take no lock,
+/// whatever the cache policy.
+////////////////////////////////////////////////////////////////////////////////
+struct no_lock {
+    void lock() noexcept {}
+    bool try_lock() noexcept { return true; }
+    void unlock() noexcept {}
+    void lock_shared() noexcept {}
+    bool try_lock_shared() noexcept { return true; }
+    void unlock_shared() noexcept {}
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A spinlock, for short critical sections with little contention.
+////////////////////////////////////////////////////////////////////////////////
+class spin_lock {
+    public:
+        void lock() noexcept {
+            while(locked.exchange(true, std::memory_order_acquire)){
+                for(unsigned int spins = 0; locked.load(std::memory_order_relaxed); spins++){
+                    if(spins >= 64){
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+        bool try_lock() noexcept { return !locked.exchange(true, std::memory_order_acquire); }
+        void unlock() noexcept { locked.store(false, std::memory_order_release); }
+        void lock_shared() noexcept { lock(); }
+        bool try_lock_shared() noexcept { return try_lock(); }
+        void unlock_shared() noexcept { unlock(); }
+    private:
+        std::atomic<bool> locked{false};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A `std::mutex`. The default.
+////////////////////////////////////////////////////////////////////////////////
+class mutex_lock {
+    public:
+        void lock(){ mutex.lock(); }
+        bool try_lock(){ return mutex.try_lock(); }
+        void unlock(){ mutex.unlock(); }
+        void lock_shared(){ mutex.lock(); }
+        bool try_lock_shared(){ return mutex.try_lock(); }
+        void unlock_shared(){ mutex.unlock(); }
+    private:
+        std::mutex mutex;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A `std::shared_mutex`, so symbol lookups from several threads don't
+/// wait for each other.
+////////////////////////////////////////////////////////////////////////////////
+class shared_mutex_lock {
+    public:
+        void lock(){ mutex.lock(); }
+        bool try_lock(){ return mutex.try_lock(); }
+        void unlock(){ mutex.unlock(); }
+        void lock_shared(){ mutex.lock_shared(); }
+        bool try_lock_shared(){ return mutex.try_lock_shared(); }
+        void unlock_shared(){ mutex.unlock_shared(); }
+    private:
+        std::shared_mutex mutex;
+};
+} //lock_policies
+
+namespace error_policies {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Errors are thrown as `rll::exception`s. The default.
+///
+/// @details Built without exceptions it aborts instead, like the standard
+/// library does. Use `return_errors` there.
+////////////////////////////////////////////////////////////////////////////////
+struct throw_errors {
+    template<typename exception_type, typename... argument_types>
+    static void raise(argument_types&&... arguments){
+        #ifdef RLL_HAS_EXCEPTIONS
+        throw exception_type(std::forward<argument_types>(arguments)...);
+        #else
+        std::fputs(exception_type(std::forward<argument_types>(arguments)...).what(), stderr);
+        std::abort();
+        #endif
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Errors are recorded for the calling thread instead of thrown.
+///
+/// @details Failed calls return an empty value (a null pointer, an empty
+/// report, ...) and failed loads leave the library unloaded. The description
+/// of the last error stays readable with `last_error()` until the next one.
+////////////////////////////////////////////////////////////////////////////////
+struct return_errors {
+    template<typename exception_type, typename... argument_types>
+    static void raise(argument_types&&... arguments){
+        last_error() = exception_type(std::forward<argument_types>(arguments)...).what();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get the description of the calling thread's last error.
+    ////////////////////////////////////////////////////////////////////////////////
+    static std::string& last_error(){
+        thread_local std::string error;
+        return error;
+    }
+};
+} //error_policies
+
+namespace cache_policies {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Symbol lookups check the symbols resolved by a startup manifest and
+/// the offset cache (`rll_flags::CACHE_SYMBOL_OFFSETS`) first. The default.
+////////////////////////////////////////////////////////////////////////////////
+struct symbol_cache {
+    static constexpr bool enabled = true;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Symbol lookups go straight to the platform loader.
+///
+/// @details Lookups still hold the library's lock across the platform
+/// lookup, so an unload can't close the handle under them.
+/// `rll_flags::CACHE_SYMBOL_OFFSETS` is ignored.
+////////////////////////////////////////////////////////////////////////////////
+struct no_cache {
+    static constexpr bool enabled = false;
+};
+} //cache_policies
+
+template<typename lock_policy = lock_policies::mutex_lock, typename error_policy = error_policies::throw_errors, typename cache_policy = cache_policies::symbol_cache>
+class basic_shared_library;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A `basic_shared_library` with the default policies: a mutex,
+/// exceptions and symbol caches.
+////////////////////////////////////////////////////////////////////////////////
+using shared_library = basic_shared_library<>;
+
+namespace detail {
+class elf_image;
+class symbol_offset_cache;
+
+//Runs best-effort work from a `noexcept` path. Returns false if it threw, the
+//exception is dropped.
+template<typename function_type>
+inline bool ignore_exceptions(function_type function) noexcept {
+    #ifdef RLL_HAS_EXCEPTIONS
+    try {
+        function();
+    } catch(...){
+        return false;
+    }
+    #else
+    function();
+    #endif
+    return true;
+}
+} //detail
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A record of the libraries loaded and symbols resolved during a run,
+/// replayed to warm up the next start.
+///
+/// @details While recording, every successful `shared_library` load and symbol
+/// lookup is appended in order (each library and symbol once). `save` writes
+/// the manifest to a file.
+///
+/// On the next start, `open` the file and `replay` it before the application
+/// loads anything: the files are prefetched into the page cache in parallel,
+/// the libraries are loaded in recorded order (dependencies first) and the
+/// recorded symbols are resolved in bulk. The manifest keeps the libraries
+/// loaded, so the application's own loads of the same libraries find them
+/// resident and get the resolved symbols handed to them without any lookups.
+///
+/// Each library's build-id is recorded. Libraries whose file on disk no longer
+/// has the same build-id are skipped by `replay` and reported as stale.
+///
+/// ```cpp
+/// rll::startup_manifest manifest;
+/// if(manifest.open("startup.manifest")){
+///     manifest.replay();
+/// }
+/// manifest.start_recording();
+/// //... start up as usual ...
+/// manifest.stop_recording();
+/// manifest.save("startup.manifest");
+/// ```
+////////////////////////////////////////////////////////////////////////////////
+class startup_manifest {
+    public:
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief One recorded library.
+        ////////////////////////////////////////////////////////////////////////////////
+        struct library_entry {
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief The path it was loaded by.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::string path;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief The file the platform loader resolved the path to.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::string resolved_path;
+            std::string build_id;
+            unsigned int native_flags = 0;
+            unsigned int rll_flags = 0;
+            std::vector<std::string> symbols;
+        };
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief What a replay did.
+        ////////////////////////////////////////////////////////////////////////////////
+        struct replay_result {
+            std::size_t libraries_loaded = 0;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Libraries skipped because their build-id changed.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::size_t libraries_stale = 0;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief Libraries that failed to load.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::size_t libraries_failed = 0;
+            std::size_t symbols_resolved = 0;
+        };
+
+        startup_manifest() = default;
+        startup_manifest(const startup_manifest&) = delete;
+        startup_manifest& operator=(const startup_manifest&) = delete;
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Stops recording and releases the replayed libraries.
+        ////////////////////////////////////////////////////////////////////////////////
+        ~startup_manifest();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Make this the manifest that loads and lookups are recorded
+        /// into. Only one manifest records at a time.
+        ////////////////////////////////////////////////////////////////////////////////
+        void start_recording();
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Stop recording into this manifest.
+        ////////////////////////////////////////////////////////////////////////////////
+        void stop_recording();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Write the manifest to a file.
+        /// @return bool Whether it was written.
+        ////////////////////////////////////////////////////////////////////////////////
+        bool save(const std::string& file) const;
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Replace the manifest's entries with the ones in a file.
+        /// @return bool Whether the file was read. A missing or malformed file
+        /// leaves the manifest empty.
+        ////////////////////////////////////////////////////////////////////////////////
+        bool open(const std::string& file);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Prefetch, load and resolve everything in the manifest.
+        ///
+        /// @details Stale libraries are dropped from the manifest, so saving it
+        /// again (or recording over it) refreshes it.
+        ///
+        /// @param threads The number of threads used for prefetching and
+        /// checking build-ids. 0 picks the hardware concurrency.
+        /// @return replay_result What was done.
+        ////////////////////////////////////////////////////////////////////////////////
+        replay_result replay(unsigned int threads = 0);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Unload the libraries that `replay` loaded. Libraries the
+        /// application loaded itself stay loaded.
+        ////////////////////////////////////////////////////////////////////////////////
+        void release();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the recorded libraries in load order.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::vector<library_entry> get_libraries() const;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the manifest that is recording, if any. Used by
+        /// `shared_library`.
+        ////////////////////////////////////////////////////////////////////////////////
+        static startup_manifest * get_recording(){ return recording().load(std::memory_order_acquire); }
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Record a successful load. Used by `shared_library`.
+        ////////////////////////////////////////////////////////////////////////////////
+        void record_load(const std::string& path, void * handle, unsigned int native_flags, unsigned int rll_flags);
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Record a successful symbol lookup. Used by `shared_library`.
+        ////////////////////////////////////////////////////////////////////////////////
+        void record_symbol(void * handle, const std::string& name);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the symbols a replay resolved for a platform handle.
+        /// Used by `shared_library` when it loads a library.
+        /// @return bool Whether there were any.
+        ////////////////////////////////////////////////////////////////////////////////
+        static bool get_resolved_symbols(void * handle, std::unordered_map<std::string, void *>& symbols);
+    private:
+        mutable std::mutex entries_mutex;
+        std::vector<library_entry> entries;
+        std::unordered_map<void *, std::size_t> entries_by_handle;
+        std::vector<std::unordered_set<std::string>> recorded_symbols;
+        //Failed loads are counted, not thrown, so these report errors by return.
+        using replayed_library = basic_shared_library<lock_policies::mutex_lock, error_policies::return_errors>;
+        std::vector<std::unique_ptr<replayed_library>> replayed;
+
+        static std::atomic<startup_manifest *>& recording(){
+            static std::atomic<startup_manifest *> manifest{nullptr};
+            return manifest;
+        }
+        //Symbols resolved by replays, per platform handle.
+        struct resolved_table {
+            std::mutex mutex;
+            std::atomic<std::size_t> size{0};
+            std::unordered_map<void *, std::unordered_map<std::string, void *>> symbols;
+        };
+        static resolved_table& resolved(){
+            static resolved_table table;
+            return table;
+        }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Limits for the pool that keeps recently unloaded libraries loaded.
+///
+/// @details When the pool is enabled `shared_library::unload()` parks the
+/// platform handle instead of closing it, and a later `load()` of the same
+/// path with the same flags takes it back without going through the platform
+/// loader. Parked libraries are closed least recently used first once a limit
+/// is exceeded. Expiry is checked on every pool operation and by
+/// `shared_library::trim_warm_pool()`; there is no background thread.
+///
+/// Only libraries loaded by the platform loader are pooled.
+////////////////////////////////////////////////////////////////////////////////
+struct warm_pool_limits {
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The most libraries kept parked. 0 disables the pool.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t max_libraries = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The most mapped bytes kept parked. 0 means no memory budget.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t max_bytes = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief How long a library stays parked. 0 means until it is evicted.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::chrono::milliseconds keep_alive{0};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A library that provides a symbol, and the symbol's address in it.
+////////////////////////////////////////////////////////////////////////////////
+struct symbol_provider {
+    shared_library * library = nullptr;
+    void * address = nullptr;
+
+    explicit operator bool() const noexcept { return library != nullptr; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A process-wide index from symbol names to the libraries that export
+/// them.
+///
+/// @details Libraries loaded with `rll_flags::INDEX_SYMBOLS` add their exported
+/// symbols when they are loaded and remove them when they are unloaded. When
+/// several libraries export the same name the one loaded first wins, like the
+/// platform loader's global scope.
+///
+/// Lookups never block and take no locks: the index keeps two copies of its
+/// table (a left-right scheme), readers announce themselves on per-thread
+/// sharded counters and writers update the copy nobody reads, swap, wait for
+/// the old readers to leave, then update the other copy. Loads and unloads of
+/// indexed libraries serialize with each other.
+///
+/// A provider is only valid while its library stays loaded.
+////////////////////////////////////////////////////////////////////////////////
+class symbol_index {
+    public:
+        symbol_index(const symbol_index&) = delete;
+        symbol_index& operator=(const symbol_index&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the index of this process.
+        ////////////////////////////////////////////////////////////////////////////////
+        static symbol_index& global();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Find the library that provides a symbol.
+        /// @param name The symbol's (mangled) name.
+        /// @return symbol_provider The provider, or an empty one.
+        ////////////////////////////////////////////////////////////////////////////////
+        symbol_provider find(const std::string& name) const noexcept;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Find every library that provides a symbol.
+        /// @param name The symbol's (mangled) name.
+        /// @return std::vector<symbol_provider> The providers, in precedence
+        /// order.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::vector<symbol_provider> find_all(const std::string& name) const;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the number of distinct names in the index.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::size_t size() const noexcept;
+    private:
+        template<typename, typename, typename>
+        friend class basic_shared_library;
+        static constexpr std::size_t shard_count = 16;
+
+        using table = std::unordered_map<std::string, std::vector<symbol_provider>>;
+        struct alignas(64) read_indicator {
+            std::atomic<std::size_t> readers{0};
+        };
+        //Marks the calling thread as reading one of the tables while alive.
+        class read_guard {
+            public:
+                read_guard(const symbol_index& index) noexcept;
+                ~read_guard();
+                const table& get() const noexcept { return *current; }
+            private:
+                std::atomic<std::size_t>& indicator;
+                const table * current;
+        };
+
+        symbol_index() = default;
+
+        void add(shared_library * library, const std::vector<std::pair<std::string, void *>>& symbols);
+        void remove(shared_library * library);
+        template<typename change_type>
+        void write(change_type change);
+
+        std::array<table, 2> tables;
+        std::atomic<unsigned int> left_right{0};
+        std::atomic<unsigned int> version{0};
+        mutable std::array<std::array<read_indicator, shard_count>, 2> indicators;
+        std::mutex writer;
+
+        static std::size_t thread_shard() noexcept;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief An interface for loading shared libraries at run-time.
+///
+/// @warning RLL doesn't support (at least at this time) the checking of symbol
+/// types. This means that RLL doesn't know the type of a symbol and can't
+/// safeguard against segmentation faults. This must be debugged and caught by
+/// you.
+///
+/// @details Hey! This is a simple class that allows for simple yet powerful
+/// interface for loading and processing shared libraries (dynamic libraries) at
+/// run-time. It is completely multi-platform (for the operating systems you
+/// have actually heard of at least, :P) and the API is too! 
+///
+/// It has an exception-based way of processing errors (no more error codes,
+/// yay!). This means if you haven't properly loaded a library before you try to
+/// get a symbol or something it will throw an error.
+///
+/// `shared_library` is this class with the default policies. The policies pick
+/// the synchronization, error handling and symbol caching at compile time, so
+/// e.g. a single-threaded, exception-free program can use
+/// `basic_shared_library<lock_policies::no_lock, error_policies::return_errors>`
+/// and pay for neither.
+///
+/// Better than anything is a code example:
+/// ```cpp
+/// //Contains a function add two integers:
+/// rll::shared_library test_lib;
+/// try {
+///     test_lib.load("test_lib.so");
+/// } catch(rll::exception::library_loading_error& e) {
+///     std::cout << "Oh noes! We had an issue loading the shared library:\n" << e.what() << "\n"; 
+/// }
+///
+/// std::function<int(int, int)> add_function;
+///
+/// if(test_lib.has_symbol("add")){
+///     add_function = test_lib.get_function_symbol<int(int, int)>("add"));
+/// }
+///
+/// std::cout << add_function(2, 4) << "\n"; //returns "6";
+///
+/// test_lib.unload(); //Clears object and closes the shared library.
+///
+/// //Repeat...
+/// ```
+///
+/// @tparam lock_policy How the library's state is locked, from
+/// `lock_policies`. Loads and unloads still serialize process-wide.
+/// @tparam error_policy How errors are reported, from `error_policies`.
+/// @tparam cache_policy Which caches symbol lookups use, from
+/// `cache_policies`.
+////////////////////////////////////////////////////////////////////////////////
+template<typename lock_policy, typename error_policy, typename cache_policy>
+class basic_shared_library {
+	private:
+		basic_shared_library(const basic_shared_library&);
+		basic_shared_library& operator=(const basic_shared_library&);
+		//
+		std::string lib_path;
+		void * lib_handle;
+		int lib_flags = 0;
+		load_report lib_report;
+		std::shared_ptr<const address_index> lib_address_index;
+		std::unordered_map<std::string, void *> lib_symbols;
+		std::shared_ptr<detail::elf_image> lib_image;
+		bool lib_indexed = false;
+		bool lib_namespaced = false;
+		std::shared_ptr<const std::unordered_map<std::string, void *>> lib_demangled;
+		std::shared_ptr<detail::symbol_offset_cache> lib_offsets;
+		lock_policy lib_lock;
+		//
+		//Return whether this call loaded the library.
+		bool load(const std::string& path, int flags, unsigned int options);
+		bool load_image(const std::string& path, const std::string& file, unsigned int options);
+		void index_symbols();
+		void leak();
+		void open_offset_cache();
+		void unload(bool park);
+		void warm(unsigned int options);
+		friend class library_set;
+	public:
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Construct a new shared library object.
+		////////////////////////////////////////////////////////////////////////////////
+		basic_shared_library();
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Destroy the shared library object.
+		////////////////////////////////////////////////////////////////////////////////
+		virtual ~basic_shared_library();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Loads a shared library from a given path. 
+		///
+		/// @details This ctor takes the path to a shared library and then loads
+		/// it with no flags on Windows or the default flag
+		/// (RTLD_LAZY/LOAD_LAZY) on Unix. If it fails to load the shared
+		/// library it will throw a `library_not_loaded` exception with the
+		/// relevant information. If a library is already loaded into the object
+		/// then it throws a `library_already_loaded` exception.
+		///
+		/// @param path The path to the shared library.
+		///
+		/// @throw rll::exception::library_loading_error 
+		/// @throw rll::exception::library_already_loaded
+		////////////////////////////////////////////////////////////////////////////////
+		void load(const std::string& path){ load(path, loader_flags()); }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Loads a shared library from a path with flags.
+		///
+		/// @details This ctor takes the path to shared library and also
+		/// loader_flags. These flags tell the platform backend how to load the
+		/// library. It also throws the same exception as the other overload
+		/// (`load(std::string)`).
+		///
+		/// On Linux, files compressed with LZ4 (frame format, as written by
+		/// the `lz4` tool) are decompressed into an anonymous memory file and
+		/// loaded from there. Corrupt ones throw `library_loading_error`.
+		///
+		/// @param path The path to the shared library. 
+		/// @param flags The flags that are used by the platform backend.
+		///
+		/// @see load
+		///
+		/// @throw rll::exception::library_loading_error 
+		/// @throw rll::exception::library_already_loaded
+		////////////////////////////////////////////////////////////////////////////////
+		void load(const std::string& path, loader_flags flags);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Unloads the loaded if there is one loaded.
+		////////////////////////////////////////////////////////////////////////////////
+		void unload();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Unloads the library and checks that its mappings went away.
+		///
+		/// @details The loaded objects are listed (`dl_iterate_phdr`) after
+		/// closing the library. If it is still there the result says what
+		/// holds it. The check itself doesn't keep anything loaded. Where it
+		/// can't be checked, the library is still unloaded before
+		/// `not_supported` is raised.
+		///
+		/// @param bypass_warm_pool Close the library even if the warm pool is
+		/// enabled.
+		/// @return unload_verification What happened.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		unload_verification unload_and_verify(bool bypass_warm_pool = true);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Returns whether a shared library has been loaded into the object.
+		/// @return true A shared library is loaded.
+		/// @return false A shared library isn't loaded.
+		////////////////////////////////////////////////////////////////////////////////
+		bool is_loaded();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Returns whether the loaded shared library has a symbol in it.
+		///
+		/// @details It looks for a symbol. Simple as that. But if a library
+		/// hasn't been loaded it throws an `library_not_loaded` exception.
+		///
+		/// @param name The name of the symbol.
+		/// @return true The symbol was found.
+		/// @return false The symbol wasn't found.
+		///
+		/// @throw rll::exception::library_not_loaded
+		////////////////////////////////////////////////////////////////////////////////
+		bool has_symbol(const std::string& name){ return get_symbol_fast(name) != nullptr; }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Attempts to retrieve a symbol.
+		///
+		/// @details It attempts to find a symbol but if it can't find a symbol
+		/// it throws a `symbol_not_found` error. If a shared library has not
+		/// been loaded into the object then it throws a `library_not_loaded`
+		/// exception. 
+		///
+		/// @warning C++ library symbols are NOT demangled! Use
+		/// `get_demangled_symbol` to look them up by their signature.
+		///
+		/// @param name The name of the symbol. 
+		/// @return void * The pointer to the retrieved symbol.
+		///
+		/// @throw rll::exception::library_not_loaded 
+		/// @throw rll::exception::symbol_not_found
+		////////////////////////////////////////////////////////////////////////////////
+		void * get_symbol(const std::string& name);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Attempts to retrieve a C++ symbol by its demangled name.
+		///
+		/// @details The first call demangles the whole dynamic symbol table
+		/// into an index that is kept until the library is unloaded, later
+		/// calls are a single hash lookup. The signature must be spelled the
+		/// way the platform demangler prints it, e.g.
+		/// `"ns::foo(int, char const*)"`.
+		///
+		/// If a cache directory is set (see `set_demangle_cache_directory`)
+		/// the index is saved there, keyed by the library's build-id, and later
+		/// processes skip the demangling.
+		///
+		/// @param signature The demangled name of the symbol.
+		/// @return void * The pointer to the retrieved symbol.
+		///
+		/// @throw rll::exception::library_not_loaded 
+		/// @throw rll::exception::symbol_not_found
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		void * get_demangled_symbol(const std::string& signature);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Attempts to get a std::function pointing to a C++ function
+		/// symbol by its demangled name.
+		/// 
+		/// @tparam signature The function signature.
+		/// @param name The demangled name of the symbol.
+		/// @return std::function<signature> The returned function symbol.
+		///
+		/// @see get_demangled_symbol
+		////////////////////////////////////////////////////////////////////////////////
+		template<typename signature>
+		std::function<signature> get_demangled_function_symbol(const std::string& name){
+			return reinterpret_cast<signature *>(get_demangled_symbol(name));
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Sets the directory the demangled symbol indexes are cached
+		/// in.
+		///
+		/// @details An empty path (the default) turns the cache off. The
+		/// directory must already exist.
+		///
+		/// @param directory The cache directory.
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_demangle_cache_directory(const std::string& directory);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Sets the directory the symbol offset caches are kept in.
+		///
+		/// @details Used by libraries loaded with
+		/// `rll_flags::CACHE_SYMBOL_OFFSETS`. An empty path (the default)
+		/// turns the cache off. The directory must already exist.
+		///
+		/// @param directory The cache directory.
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_offset_cache_directory(const std::string& directory);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Sets the digests of the files `rll_flags::VERIFY_INTEGRITY`
+		/// lets load.
+		///
+		/// @param digests XXH64 digests as 16 hex digits, as returned by
+		/// `get_file_digest`. They replace the previous ones.
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_trusted_digests(const std::vector<std::string>& digests);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Sets the file the digests of verified files are kept in.
+		///
+		/// @details Digests are always cached for the life of the process.
+		/// With a file they are also shared between processes and runs, so
+		/// unchanged files are never hashed twice. An empty path (the default)
+		/// keeps them in memory only. Whoever can write the file can make
+		/// RLL trust a changed library, so it is ignored (neither read nor
+		/// written) unless the effective user owns it and neither its group
+		/// nor others can write it.
+		///
+		/// @param file The cache file. It is created if it doesn't exist.
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_integrity_cache_file(const std::string& file);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the XXH64 digest `rll_flags::VERIFY_INTEGRITY` checks for
+		/// a file.
+		///
+		/// @param path The path to the file.
+		/// @return std::string The digest as 16 hex digits.
+		///
+		/// @throw rll::exception::library_loading_error
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		static std::string get_file_digest(const std::string& path);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Attempts to get a pointer to the object at a symbol.
+        /// 
+        /// @tparam object_type The type of the symbol being accessed.
+        /// @param name The name of the symbol.
+        /// @return object_type* A pointer to the object being accessed.
+        ////////////////////////////////////////////////////////////////////////////////
+        template<typename object_type>
+        object_type * get_object_symbol(const std::string& name){
+            return reinterpret_cast<object_type *>(get_symbol(name));
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Attempts to get a std::function pointing to function symbol.
+        /// 
+        /// @tparam signature The function signature.
+        /// @param name The name of the symbol.
+        /// @return std::function<signature> The returned function symbol.
+        ////////////////////////////////////////////////////////////////////////////////
+        template<typename signature>
+        std::function<signature> get_function_symbol(const std::string& name){
+            return reinterpret_cast<signature *>(get_symbol(name));
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Attempts to get a function symbol that records the latency of
+        /// every call into a histogram.
+        ///
+        /// @details Disabling the histogram turns the timing off at run-time;
+        /// the wrapper then only checks the histogram's flag before calling.
+        ///
+        /// @tparam signature The function signature.
+        /// @param name The name of the symbol.
+        /// @param histogram The histogram that calls are recorded into. It must
+        /// outlive the returned function.
+        /// @return timed_function<signature> The timed function symbol.
+        ///
+        /// @throw rll::exception::library_not_loaded 
+        /// @throw rll::exception::symbol_not_found
+        ////////////////////////////////////////////////////////////////////////////////
+        template<typename signature>
+        timed_function<signature> get_timed_function_symbol(const std::string& name, latency_histogram& histogram){
+            return timed_function<signature>(reinterpret_cast<signature *>(get_symbol(name)), histogram);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get a symbol without exception handling.
+        ///
+        /// @details A fast symbol accessor that doesn't handle exception states
+        /// for faster runtimes. This is only to be used if you know what you
+        /// are doing. You can get any errors with the corresponding platform
+        /// backends.
+        ///
+        /// @param name The name of the symbol attempting to be accessed.
+        /// @return void* A pointer to the accessed symbol (typically a nullptr
+        /// if it failed.)
+        ////////////////////////////////////////////////////////////////////////////////
+        void * get_symbol_fast(const std::string& name) noexcept;
 
 		////////////////////////////////////////////////////////////////////////////////
 		/// @brief Get the path to the loaded shared library.
@@ -359,12 +1560,96 @@ class shared_library {
 		///
 		/// @details It does what the label says. It also *doesn't* throw a
 		/// `library_not_loaded` exception if a library has not been loaded. In
-		/// such a case it will (probably) return a null pointer.
+		/// such a case it will (probably) return a null pointer. Libraries
+		/// loaded with `rll_flags::USERSPACE_LOADER` have no platform handle,
+		/// the returned pointer only identifies the library to RLL.
 		///
 		/// @return void * The pointer to the platform library handle.
 		////////////////////////////////////////////////////////////////////////////////
 		void * get_platform_handle();
 
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the report of what loading the library cost.
+		///
+		/// @details The dependency tree is only filled in if the library was
+		/// loaded with `rll_flags::RECORD_LOAD_REPORT`.
+		///
+		/// @return const load_report& The report of the last load.
+		///
+		/// @throw rll::exception::library_not_loaded
+		////////////////////////////////////////////////////////////////////////////////
+		const load_report& get_load_report();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Measures the memory the loaded library takes up.
+		///
+		/// @details It maps the library's loadable segments onto the kernel's
+		/// per-mapping accounting (`/proc/self/smaps`). Reading that file walks
+		/// the page tables, so don't call this on a hot path.
+		///
+		/// @return library_memory_usage The footprint per segment and in total.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		library_memory_usage memory_usage();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Measures the memory of every library loaded in the process.
+		///
+		/// @details This includes libraries that weren't loaded by RLL. The
+		/// kernel accounting is read once for all of them.
+		///
+		/// @return std::vector<library_memory_usage> One footprint per loaded
+		/// object, in the platform loader's order.
+		///
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		static std::vector<library_memory_usage> process_memory_usage();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get an index from addresses to the library's exported
+		/// functions and objects.
+		///
+		/// @details The index is built from the dynamic symbol table on the
+		/// first call and kept until the library is unloaded. Lookups on the
+		/// returned index don't take any locks (unlike `dladdr`).
+		///
+		/// @param demangle Whether to also store demangled C++ names. Only
+		/// honoured by the call that builds the index.
+		/// @return std::shared_ptr<const address_index> The index.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::not_supported
+		////////////////////////////////////////////////////////////////////////////////
+		std::shared_ptr<const address_index> get_address_index(bool demangle = false);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Sets the limits of the pool of recently unloaded libraries.
+		///
+		/// @details Parked libraries over the new limits are closed right
+		/// away. The pool is disabled by default.
+		///
+		/// @param limits The new limits.
+		///
+		/// @see warm_pool_limits
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_warm_pool_limits(const warm_pool_limits& limits);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Closes the parked libraries whose keep-alive has run out.
+		///
+		/// @details Meant to be called periodically by programs that stop
+		/// loading and unloading for a while.
+		////////////////////////////////////////////////////////////////////////////////
+		static void trim_warm_pool();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the number of libraries parked in the pool.
+		/// @return std::size_t The number of parked libraries.
+		////////////////////////////////////////////////////////////////////////////////
+		static std::size_t warm_pool_size();
+
 		////////////////////////////////////////////////////////////////////////////////
 		/// @brief Get the platform suffix for shared/dynamic libraries.
 		///
@@ -378,6 +1663,98 @@ class shared_library {
 		static std::string get_platform_suffix();
 };
 
+namespace shutdown_policies {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief How a `library_set` tears its libraries down.
+////////////////////////////////////////////////////////////////////////////////
+enum shutdown_policy {
+    //Unload the libraries one at a time, most recently loaded first.
+    CLOSE,
+    //Never close the libraries. Their destructors don't run and the operating
+    //system reclaims everything when the process exits.
+    LEAK,
+    //Unload the libraries in reverse dependency order, running the libraries
+    //that don't depend on each other on worker threads.
+    PARALLEL,
+    //Like PARALLEL, but only for the libraries registered as needing
+    //finalization. The others are leaked.
+    HYBRID,
+};
+} //shutdown_policies
+
+using shutdown_policy = shutdown_policies::shutdown_policy;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A set of libraries that are torn down together under one shutdown
+/// policy.
+///
+/// @details Meant for process exit and rolling restarts, where closing many
+/// libraries one at a time and running destructors nobody needs dominates the
+/// shutdown time. The dependency order comes from the libraries' `DT_NEEDED`
+/// entries, so libraries are only torn down in parallel on ELF platforms;
+/// elsewhere PARALLEL and HYBRID close them one at a time.
+///
+/// The platform loader runs finalizers under its own lock, so most of the
+/// parallelism comes from libraries loaded with `rll_flags::USERSPACE_LOADER`
+/// and from RLL's own bookkeeping.
+////////////////////////////////////////////////////////////////////////////////
+class library_set {
+    public:
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @param policy The shutdown policy.
+        /// @param threads The most worker threads used for teardown, 0 for
+        /// one per hardware thread.
+        ////////////////////////////////////////////////////////////////////////////////
+        library_set(shutdown_policy policy = shutdown_policies::CLOSE, unsigned int threads = 0) : policy(policy), threads(threads){}
+        library_set(const library_set&) = delete;
+        library_set& operator=(const library_set&) = delete;
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Tears the libraries down with `shutdown()`.
+        ////////////////////////////////////////////////////////////////////////////////
+        ~library_set();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Loads a library into the set.
+        ///
+        /// @param path The path to the shared library.
+        /// @param flags The flags that are used by the platform backend.
+        /// @param needs_finalization Whether the HYBRID policy must unload it.
+        /// @return shared_library& The library. It belongs to the set.
+        ///
+        /// @throw rll::exception::library_loading_error 
+        ////////////////////////////////////////////////////////////////////////////////
+        shared_library& load(const std::string& path, loader_flags flags = loader_flags(), bool needs_finalization = false);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Changes whether the HYBRID policy must unload a library.
+        ///
+        /// @return false The library isn't in the set.
+        ////////////////////////////////////////////////////////////////////////////////
+        bool set_needs_finalization(const shared_library& library, bool needs_finalization);
+
+        void set_policy(shutdown_policy new_policy);
+        shutdown_policy get_policy();
+        std::size_t size();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Tears every library down according to the policy and empties
+        /// the set.
+        ////////////////////////////////////////////////////////////////////////////////
+        void shutdown();
+    private:
+        struct member {
+            std::unique_ptr<shared_library> library;
+            bool needs_finalization;
+        };
+
+        std::mutex mutex;
+        std::vector<member> members;
+        shutdown_policy policy;
+        unsigned int threads;
+
+        static std::vector<std::vector<shared_library *>> teardown_waves(const std::vector<shared_library *>& libraries);
+};
+
 //------------------------------RLL_DEFINITIONS-------------------------------//
 #define RLL_DEFINE_EXCEPTION_W_METADATA(EXCP_NAME, METADATA_TYPE, METADATA_NAME, WHAT_RETURN) \
     class EXCP_NAME : public rll_exception { \
@@ -397,27 +1774,239 @@ class shared_library {
             } \
     }; \
 
-namespace exception {
-////////////////////////////////////////////////////////////////////////////////
-/// @brief If a symbol was not found in a shared library this exception is thrown.
-////////////////////////////////////////////////////////////////////////////////
-RLL_DEFINE_EXCEPTION_W_METADATA(symbol_not_found, std::string, symbol_name, return symbol_name.c_str();)
-////////////////////////////////////////////////////////////////////////////////
-/// @brief If a loading method is invoked but a shared library already has
-/// something loaded this exception is thrown.
-////////////////////////////////////////////////////////////////////////////////
-RLL_DEFINE_EXCEPTION_W_METADATA(library_already_loaded, std::string, library_path, return library_path.c_str();)
-////////////////////////////////////////////////////////////////////////////////
-/// @brief If a accessor method is invoked but a shared library has no content
-/// loaded into it this exception is thrown.
-////////////////////////////////////////////////////////////////////////////////
-RLL_DEFINE_EXCEPTION(library_not_loaded, return "A shared_library has not been loaded with content before use.";)
-////////////////////////////////////////////////////////////////////////////////
-/// @brief If an error occurred while loading content into a shared library this
-/// exception is thrown.
-////////////////////////////////////////////////////////////////////////////////
-RLL_DEFINE_EXCEPTION_W_METADATA(library_loading_error, std::string, loading_error, return (loading_error != "" ? loading_error.c_str() : "Unknown Error.");)
-} //exception
+namespace exception {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If a symbol was not found in a shared library this exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(symbol_not_found, std::string, symbol_name, return symbol_name.c_str();)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If a loading method is invoked but a shared library already has
+/// something loaded this exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(library_already_loaded, std::string, library_path, return library_path.c_str();)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If a accessor method is invoked but a shared library has no content
+/// loaded into it this exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION(library_not_loaded, return "A shared_library has not been loaded with content before use.";)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If an error occurred while loading content into a shared library this
+/// exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(library_loading_error, std::string, loading_error, return (loading_error != "" ? loading_error.c_str() : "Unknown Error.");)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If a feature isn't available on the current platform this exception
+/// is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(not_supported, std::string, feature, return feature.c_str();)
+} //exception
+
+namespace detail {
+inline std::string json_escape(const std::string& text){
+    std::string escaped;
+    escaped.reserve(text.size());
+    for(char c : text){
+        switch(c){
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20){
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+//Returns an empty string if the name isn't a mangled C++ name.
+inline std::string demangle(const char * name){
+    #ifdef __GNUG__
+    int status = 0;
+    char * demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if(demangled != nullptr){
+        std::string result = demangled;
+        std::free(demangled);
+        return result;
+    }
+    #else
+    (void) name;
+    #endif
+    return "";
+}
+
+//Demangled name cache files: a header line with the build-id they were made
+//from, then one "demangled\tmangled" pair per line.
+inline bool read_demangle_cache(const std::string& file, const std::string& build_id, std::vector<std::pair<std::string, std::string>>& names){
+    std::ifstream in(file);
+    std::string line;
+    if(!in || !std::getline(in, line) || line != "RLL-DEMANGLED 1 " + build_id){
+        return false;
+    }
+    while(std::getline(in, line)){
+        std::string::size_type tab = line.find('\t');
+        if(tab == std::string::npos){
+            return false;
+        }
+        names.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+    }
+    return true;
+}
+
+//Written to a temporary file first so readers never see a partial cache.
+inline void write_demangle_cache(const std::string& file, const std::string& build_id, const std::vector<std::pair<std::string, std::string>>& names){
+    std::string temporary = file + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^ static_cast<std::size_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << "RLL-DEMANGLED 1 " << build_id << "\n";
+        for(auto& name : names){
+            out << name.first << "\t" << name.second << "\n";
+        }
+        if(!out){
+            out.close();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if(std::rename(temporary.c_str(), file.c_str()) != 0){
+        std::remove(temporary.c_str());
+    }
+}
+
+//A directory setting that loads read without taking the library mutex.
+class cache_directory {
+    public:
+        std::string get(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return path;
+        }
+        void set(const std::string& directory){
+            std::lock_guard<std::mutex> lock(mutex);
+            path = directory;
+        }
+    private:
+        std::mutex mutex;
+        std::string path;
+};
+
+inline cache_directory& offset_cache_directory(){
+    static cache_directory directory;
+    return directory;
+}
+
+inline cache_directory& demangle_cache_directory(){
+    static cache_directory directory;
+    return directory;
+}
+
+//Serializes loads and unloads across every `basic_shared_library`, whatever
+//its lock policy.
+inline std::mutex& loader_mutex(){
+    static std::mutex mutex;
+    return mutex;
+}
+
+//Recently unloaded platform handles, most recently used first. Handles that
+//fall out of the pool are handed back to the caller to close, so the pool
+//itself doesn't depend on the platform.
+class warm_pool {
+    public:
+        void set_limits(const warm_pool_limits& new_limits, std::vector<void *>& evicted){
+            std::lock_guard<std::mutex> lock(mutex);
+            limits = new_limits;
+            evict(evicted);
+        }
+
+        //Returns null if nothing usable is parked for the path and flags.
+        void * take(const std::string& path, int flags, std::vector<void *>& evicted){
+            std::lock_guard<std::mutex> lock(mutex);
+            evict(evicted);
+            for(auto it = entries.begin(); it != entries.end(); ++it){
+                if(it->flags == flags && it->path == path){
+                    void * handle = it->handle;
+                    bytes -= it->bytes;
+                    entries.erase(it);
+                    return handle;
+                }
+            }
+            return nullptr;
+        }
+
+        void park(const std::string& path, int flags, void * handle, std::size_t size, std::vector<void *>& evicted){
+            std::lock_guard<std::mutex> lock(mutex);
+            if(limits.max_libraries == 0){
+                evicted.push_back(handle);
+                return;
+            }
+            entries.push_front(entry{path, flags, handle, size, std::chrono::steady_clock::now()});
+            bytes += size;
+            evict(evicted);
+        }
+
+        void trim(std::vector<void *>& evicted){
+            std::lock_guard<std::mutex> lock(mutex);
+            evict(evicted);
+        }
+
+        std::size_t size(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return entries.size();
+        }
+
+        bool contains(const void * handle){
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto& parked : entries){
+                if(parked.handle == handle){
+                    return true;
+                }
+            }
+            return false;
+        }
+    private:
+        struct entry {
+            std::string path;
+            int flags;
+            void * handle;
+            std::size_t bytes;
+            std::chrono::steady_clock::time_point parked;
+        };
+
+        std::mutex mutex;
+        warm_pool_limits limits;
+        std::list<entry> entries;
+        std::size_t bytes = 0;
+
+        void evict(std::vector<void *>& evicted){
+            if(limits.keep_alive.count() != 0){
+                auto now = std::chrono::steady_clock::now();
+                for(auto it = entries.begin(); it != entries.end();){
+                    if(now - it->parked >= limits.keep_alive){
+                        bytes -= it->bytes;
+                        evicted.push_back(it->handle);
+                        it = entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            while(!entries.empty() && (entries.size() > limits.max_libraries || (limits.max_bytes != 0 && bytes > limits.max_bytes))){
+                bytes -= entries.back().bytes;
+                evicted.push_back(entries.back().handle);
+                entries.pop_back();
+            }
+        }
+};
+
+inline warm_pool& get_warm_pool(){
+    static warm_pool pool;
+    return pool;
+}
+} //detail
 
 //Shared library platform implementations:
 #ifdef RLL_PLATFORM_IS_WINDOWS
@@ -428,18 +2017,34 @@ RLL_DEFINE_EXCEPTION_W_METADATA(library_loading_error, std::string, loading_erro
 #include "platform/sl_windows_impl.inl"
 #else
 #include <dlfcn.h>
+#if defined(__GLIBC__) && defined(LM_ID_NEWLM)
+#define RLL_HAS_LINK_MAP_NAMESPACES
+#endif
+#ifdef RLL_PLATFORM_IS_ELF
+#include "platform/elf_introspection.inl"
+#include "platform/elf_loader.inl"
+#include "platform/elf_offset_cache.inl"
+#ifdef __linux__
+#include "platform/lz4_frame.inl"
+#include "platform/file_integrity.inl"
+#endif
+#endif
 #include "platform/sl_unix_impl.inl"
 #endif
 
-inline loader_flags::loader_flags(std::initializer_list<unix_flag> unix_flags, std::initializer_list<windows_flag> windows_flags){
+inline loader_flags::loader_flags(std::initializer_list<unix_flag> unix_flags, std::initializer_list<windows_flag> windows_flags, std::initializer_list<rll_flag> rll_flags){
     uflags = 0;
     wflags = 0;
+    rflags = 0;
     for(auto& it : unix_flags){
         add_flag(it);
     }
     for(auto& it : windows_flags){
         add_flag(it);
     }
+    for(auto& it : rll_flags){
+        add_flag(it);
+    }
 }
 
 inline void loader_flags::add_flag(unix_flag flag){ 
@@ -458,6 +2063,7 @@ inline void loader_flags::add_flag(unix_flag flag){
 }
 
 inline void loader_flags::add_flag(windows_flag flag){ wflags |= flag; }
+inline void loader_flags::add_flag(rll_flag flag){ rflags |= flag; }
 
 inline void loader_flags::remove_flag(unix_flag flag){ 
     if(flag == unix_flags::LOAD_LAZY){
@@ -471,6 +2077,7 @@ inline void loader_flags::remove_flag(unix_flag flag){
     uflags &= ~flag; 
 }
 inline void loader_flags::remove_flag(windows_flag flag){ wflags &= ~flag; }
+inline void loader_flags::remove_flag(rll_flag flag){ rflags &= ~flag; }
 
 inline bool loader_flags::has_flag(unix_flag flag){
     return true ? ((uflags & flag) == flag) : false;
@@ -478,12 +2085,901 @@ inline bool loader_flags::has_flag(unix_flag flag){
 inline bool loader_flags::has_flag(windows_flag flag){
     return true ? ((wflags & flag) == flag) : false;
 }
+inline bool loader_flags::has_flag(rll_flag flag){
+    return (rflags & flag) == flag;
+}
 
 inline void loader_flags::clear_unix_flags(){ uflags = unix_flags::LOAD_LAZY; }
 inline void loader_flags::clear_windows_flags(){ wflags = 0; }
+inline void loader_flags::clear_rll_flags(){ rflags = 0; }
 
 inline unsigned int loader_flags::get_unix_flags(){ return uflags; }
 inline unsigned int loader_flags::get_windows_flags(){ return wflags; }
+inline unsigned int loader_flags::get_rll_flags(){ return rflags; }
+
+inline std::string unload_verification::describe() const {
+    if(unmapped){
+        return path + ": unmapped";
+    }
+    static const std::pair<unload_blocker, const char *> names[] = {
+        { unload_blockers::NODELETE_FLAG, "linked with -z nodelete" },
+        { unload_blockers::NODELETE_LOAD, "loaded with LOAD_NODELETE" },
+        { unload_blockers::UNIQUE_SYMBOLS, "defines unique symbols" },
+        { unload_blockers::DEPENDENTS, "needed by other objects" },
+        { unload_blockers::WARM_POOL, "parked in the warm pool" },
+        { unload_blockers::OTHER_REFERENCES, "still referenced by other handles" },
+    };
+    std::string text = path + ": still mapped";
+    const char * separator = " (";
+    for(auto& name : names){
+        if(blockers & name.first){
+            text += separator;
+            text += name.second;
+            separator = ", ";
+        }
+    }
+    for(auto& dependent : dependents){
+        text += separator;
+        text += dependent;
+        separator = ", ";
+    }
+    if(std::strcmp(separator, ", ") == 0){
+        text += ")";
+    }
+    return text;
+}
+
+inline std::size_t load_report::newly_mapped_size() const {
+    std::size_t size = 0;
+    for(auto& entry : entries){
+        if(entry.newly_mapped){
+            size += entry.mapped_size;
+        }
+    }
+    return size;
+}
+
+inline void address_index::add(std::uintptr_t address, std::size_t size, const char * name, const std::string& demangled_name){
+    starts.push_back(address);
+    ends.push_back(address + size);
+    names.push_back(static_cast<std::uint32_t>(strings.size()));
+    strings.append(name).push_back('\0');
+    if(demangled_name.empty()){
+        demangled_names.push_back(UINT32_MAX);
+    } else {
+        demangled_names.push_back(static_cast<std::uint32_t>(strings.size()));
+        strings.append(demangled_name).push_back('\0');
+    }
+}
+
+inline void address_index::finish(const std::string& library){
+    library_name = library;
+
+    std::vector<std::size_t> order(starts.size());
+    for(std::size_t i = 0; i < order.size(); i++){
+        order[i] = i;
+    }
+    //Sized symbols first so that they win over unsized aliases at the same address.
+    std::stable_sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b){
+        if(starts[a] != starts[b]){
+            return starts[a] < starts[b];
+        }
+        return (ends[a] - starts[a]) > (ends[b] - starts[b]);
+    });
+
+    std::vector<std::uintptr_t> sorted_starts, sorted_ends;
+    std::vector<std::uint32_t> sorted_names, sorted_demangled_names;
+    for(std::size_t i : order){
+        if(!sorted_starts.empty() && sorted_starts.back() == starts[i]){
+            continue;
+        }
+        sorted_starts.push_back(starts[i]);
+        sorted_ends.push_back(ends[i]);
+        sorted_names.push_back(names[i]);
+        sorted_demangled_names.push_back(demangled_names[i]);
+    }
+    for(std::size_t i = 0; i < sorted_starts.size(); i++){
+        if(sorted_ends[i] == sorted_starts[i]){
+            sorted_ends[i] = (i + 1 < sorted_starts.size()) ? sorted_starts[i + 1] : UINTPTR_MAX;
+        }
+    }
+
+    starts.swap(sorted_starts);
+    ends.swap(sorted_ends);
+    names.swap(sorted_names);
+    demangled_names.swap(sorted_demangled_names);
+    starts.shrink_to_fit();
+    ends.shrink_to_fit();
+    names.shrink_to_fit();
+    demangled_names.shrink_to_fit();
+}
+
+inline address_index::symbol_info address_index::lookup(const void * address) const noexcept {
+    symbol_info info;
+    std::uintptr_t value = reinterpret_cast<std::uintptr_t>(address);
+    if(starts.empty() || value < starts[0]){
+        return info;
+    }
+
+    //Branchless binary search for the last start <= value.
+    const std::uintptr_t * base = starts.data();
+    std::size_t length = starts.size();
+    while(length > 1){
+        std::size_t half = length / 2;
+        base = (base[half] <= value) ? base + half : base;
+        length -= half;
+    }
+    std::size_t i = static_cast<std::size_t>(base - starts.data());
+
+    if(value >= ends[i]){
+        return info;
+    }
+    info.library = library_name.c_str();
+    info.name = strings.c_str() + names[i];
+    if(demangled_names[i] != UINT32_MAX){
+        info.demangled_name = strings.c_str() + demangled_names[i];
+    }
+    info.symbol_address = starts[i];
+    info.offset = value - starts[i];
+    return info;
+}
+
+inline std::size_t latency_histogram::bucket_of(std::uint64_t value) noexcept {
+    constexpr std::uint64_t sub_bucket_count = std::uint64_t(1) << sub_bucket_bits;
+    if(value < sub_bucket_count){
+        return static_cast<std::size_t>(value);
+    }
+    std::size_t exponent = 63;
+    while(((value >> exponent) & 1) == 0){
+        exponent--;
+    }
+    if(exponent >= max_value_bits){
+        return bucket_count - 1;
+    }
+    std::size_t shift = exponent - sub_bucket_bits;
+    return static_cast<std::size_t>(((shift + 1) << sub_bucket_bits) + ((value >> shift) - sub_bucket_count));
+}
+
+inline std::uint64_t latency_histogram::bucket_upper_bound(std::size_t bucket) noexcept {
+    constexpr std::uint64_t sub_bucket_count = std::uint64_t(1) << sub_bucket_bits;
+    if(bucket < sub_bucket_count){
+        return bucket;
+    }
+    if(bucket == bucket_count - 1){
+        return UINT64_MAX;
+    }
+    std::size_t shift = (bucket >> sub_bucket_bits) - 1;
+    std::uint64_t mantissa = sub_bucket_count + (bucket & (sub_bucket_count - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+inline std::size_t latency_histogram::thread_shard() noexcept {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return shard;
+}
+
+inline void latency_histogram::record(std::chrono::nanoseconds value) noexcept {
+    std::uint64_t ns = value.count() > 0 ? static_cast<std::uint64_t>(value.count()) : 0;
+    shard& target = shards[thread_shard()];
+    target.counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    target.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    std::uint64_t max = target.max_ns.load(std::memory_order_relaxed);
+    while(ns > max && !target.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)){}
+}
+
+inline latency_histogram::snapshot latency_histogram::merge() const {
+    snapshot merged;
+    for(auto& shard : shards){
+        for(std::size_t i = 0; i < bucket_count; i++){
+            std::uint64_t count = shard.counts[i].load(std::memory_order_relaxed);
+            merged.counts[i] += count;
+            merged.count += count;
+        }
+        merged.total_ns += shard.total_ns.load(std::memory_order_relaxed);
+        merged.max_ns = std::max(merged.max_ns, shard.max_ns.load(std::memory_order_relaxed));
+    }
+    return merged;
+}
+
+inline void latency_histogram::reset() noexcept {
+    for(auto& shard : shards){
+        for(auto& count : shard.counts){
+            count.store(0, std::memory_order_relaxed);
+        }
+        shard.total_ns.store(0, std::memory_order_relaxed);
+        shard.max_ns.store(0, std::memory_order_relaxed);
+    }
+}
+
+inline std::chrono::nanoseconds latency_histogram::snapshot::percentile(double percentile) const {
+    if(count == 0){
+        return std::chrono::nanoseconds(0);
+    }
+    std::uint64_t rank = static_cast<std::uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.5);
+    rank = std::min(std::max<std::uint64_t>(rank, 1), count);
+    std::uint64_t seen = 0;
+    for(std::size_t i = 0; i < bucket_count; i++){
+        seen += counts[i];
+        if(seen >= rank){
+            return std::chrono::nanoseconds(std::min(bucket_upper_bound(i), max_ns));
+        }
+    }
+    return std::chrono::nanoseconds(max_ns);
+}
+
+inline std::chrono::nanoseconds latency_histogram::snapshot::mean() const {
+    return std::chrono::nanoseconds(count ? total_ns / count : 0);
+}
+
+inline void latency_histogram::snapshot::add(const snapshot& other){
+    for(std::size_t i = 0; i < bucket_count; i++){
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    total_ns += other.total_ns;
+    max_ns = std::max(max_ns, other.max_ns);
+}
+
+inline std::string load_report::to_json() const {
+    std::string json = "{\"path\":\"" + detail::json_escape(path) + "\"";
+    json += ",\"load_time_ns\":" + std::to_string(load_time.count());
+    json += ",\"newly_mapped_size\":" + std::to_string(newly_mapped_size());
+    json += ",\"warm_time_ns\":" + std::to_string(warm_time.count());
+    json += ",\"prefaulted_size\":" + std::to_string(prefaulted_size);
+    json += ",\"locked_size\":" + std::to_string(locked_size);
+    json += ",\"entries\":[";
+    for(std::size_t i = 0; i < entries.size(); i++){
+        const dependency_entry& entry = entries[i];
+        json += (i ? ",{" : "{");
+        json += "\"name\":\"" + detail::json_escape(entry.name) + "\"";
+        json += ",\"path\":\"" + detail::json_escape(entry.path) + "\"";
+        json += ",\"resolved\":" + std::string(entry.resolved ? "true" : "false");
+        json += ",\"newly_mapped\":" + std::string(entry.newly_mapped ? "true" : "false");
+        json += ",\"base\":" + std::to_string(entry.base);
+        json += ",\"mapped_size\":" + std::to_string(entry.mapped_size);
+        json += ",\"needed\":[";
+        for(std::size_t j = 0; j < entry.needed.size(); j++){
+            json += (j ? "," : "") + std::to_string(entry.needed[j]);
+        }
+        json += "]}";
+    }
+    json += "]}";
+    return json;
+}
+
+inline startup_manifest::~startup_manifest(){
+    stop_recording();
+    release();
+}
+
+inline void startup_manifest::start_recording(){
+    recording().store(this, std::memory_order_release);
+}
+
+inline void startup_manifest::stop_recording(){
+    startup_manifest * self = this;
+    recording().compare_exchange_strong(self, nullptr, std::memory_order_acq_rel);
+}
+
+inline void startup_manifest::record_load(const std::string& path, void * handle, unsigned int native_flags, unsigned int rll_flags){
+    library_entry entry;
+    entry.path = path;
+    entry.native_flags = native_flags;
+    entry.rll_flags = rll_flags;
+    detail::describe_library(handle, entry.resolved_path, entry.build_id);
+    const std::string& key = entry.resolved_path.empty() ? entry.path : entry.resolved_path;
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    for(std::size_t i = 0; i < entries.size(); i++){
+        const std::string& other = entries[i].resolved_path.empty() ? entries[i].path : entries[i].resolved_path;
+        if(other == key){
+            entries_by_handle[handle] = i;
+            return;
+        }
+    }
+    entries.push_back(entry);
+    recorded_symbols.emplace_back();
+    entries_by_handle[handle] = entries.size() - 1;
+}
+
+inline void startup_manifest::record_symbol(void * handle, const std::string& name){
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    auto it = entries_by_handle.find(handle);
+    if(it != entries_by_handle.end() && recorded_symbols[it->second].insert(name).second){
+        entries[it->second].symbols.push_back(name);
+    }
+}
+
+inline bool startup_manifest::save(const std::string& file) const {
+    std::ofstream out(file, std::ios::trunc);
+    if(!out){
+        return false;
+    }
+    out << "RLL-MANIFEST 1\n";
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    for(auto& entry : entries){
+        out << "L\t" << entry.native_flags << "\t" << entry.rll_flags << "\t" << entry.build_id << "\t" << entry.path << "\t" << entry.resolved_path << "\n";
+        for(auto& symbol : entry.symbols){
+            out << "S\t" << symbol << "\n";
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+inline bool startup_manifest::open(const std::string& file){
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries.clear();
+    recorded_symbols.clear();
+    entries_by_handle.clear();
+
+    std::ifstream in(file);
+    std::string line;
+    if(!in || !std::getline(in, line) || line != "RLL-MANIFEST 1"){
+        return false;
+    }
+    while(std::getline(in, line)){
+        std::vector<std::string> fields;
+        std::string::size_type start = 0, tab;
+        while((tab = line.find('\t', start)) != std::string::npos){
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        fields.push_back(line.substr(start));
+
+        if(fields[0] == "L" && fields.size() == 6){
+            library_entry entry;
+            entry.native_flags = static_cast<unsigned int>(std::strtoul(fields[1].c_str(), nullptr, 10));
+            entry.rll_flags = static_cast<unsigned int>(std::strtoul(fields[2].c_str(), nullptr, 10));
+            entry.build_id = fields[3];
+            entry.path = fields[4];
+            entry.resolved_path = fields[5];
+            entries.push_back(entry);
+            recorded_symbols.emplace_back();
+        } else if(fields[0] == "S" && fields.size() == 2 && !entries.empty()){
+            if(recorded_symbols.back().insert(fields[1]).second){
+                entries.back().symbols.push_back(fields[1]);
+            }
+        } else {
+            entries.clear();
+            recorded_symbols.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+inline startup_manifest::replay_result startup_manifest::replay(unsigned int threads){
+    replay_result result;
+    std::vector<library_entry> work = get_libraries();
+
+    //Checking build-ids and prefetching is I/O bound, so it is spread over
+    //threads. Loading isn't: the platform loader serializes it.
+    std::vector<char> stale(work.size(), 0);
+    std::atomic<std::size_t> next{0};
+    auto prefetch = [&](){
+        for(std::size_t i; (i = next.fetch_add(1)) < work.size();){
+            const std::string& file = work[i].resolved_path.empty() ? work[i].path : work[i].resolved_path;
+            if(!work[i].build_id.empty() && detail::file_build_id(file) != work[i].build_id){
+                stale[i] = 1;
+                continue;
+            }
+            detail::prefetch_file(file);
+        }
+    };
+    if(threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<std::thread> prefetchers;
+    for(unsigned int i = 1; i < threads && i < work.size(); i++){
+        prefetchers.emplace_back(prefetch);
+    }
+    prefetch();
+    for(auto& prefetcher : prefetchers){
+        prefetcher.join();
+    }
+
+    std::vector<library_entry> kept;
+    for(std::size_t i = 0; i < work.size(); i++){
+        if(stale[i]){
+            result.libraries_stale++;
+            continue;
+        }
+        kept.push_back(work[i]);
+
+        loader_flags flags({}, {});
+        for(unsigned int bit = 1; bit != 0; bit <<= 1){
+            if(work[i].native_flags & bit){
+                #ifdef RLL_PLATFORM_IS_WINDOWS
+                flags.add_flag(static_cast<windows_flag>(bit));
+                #else
+                flags.add_flag(static_cast<unix_flag>(bit));
+                #endif
+            }
+            if(work[i].rll_flags & bit){
+                flags.add_flag(static_cast<rll_flag>(bit));
+            }
+        }
+
+        std::unique_ptr<replayed_library> library(new replayed_library());
+        library->load(work[i].path, flags);
+        if(!library->is_loaded()){
+            result.libraries_failed++;
+            continue;
+        }
+        result.libraries_loaded++;
+
+        std::unordered_map<std::string, void *> symbols;
+        for(auto& name : work[i].symbols){
+            void * address = library->get_symbol_fast(name);
+            if(address != nullptr){
+                symbols[name] = address;
+            }
+        }
+        result.symbols_resolved += symbols.size();
+
+        resolved_table& table = resolved();
+        {
+            std::lock_guard<std::mutex> lock(table.mutex);
+            auto& known = table.symbols[library->get_platform_handle()];
+            known.insert(symbols.begin(), symbols.end());
+            table.size.store(table.symbols.size(), std::memory_order_release);
+        }
+        replayed.push_back(std::move(library));
+    }
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    if(result.libraries_stale != 0){
+        entries = kept;
+        recorded_symbols.clear();
+        entries_by_handle.clear();
+        for(auto& entry : entries){
+            recorded_symbols.emplace_back(entry.symbols.begin(), entry.symbols.end());
+        }
+    }
+    return result;
+}
+
+inline void startup_manifest::release(){
+    resolved_table& table = resolved();
+    {
+        std::lock_guard<std::mutex> lock(table.mutex);
+        for(auto& library : replayed){
+            table.symbols.erase(library->get_platform_handle());
+        }
+        table.size.store(table.symbols.size(), std::memory_order_release);
+    }
+    replayed.clear();
+}
+
+inline std::vector<startup_manifest::library_entry> startup_manifest::get_libraries() const {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    return entries;
+}
+
+inline bool startup_manifest::get_resolved_symbols(void * handle, std::unordered_map<std::string, void *>& symbols){
+    resolved_table& table = resolved();
+    if(table.size.load(std::memory_order_acquire) == 0){
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto it = table.symbols.find(handle);
+    if(it == table.symbols.end()){
+        return false;
+    }
+    symbols.insert(it->second.begin(), it->second.end());
+    return true;
+}
+
+inline symbol_index& symbol_index::global(){
+    static symbol_index index;
+    return index;
+}
+
+inline std::size_t symbol_index::thread_shard() noexcept {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % shard_count;
+    return shard;
+}
+
+inline symbol_index::read_guard::read_guard(const symbol_index& index) noexcept
+    : indicator(index.indicators[index.version.load() & 1][thread_shard()].readers) {
+    indicator.fetch_add(1);
+    current = &index.tables[index.left_right.load() & 1];
+}
+
+inline symbol_index::read_guard::~read_guard(){
+    indicator.fetch_sub(1, std::memory_order_release);
+}
+
+inline symbol_provider symbol_index::find(const std::string& name) const noexcept {
+    read_guard guard(*this);
+    auto it = guard.get().find(name);
+    if(it == guard.get().end()){
+        return symbol_provider();
+    }
+    return it->second.front();
+}
+
+inline std::vector<symbol_provider> symbol_index::find_all(const std::string& name) const {
+    read_guard guard(*this);
+    auto it = guard.get().find(name);
+    if(it == guard.get().end()){
+        return {};
+    }
+    return it->second;
+}
+
+inline std::size_t symbol_index::size() const noexcept {
+    read_guard guard(*this);
+    return guard.get().size();
+}
+
+template<typename change_type>
+inline void symbol_index::write(change_type change){
+    std::lock_guard<std::mutex> lock(writer);
+    unsigned int reading = left_right.load() & 1;
+    change(tables[reading ^ 1]);
+    left_right.store(reading ^ 1);
+
+    //New readers see the updated table. Flip the version and wait out the
+    //readers that may still be in the old one before changing it as well.
+    auto drain = [this](unsigned int which){
+        for(auto& shard : indicators[which]){
+            while(shard.readers.load(std::memory_order_acquire) != 0){
+                std::this_thread::yield();
+            }
+        }
+    };
+    unsigned int old_version = version.load() & 1;
+    drain(old_version ^ 1);
+    version.store(old_version ^ 1);
+    drain(old_version);
+    change(tables[reading]);
+}
+
+inline void symbol_index::add(shared_library * library, const std::vector<std::pair<std::string, void *>>& symbols){
+    write([&](table& names){
+        for(auto& symbol : symbols){
+            names[symbol.first].push_back(symbol_provider{library, symbol.second});
+        }
+    });
+}
+
+inline void symbol_index::remove(shared_library * library){
+    write([library](table& names){
+        for(auto it = names.begin(); it != names.end();){
+            auto& providers = it->second;
+            providers.erase(std::remove_if(providers.begin(), providers.end(), [library](const symbol_provider& provider){
+                return provider.library == library;
+            }), providers.end());
+            if(providers.empty()){
+                it = names.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    });
+}
+
+#ifdef RLL_ENABLE_TRACING
+namespace tracing {
+namespace detail {
+struct event {
+    const char * name;
+    char phase;
+    std::uint64_t timestamp_ns;
+    char detail[64];
+};
+
+//Written only by its thread (head) and drained only by the exporter (tail).
+struct ring {
+    static constexpr std::size_t capacity = 4096;
+    std::array<event, capacity> events;
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::size_t thread = 0;
+};
+
+struct registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ring>> rings;
+    std::atomic<std::size_t> dropped{0};
+};
+
+inline registry& get_registry(){
+    static registry instance;
+    return instance;
+}
+
+//Rings outlive their threads so late exports still see their events.
+inline ring * thread_ring() noexcept {
+    thread_local ring * local = nullptr;
+    if(local == nullptr){
+        rll::detail::ignore_exceptions([](){
+            std::shared_ptr<ring> created = std::make_shared<ring>();
+            registry& instance = get_registry();
+            std::lock_guard<std::mutex> lock(instance.mutex);
+            created->thread = instance.rings.size() + 1;
+            instance.rings.push_back(created);
+            local = created.get();
+        });
+    }
+    return local;
+}
+
+inline void record(const char * name, char phase, const char * detail) noexcept {
+    std::uint64_t now = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    ring * target = thread_ring();
+    if(target == nullptr){
+        return;
+    }
+    std::size_t head = target->head.load(std::memory_order_relaxed);
+    if(head - target->tail.load(std::memory_order_acquire) == ring::capacity){
+        get_registry().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    event& slot = target->events[head % ring::capacity];
+    slot.name = name;
+    slot.phase = phase;
+    slot.timestamp_ns = now;
+    slot.detail[0] = '\0';
+    if(detail != nullptr){
+        std::strncpy(slot.detail, detail, sizeof(slot.detail) - 1);
+        slot.detail[sizeof(slot.detail) - 1] = '\0';
+    }
+    target->head.store(head + 1, std::memory_order_release);
+}
+
+inline std::uint64_t process_id(){
+    #ifdef RLL_PLATFORM_IS_WINDOWS
+    return GetCurrentProcessId();
+    #else
+    return static_cast<std::uint64_t>(getpid());
+    #endif
+}
+} //detail
+
+inline scope::scope(const char * name, const char * detail) noexcept : name(name){
+    detail::record(name, 'B', detail);
+}
+
+inline scope::~scope(){
+    detail::record(name, 'E', nullptr);
+}
+
+inline std::string export_chrome_json(){
+    detail::registry& instance = detail::get_registry();
+    std::lock_guard<std::mutex> lock(instance.mutex);
+    std::string pid = std::to_string(detail::process_id());
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char timestamp[32];
+    for(auto& ring : instance.rings){
+        std::size_t head = ring->head.load(std::memory_order_acquire);
+        std::size_t tail = ring->tail.load(std::memory_order_relaxed);
+        for(; tail != head; tail++){
+            const detail::event& event = ring->events[tail % detail::ring::capacity];
+            std::snprintf(timestamp, sizeof(timestamp), "%.3f", static_cast<double>(event.timestamp_ns) / 1000.0);
+            json += first ? "" : ",";
+            json += "{\"name\":\"" + rll::detail::json_escape(event.name) + "\",\"cat\":\"rll\",\"ph\":\"";
+            json += event.phase;
+            json += "\",\"ts\":" + std::string(timestamp) + ",\"pid\":" + pid + ",\"tid\":" + std::to_string(ring->thread);
+            if(event.detail[0] != '\0'){
+                json += ",\"args\":{\"detail\":\"" + rll::detail::json_escape(event.detail) + "\"}";
+            }
+            json += "}";
+            first = false;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    json += "]}";
+    return json;
+}
+
+inline std::size_t dropped_events() noexcept {
+    return detail::get_registry().dropped.load(std::memory_order_relaxed);
+}
+} //tracing
+#endif
+
+inline library_set::~library_set(){
+    shutdown();
+}
+
+inline shared_library& library_set::load(const std::string& path, loader_flags flags, bool needs_finalization){
+    std::unique_ptr<shared_library> library(new shared_library());
+    library->load(path, flags);
+    std::lock_guard<std::mutex> lock(mutex);
+    members.push_back(member{std::move(library), needs_finalization});
+    return *members.back().library;
+}
+
+inline bool library_set::set_needs_finalization(const shared_library& library, bool needs_finalization){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto& member : members){
+        if(member.library.get() == &library){
+            member.needs_finalization = needs_finalization;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void library_set::set_policy(shutdown_policy new_policy){
+    std::lock_guard<std::mutex> lock(mutex);
+    policy = new_policy;
+}
+
+inline shutdown_policy library_set::get_policy(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+}
+
+inline std::size_t library_set::size(){
+    std::lock_guard<std::mutex> lock(mutex);
+    return members.size();
+}
+
+//Groups the libraries into waves that can be unloaded at the same time: a
+//library is only unloaded after every library in the set that needs it.
+inline std::vector<std::vector<shared_library *>> library_set::teardown_waves(const std::vector<shared_library *>& libraries){
+    std::vector<std::vector<shared_library *>> waves;
+    #ifdef RLL_PLATFORM_IS_ELF
+    std::vector<detail::elf_module> modules(libraries.size());
+    std::vector<char> found(libraries.size(), 0);
+    for(std::size_t i = 0; i < libraries.size(); i++){
+        found[i] = detail::elf_find_module(libraries[i]->get_platform_handle(), modules[i]);
+    }
+    //needed_by[i] counts the libraries still loaded that need library i.
+    std::vector<std::vector<std::size_t>> needs(libraries.size());
+    std::vector<std::size_t> needed_by(libraries.size(), 0);
+    for(std::size_t i = 0; i < libraries.size(); i++){
+        if(!found[i]){
+            continue;
+        }
+        for(auto& name : detail::elf_needed(modules[i])){
+            for(std::size_t j = 0; j < libraries.size(); j++){
+                if(j != i && found[j] && detail::elf_module_matches(modules[j], name)){
+                    needs[i].push_back(j);
+                    needed_by[j]++;
+                }
+            }
+        }
+    }
+
+    std::vector<char> done(libraries.size(), 0);
+    for(std::size_t remaining = libraries.size(); remaining != 0;){
+        std::vector<std::size_t> wave;
+        for(std::size_t i = 0; i < libraries.size(); i++){
+            if(!done[i] && needed_by[i] == 0){
+                wave.push_back(i);
+            }
+        }
+        if(wave.empty()){
+            //A dependency cycle, fall back to the most recently loaded.
+            for(std::size_t i = libraries.size(); i-- > 0;){
+                if(!done[i]){
+                    wave.push_back(i);
+                    break;
+                }
+            }
+        }
+        waves.emplace_back();
+        for(std::size_t i : wave){
+            done[i] = 1;
+            remaining--;
+            waves.back().push_back(libraries[i]);
+            for(std::size_t j : needs[i]){
+                if(needed_by[j] != 0){
+                    needed_by[j]--;
+                }
+            }
+        }
+    }
+    #else
+    for(std::size_t i = libraries.size(); i-- > 0;){
+        waves.push_back({ libraries[i] });
+    }
+    #endif
+    return waves;
+}
+
+inline void library_set::shutdown(){
+    std::vector<member> taken;
+    shutdown_policy current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        taken.swap(members);
+        current = policy;
+    }
+
+    std::vector<shared_library *> closing;
+    for(auto& member : taken){
+        if(current == shutdown_policies::LEAK || (current == shutdown_policies::HYBRID && !member.needs_finalization)){
+            member.library->leak();
+        } else {
+            closing.push_back(member.library.get());
+        }
+    }
+
+    //Unloaded past the warm pool, or a fast shutdown would leave everything
+    //mapped.
+    if(current == shutdown_policies::CLOSE){
+        for(auto it = closing.rbegin(); it != closing.rend(); ++it){
+            (*it)->unload(false);
+        }
+        return;
+    }
+
+    std::vector<std::vector<shared_library *>> waves = teardown_waves(closing);
+    std::size_t widest = 0;
+    for(auto& wave : waves){
+        widest = std::max(widest, wave.size());
+    }
+    unsigned int workers = threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    std::size_t helper_count = std::min<std::size_t>(workers, widest);
+    helper_count = helper_count != 0 ? helper_count - 1 : 0;
+
+    //One set of helpers works through every wave. Each wave is started by
+    //bumping `generation` and finishes when no helper is `busy` with it.
+    struct teardown_state {
+        std::mutex mutex;
+        std::condition_variable started;
+        std::condition_variable finished;
+        std::size_t wave = 0;
+        unsigned int generation = 0;
+        std::size_t busy = 0;
+        std::atomic<std::size_t> next{0};
+    } state;
+    auto work = [&waves, &state](std::size_t wave){
+        for(std::size_t i; (i = state.next.fetch_add(1)) < waves[wave].size();){
+            waves[wave][i]->unload(false);
+        }
+    };
+    std::vector<std::thread> helpers;
+    for(std::size_t i = 0; i < helper_count; i++){
+        helpers.emplace_back([&waves, &state, &work](){
+            for(unsigned int seen = 0;;){
+                std::size_t wave;
+                {
+                    std::unique_lock<std::mutex> lock(state.mutex);
+                    state.started.wait(lock, [&state, seen](){ return state.generation != seen; });
+                    seen = state.generation;
+                    wave = state.wave;
+                }
+                if(wave == waves.size()){
+                    return;
+                }
+                work(wave);
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if(--state.busy == 0){
+                    state.finished.notify_one();
+                }
+            }
+        });
+    }
+
+    for(std::size_t wave = 0; wave <= waves.size(); wave++){
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.wave = wave;
+            state.next.store(0);
+            state.busy = helpers.size();
+            state.generation++;
+        }
+        state.started.notify_all();
+        if(wave == waves.size()){
+            break;
+        }
+        work(wave);
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.finished.wait(lock, [&state](){ return state.busy == 0; });
+    }
+    for(auto& helper : helpers){
+        helper.join();
+    }
+}
 
 } //rll
 //-----------------------------------END_IF-----------------------------------//
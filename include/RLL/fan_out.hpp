@@ -0,0 +1,335 @@
+// This is RLL. A Runtime Library Loader.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//--------------------------------HEADER_GUARD--------------------------------//
+#ifndef RLL_FAN_OUT_HPP_
+#define RLL_FAN_OUT_HPP_
+//----------------------------------INCLUDES----------------------------------//
+#include "RLL.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <tuple>
+#include <type_traits>
+//---------------------------------FAN_OUT------------------------------------//
+namespace rll {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A fixed set of worker threads that run batches of indexed tasks.
+///
+/// @details Every worker owns a deque. A batch is dealt out round-robin over
+/// the deques; workers take from the back of their own and, when it runs dry,
+/// steal from the front of the others', so one slow task doesn't hold up the
+/// tasks queued behind it. The thread that calls `run` works on the batch too.
+///
+/// Batches from several threads can run at the same time.
+////////////////////////////////////////////////////////////////////////////////
+class work_stealing_pool {
+    public:
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @param threads The number of worker threads, 0 for one less than the
+        /// number of hardware threads (the caller makes up the difference).
+        ////////////////////////////////////////////////////////////////////////////////
+        explicit work_stealing_pool(unsigned int threads = 0);
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+        ~work_stealing_pool();
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Calls `task(i)` for every `i` below `count` and waits for all of
+        /// them.
+        ///
+        /// @details `task` must not throw.
+        ////////////////////////////////////////////////////////////////////////////////
+        void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the number of worker threads.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::size_t size() const noexcept { return workers.size(); }
+    private:
+        struct batch {
+            const std::function<void(std::size_t)> * task;
+            std::atomic<std::size_t> remaining;
+        };
+        struct job {
+            batch * owner;
+            std::size_t index;
+        };
+        struct alignas(64) queue {
+            std::mutex mutex;
+            std::deque<job> jobs;
+        };
+
+        std::vector<std::unique_ptr<queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex sleep_mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        std::atomic<std::size_t> queued{0};
+        bool stopping = false;
+
+        bool pop(std::size_t home, job& out);
+        void execute(const job& work);
+        void work(std::size_t home);
+};
+
+inline work_stealing_pool::work_stealing_pool(unsigned int threads){
+    if(threads == 0){
+        threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+    //The caller's thread uses its own queue when there are no workers.
+    for(unsigned int i = 0; i < std::max(1u, threads); i++){
+        queues.emplace_back(new queue());
+    }
+    for(unsigned int i = 0; i < threads; i++){
+        workers.emplace_back(&work_stealing_pool::work, this, i);
+    }
+}
+
+inline work_stealing_pool::~work_stealing_pool(){
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(auto& worker : workers){
+        worker.join();
+    }
+}
+
+//Own queue from the back, the others from the front.
+inline bool work_stealing_pool::pop(std::size_t home, job& out){
+    if(queued.load(std::memory_order_acquire) == 0){
+        return false;
+    }
+    for(std::size_t i = 0; i < queues.size(); i++){
+        queue& target = *queues[(home + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        if(target.jobs.empty()){
+            continue;
+        }
+        if(i == 0){
+            out = target.jobs.back();
+            target.jobs.pop_back();
+        } else {
+            out = target.jobs.front();
+            target.jobs.pop_front();
+        }
+        queued.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+    return false;
+}
+
+inline void work_stealing_pool::execute(const job& work){
+    (*work.owner->task)(work.index);
+    if(work.owner->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        finished.notify_all();
+    }
+}
+
+inline void work_stealing_pool::work(std::size_t home){
+    for(;;){
+        job next;
+        if(pop(home, next)){
+            execute(next);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this](){ return stopping || queued.load(std::memory_order_acquire) != 0; });
+        if(stopping){
+            return;
+        }
+    }
+}
+
+inline void work_stealing_pool::run(std::size_t count, const std::function<void(std::size_t)>& task){
+    if(count == 0){
+        return;
+    }
+    batch current;
+    current.task = &task;
+    current.remaining.store(count, std::memory_order_relaxed);
+
+    static std::atomic<std::size_t> next_queue{0};
+    std::size_t start = next_queue.fetch_add(1, std::memory_order_relaxed);
+    for(std::size_t i = 0; i < count; i++){
+        queue& target = *queues[(start + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.jobs.push_back(job{&current, i});
+        queued.fetch_add(1, std::memory_order_acq_rel);
+    }
+    {
+        //Taking the lock orders this with workers that are about to sleep.
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+
+    //Help out until the queues are empty, then wait for the stragglers.
+    job next;
+    while(current.remaining.load(std::memory_order_acquire) != 0 && pop(start, next)){
+        execute(next);
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    finished.wait(lock, [&current](){ return current.remaining.load(std::memory_order_acquire) == 0; });
+}
+
+namespace detail {
+//Stands in for the value of functions that return void.
+struct no_value {};
+
+template<typename return_type>
+using fan_out_value = typename std::conditional<std::is_void<return_type>::value, no_value, return_type>::type;
+
+template<typename return_type>
+struct fan_out_call {
+    template<typename function_type, typename tuple_type>
+    static return_type call(function_type function, tuple_type& arguments){
+        return std::apply(function, arguments);
+    }
+};
+
+template<>
+struct fan_out_call<void> {
+    template<typename function_type, typename tuple_type>
+    static no_value call(function_type function, tuple_type& arguments){
+        std::apply(function, arguments);
+        return no_value();
+    }
+};
+} //detail
+
+template<typename signature>
+class fan_out;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A function symbol bound across many libraries and called on all of
+/// them at once.
+///
+/// @details Bind the same entry point in every library with `bind`, then each
+/// call runs it in all of them concurrently on a `work_stealing_pool`, so a
+/// call takes about as long as the slowest library instead of the sum of
+/// them. Every library gets its own outcome: the returned value or the
+/// exception it threw, and how long it took. Outcomes keep the bind order.
+///
+/// The arguments are shared by all the concurrent calls, so pointer and
+/// reference arguments must be safe to use from several threads.
+///
+/// ```cpp
+/// rll::work_stealing_pool pool;
+/// rll::fan_out<int(const batch *)> process(pool);
+/// for(auto& plugin : plugins){
+///     process.bind(plugin, "process");
+/// }
+/// int total = process.aggregate(0, [](int sum, int value){ return sum + value; }, &next_batch);
+/// ```
+///
+/// @tparam return_type The function's return type.
+/// @tparam argument_types The function's parameter types.
+////////////////////////////////////////////////////////////////////////////////
+template<typename return_type, typename... argument_types>
+class fan_out<return_type(argument_types...)> {
+    public:
+        using function_type = return_type(*)(argument_types...);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief What one library's call did.
+        ////////////////////////////////////////////////////////////////////////////////
+        struct outcome {
+            shared_library * library = nullptr;
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief The returned value. Empty for `void` functions and failed calls.
+            ////////////////////////////////////////////////////////////////////////////////
+            detail::fan_out_value<return_type> value{};
+            ////////////////////////////////////////////////////////////////////////////////
+            /// @brief The exception the call threw, if it did.
+            ////////////////////////////////////////////////////////////////////////////////
+            std::exception_ptr error;
+            std::chrono::nanoseconds latency{0};
+
+            bool ok() const noexcept { return !error; }
+        };
+
+        explicit fan_out(work_stealing_pool& pool) : pool(&pool){}
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Adds a library's symbol to the set.
+        ///
+        /// @throw rll::exception::library_not_loaded
+        /// @throw rll::exception::symbol_not_found
+        ////////////////////////////////////////////////////////////////////////////////
+        void bind(shared_library& library, const std::string& name){
+            targets.push_back(target{&library, reinterpret_cast<function_type>(library.get_symbol(name))});
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Adds every library that has the symbol to the set.
+        /// @return std::size_t The number of libraries that had it.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::size_t bind_all(const std::vector<shared_library *>& libraries, const std::string& name){
+            std::size_t bound = 0;
+            for(shared_library * library : libraries){
+                if(void * symbol = library->get_symbol_fast(name)){
+                    targets.push_back(target{library, reinterpret_cast<function_type>(symbol)});
+                    bound++;
+                }
+            }
+            return bound;
+        }
+
+        void clear() noexcept { targets.clear(); }
+        std::size_t size() const noexcept { return targets.size(); }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Calls the symbol in every bound library at once.
+        /// @return std::vector<outcome> One outcome per library, in bind order.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::vector<outcome> operator()(argument_types... arguments) const {
+            std::tuple<argument_types...> shared(std::forward<argument_types>(arguments)...);
+            std::vector<outcome> outcomes(targets.size());
+            pool->run(targets.size(), [this, &shared, &outcomes](std::size_t i){
+                outcome& result = outcomes[i];
+                result.library = targets[i].library;
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    result.value = detail::fan_out_call<return_type>::call(targets[i].function, shared);
+                } catch(...){
+                    result.error = std::current_exception();
+                }
+                result.latency = std::chrono::steady_clock::now() - start;
+            });
+            return outcomes;
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Calls the symbol in every bound library and folds the values
+        /// of the successful calls, in bind order.
+        ///
+        /// @param initial The starting value.
+        /// @param combine Called as `combine(accumulated, value)`.
+        /// @param arguments The arguments of the calls.
+        ////////////////////////////////////////////////////////////////////////////////
+        template<typename accumulated_type, typename combine_type>
+        accumulated_type aggregate(accumulated_type initial, combine_type combine, argument_types... arguments) const {
+            for(auto& result : (*this)(std::forward<argument_types>(arguments)...)){
+                if(result.ok()){
+                    initial = combine(std::move(initial), std::move(result.value));
+                }
+            }
+            return initial;
+        }
+    private:
+        struct target {
+            shared_library * library;
+            function_type function;
+        };
+        work_stealing_pool * pool;
+        std::vector<target> targets;
+};
+
+} //rll
+//-----------------------------------END_IF-----------------------------------//
+#endif //RLL_FAN_OUT_HPP_
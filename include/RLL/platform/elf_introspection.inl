@@ -0,0 +1,607 @@
+// This is inline content for the RLL headeronly file.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+
+//These helpers read the loader's view of the process (dl_iterate_phdr) and the
+//dynamic sections of loaded objects. None of them throw; callers decide how an
+//error is surfaced.
+
+namespace detail {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A loaded ELF object as seen through `dl_iterate_phdr`.
+///
+/// @details The pointers are owned by the loader and stay valid for as long as
+/// the object remains mapped.
+////////////////////////////////////////////////////////////////////////////////
+struct elf_module {
+	std::string path;
+	std::uintptr_t base = 0;
+	const ElfW(Phdr) * phdrs = nullptr;
+	std::size_t phnum = 0;
+	const ElfW(Dyn) * dynamic = nullptr;
+};
+
+inline const ElfW(Dyn) * elf_find_dynamic(std::uintptr_t base, const ElfW(Phdr) * phdrs, std::size_t phnum){
+	for(std::size_t i = 0; i < phnum; i++){
+		if(phdrs[i].p_type == PT_DYNAMIC){
+			return reinterpret_cast<const ElfW(Dyn) *>(base + phdrs[i].p_vaddr);
+		}
+	}
+	return nullptr;
+}
+
+inline std::vector<elf_module> elf_loaded_modules(){
+	std::vector<elf_module> modules;
+	dl_iterate_phdr([](struct dl_phdr_info * info, size_t, void * data) -> int {
+		elf_module module;
+		module.path = info->dlpi_name ? info->dlpi_name : "";
+		module.base = info->dlpi_addr;
+		module.phdrs = info->dlpi_phdr;
+		module.phnum = info->dlpi_phnum;
+		module.dynamic = elf_find_dynamic(module.base, module.phdrs, module.phnum);
+		static_cast<std::vector<elf_module> *>(data)->push_back(module);
+		return 0;
+	}, &modules);
+	return modules;
+}
+
+//Libraries mapped by RLL's own loader have no link map, so their handles are
+//registered here instead.
+struct elf_image_registry {
+	std::mutex mutex;
+	std::unordered_map<const void *, elf_module> modules;
+};
+
+inline elf_image_registry& elf_images(){
+	static elf_image_registry registry;
+	return registry;
+}
+
+inline bool elf_find_module(void * handle, elf_module& out){
+	{
+		elf_image_registry& images = elf_images();
+		std::lock_guard<std::mutex> lock(images.mutex);
+		auto it = images.modules.find(handle);
+		if(it != images.modules.end()){
+			out = it->second;
+			return true;
+		}
+	}
+
+	struct link_map * map = nullptr;
+	if(handle == nullptr || dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0 || map == nullptr){
+		return false;
+	}
+
+	//The dynamic section address is unique per mapped object, unlike the name
+	//(empty for the main program) or the base (0 for non-PIE executables).
+	for(auto& module : elf_loaded_modules()){
+		if(module.dynamic == map->l_ld){
+			out = module;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline std::size_t elf_mapped_size(const elf_module& module){
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+	std::size_t size = 0;
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type == PT_LOAD){
+			std::uintptr_t start = phdr.p_vaddr & ~(page - 1);
+			std::uintptr_t end = (phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+			size += end - start;
+		}
+	}
+	return size;
+}
+
+#if defined(__linux__) && defined(MADV_POPULATE_READ)
+constexpr int elf_populate_read = MADV_POPULATE_READ;
+constexpr int elf_populate_write = MADV_POPULATE_WRITE;
+#elif defined(__linux__)
+//Linux 5.14, for C libraries that don't know them yet.
+constexpr int elf_populate_read = 22;
+constexpr int elf_populate_write = 23;
+#endif
+
+//Faults a page-aligned range in, for writing if `write` so copy-on-write pages
+//are copied now too. Kernels without MADV_POPULATE get every page touched.
+inline bool elf_populate(std::uintptr_t start, std::uintptr_t end, bool write){
+	if(start >= end){
+		return true;
+	}
+	#ifdef __linux__
+	if(madvise(reinterpret_cast<void *>(start), end - start, write ? elf_populate_write : elf_populate_read) == 0){
+		return true;
+	}
+	if(errno != EINVAL){
+		return false;
+	}
+	#endif
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+	for(std::uintptr_t address = start; address < end; address += page){
+		if(write){
+			//Adding zero atomically doesn't race with threads already
+			//writing there.
+			__atomic_fetch_add(reinterpret_cast<unsigned char *>(address), 0, __ATOMIC_RELAXED);
+		} else {
+			(void) *reinterpret_cast<volatile const unsigned char *>(address);
+		}
+	}
+	return true;
+}
+
+//Prefaults and/or locks the pages of an object's loadable segments. The
+//writable segments are populated for writing except their RELRO part, which
+//the loader made read-only. Adds the sizes it managed to the report.
+inline void elf_warm_module(const elf_module& module, bool prefault, bool lock, load_report& report){
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+	std::uintptr_t relro_start = 0, relro_end = 0;
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type == PT_GNU_RELRO){
+			relro_start = (module.base + phdr.p_vaddr) & ~(page - 1);
+			relro_end = (module.base + phdr.p_vaddr + phdr.p_memsz) & ~(page - 1);
+		}
+	}
+
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type != PT_LOAD){
+			continue;
+		}
+		std::uintptr_t start = (module.base + phdr.p_vaddr) & ~(page - 1);
+		std::uintptr_t end = (module.base + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+		if(prefault && (phdr.p_flags & PF_R)){
+			bool populated;
+			if(phdr.p_flags & PF_W){
+				std::uintptr_t read_start = std::max(start, relro_start);
+				std::uintptr_t read_end = std::min(end, relro_end);
+				if(read_start < read_end){
+					populated = elf_populate(start, read_start, true)
+						&& elf_populate(read_start, read_end, false)
+						&& elf_populate(read_end, end, true);
+				} else {
+					populated = elf_populate(start, end, true);
+				}
+			} else {
+				populated = elf_populate(start, end, false);
+			}
+			if(populated){
+				report.prefaulted_size += end - start;
+			}
+		}
+		if(lock && mlock(reinterpret_cast<void *>(start), end - start) == 0){
+			report.locked_size += end - start;
+		}
+	}
+}
+
+//glibc relocates the address-valued dynamic entries in place, other loaders
+//(musl, or the dynamic section of a file that was never loaded) don't.
+inline std::uintptr_t elf_dynamic_address(const elf_module& module, ElfW(Addr) value){
+	return value < module.base ? module.base + value : value;
+}
+
+inline std::uintptr_t elf_dynamic_entry(const elf_module& module, ElfW(Sxword) tag){
+	if(module.dynamic == nullptr){
+		return 0;
+	}
+	for(const ElfW(Dyn) * dyn = module.dynamic; dyn->d_tag != DT_NULL; dyn++){
+		if(dyn->d_tag == tag){
+			return dyn->d_un.d_val;
+		}
+	}
+	return 0;
+}
+
+inline std::vector<std::string> elf_needed(const elf_module& module){
+	std::vector<std::string> needed;
+	std::uintptr_t strtab = elf_dynamic_entry(module, DT_STRTAB);
+	if(strtab == 0){
+		return needed;
+	}
+	const char * strings = reinterpret_cast<const char *>(elf_dynamic_address(module, strtab));
+	for(const ElfW(Dyn) * dyn = module.dynamic; dyn->d_tag != DT_NULL; dyn++){
+		if(dyn->d_tag == DT_NEEDED){
+			needed.emplace_back(strings + dyn->d_un.d_val);
+		}
+	}
+	return needed;
+}
+
+inline std::string elf_soname(const elf_module& module){
+	std::uintptr_t strtab = elf_dynamic_entry(module, DT_STRTAB);
+	if(strtab == 0){
+		return "";
+	}
+	for(const ElfW(Dyn) * dyn = module.dynamic; dyn->d_tag != DT_NULL; dyn++){
+		if(dyn->d_tag == DT_SONAME){
+			return reinterpret_cast<const char *>(elf_dynamic_address(module, strtab)) + dyn->d_un.d_val;
+		}
+	}
+	return "";
+}
+
+//Whether a DT_NEEDED entry names this module, by soname or by file name.
+inline bool elf_module_matches(const elf_module& module, const std::string& needed){
+	if(elf_soname(module) == needed){
+		return true;
+	}
+	std::string::size_type slash = module.path.find_last_of('/');
+	return module.path.compare(slash == std::string::npos ? 0 : slash + 1, std::string::npos, needed) == 0;
+}
+
+//One entry of /proc/self/smaps, sizes in bytes.
+struct smaps_entry {
+	std::uintptr_t start = 0;
+	std::uintptr_t end = 0;
+	std::size_t rss = 0;
+	std::size_t pss = 0;
+	std::size_t dirty = 0;
+};
+
+inline bool elf_read_smaps(std::vector<smaps_entry>& entries){
+	std::FILE * file = std::fopen("/proc/self/smaps", "r");
+	if(file == nullptr){
+		return false;
+	}
+
+	char line[512];
+	while(std::fgets(line, sizeof(line), file) != nullptr){
+		unsigned long long start, end, value;
+		char field[64];
+		if(std::sscanf(line, "%llx-%llx ", &start, &end) == 2 && std::strchr(line, '-') < std::strchr(line, ' ')){
+			smaps_entry entry;
+			entry.start = static_cast<std::uintptr_t>(start);
+			entry.end = static_cast<std::uintptr_t>(end);
+			entries.push_back(entry);
+		} else if(!entries.empty() && std::sscanf(line, "%63[^:]: %llu kB", field, &value) == 2){
+			std::size_t bytes = static_cast<std::size_t>(value) * 1024;
+			if(std::strcmp(field, "Rss") == 0){
+				entries.back().rss = bytes;
+			} else if(std::strcmp(field, "Pss") == 0){
+				entries.back().pss = bytes;
+			} else if(std::strcmp(field, "Shared_Dirty") == 0 || std::strcmp(field, "Private_Dirty") == 0){
+				entries.back().dirty += bytes;
+			}
+		}
+	}
+	std::fclose(file);
+	return true;
+}
+
+#ifdef __linux__
+//glibc finds loaded libraries by name before it opens the file, so a library
+//loaded through "/proc/self/fd/N" is handed back for every later
+//"/proc/self/fd/N", even after N was closed and reused for another file. Moves
+//`fd` to a number no loaded library is named after and returns its path. Call
+//it with the loader mutex held so no other load takes the name in between.
+inline std::string elf_unaliased_fd_path(int& fd){
+	std::string path = "/proc/self/fd/" + std::to_string(fd);
+	std::vector<int> aliased;
+	while(void * loaded = dlopen(path.c_str(), RTLD_LAZY | RTLD_NOLOAD)){
+		dlclose(loaded);
+		int moved = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if(moved < 0){
+			break;
+		}
+		//The old number stays open until the search ends, so it isn't picked again.
+		aliased.push_back(fd);
+		fd = moved;
+		path = "/proc/self/fd/" + std::to_string(fd);
+	}
+	for(int old : aliased){
+		close(old);
+	}
+	return path;
+}
+
+//True if the object behind `handle` is mapped from the file `fd` is open on,
+//rather than being an object the loader had already mapped from another file.
+inline bool elf_module_backed_by(void * handle, int fd){
+	struct stat info;
+	elf_module module;
+	if(fstat(fd, &info) != 0 || !elf_find_module(handle, module) || module.dynamic == nullptr){
+		return false;
+	}
+	std::FILE * file = std::fopen("/proc/self/maps", "r");
+	if(file == nullptr){
+		return false;
+	}
+	const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(module.dynamic);
+	bool backed = false;
+	char line[512];
+	while(std::fgets(line, sizeof(line), file) != nullptr){
+		unsigned long long start, end, offset, inode;
+		unsigned int major_number, minor_number;
+		if(std::sscanf(line, "%llx-%llx %*s %llx %x:%x %llu", &start, &end, &offset, &major_number, &minor_number, &inode) == 6 && start <= address && address < end){
+			backed = inode == static_cast<unsigned long long>(info.st_ino) && major_number == major(info.st_dev) && minor_number == minor(info.st_dev);
+			break;
+		}
+	}
+	std::fclose(file);
+	return backed;
+}
+#endif
+
+//Attributes the smaps entries overlapping [start, end) to the segment, in
+//proportion to the overlap. `smaps` is sorted by address.
+inline void elf_account_segment(segment_usage& segment, const std::vector<smaps_entry>& smaps){
+	std::uintptr_t start = segment.address;
+	std::uintptr_t end = segment.address + segment.size;
+	auto it = std::upper_bound(smaps.begin(), smaps.end(), start, [](std::uintptr_t address, const smaps_entry& entry){
+		return address < entry.end;
+	});
+	for(; it != smaps.end() && it->start < end; it++){
+		std::uintptr_t overlap = std::min(end, it->end) - std::max(start, it->start);
+		std::uintptr_t length = it->end - it->start;
+		segment.rss += static_cast<std::size_t>(static_cast<unsigned long long>(it->rss) * overlap / length);
+		segment.pss += static_cast<std::size_t>(static_cast<unsigned long long>(it->pss) * overlap / length);
+		segment.dirty += static_cast<std::size_t>(static_cast<unsigned long long>(it->dirty) * overlap / length);
+	}
+}
+
+inline library_memory_usage elf_memory_usage(const elf_module& module, const std::vector<smaps_entry>& smaps){
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+	library_memory_usage usage;
+	usage.path = module.path;
+
+	auto add_segment = [&](segment_kind kind, std::uintptr_t start, std::uintptr_t end){
+		if(end <= start){
+			return;
+		}
+		segment_usage segment;
+		segment.kind = kind;
+		segment.address = start;
+		segment.size = end - start;
+		elf_account_segment(segment, smaps);
+		usage.segments.push_back(segment);
+	};
+
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type != PT_LOAD){
+			continue;
+		}
+		std::uintptr_t start = (module.base + phdr.p_vaddr) & ~(page - 1);
+		std::uintptr_t file_end = (module.base + phdr.p_vaddr + phdr.p_filesz + page - 1) & ~(page - 1);
+		std::uintptr_t end = (module.base + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+		if(phdr.p_flags & PF_X){
+			add_segment(segment_kinds::TEXT, start, end);
+		} else if(phdr.p_flags & PF_W){
+			add_segment(segment_kinds::DATA, start, file_end);
+			add_segment(segment_kinds::BSS, file_end, end);
+		} else {
+			add_segment(segment_kinds::RODATA, start, end);
+		}
+	}
+
+	for(auto& segment : usage.segments){
+		switch(segment.kind){
+			case segment_kinds::TEXT: usage.text += segment.size; break;
+			case segment_kinds::RODATA: usage.rodata += segment.size; break;
+			case segment_kinds::DATA: usage.data += segment.size; break;
+			case segment_kinds::BSS: usage.bss += segment.size; break;
+		}
+		usage.rss += segment.rss;
+		usage.pss += segment.pss;
+		usage.dirty += segment.dirty;
+	}
+	return usage;
+}
+
+//Number of entries in the dynamic symbol table, from whichever hash table the
+//object has. The section headers (with the real count) aren't mapped.
+inline std::size_t elf_dynamic_symbol_count(const elf_module& module){
+	std::uintptr_t hash = elf_dynamic_entry(module, DT_HASH);
+	if(hash != 0){
+		return reinterpret_cast<const std::uint32_t *>(elf_dynamic_address(module, hash))[1];
+	}
+
+	std::uintptr_t gnu_hash = elf_dynamic_entry(module, DT_GNU_HASH);
+	if(gnu_hash == 0){
+		return 0;
+	}
+	const std::uint32_t * table = reinterpret_cast<const std::uint32_t *>(elf_dynamic_address(module, gnu_hash));
+	std::uint32_t bucket_count = table[0];
+	std::uint32_t symbol_offset = table[1];
+	std::uint32_t bloom_size = table[2];
+	const std::uint32_t * buckets = table + 4 + bloom_size * (sizeof(ElfW(Addr)) / 4);
+	const std::uint32_t * chains = buckets + bucket_count;
+
+	std::uint32_t last = 0;
+	for(std::uint32_t i = 0; i < bucket_count; i++){
+		last = std::max(last, buckets[i]);
+	}
+	if(last < symbol_offset){
+		return symbol_offset;
+	}
+	while((chains[last - symbol_offset] & 1) == 0){
+		last++;
+	}
+	return last + 1;
+}
+
+//Calls `callback(name, address, symbol)` for every symbol the object defines.
+template<typename callback_type>
+inline void elf_for_each_defined_symbol(const elf_module& module, callback_type callback){
+	std::uintptr_t symtab = elf_dynamic_entry(module, DT_SYMTAB);
+	std::uintptr_t strtab = elf_dynamic_entry(module, DT_STRTAB);
+	if(symtab == 0 || strtab == 0){
+		return;
+	}
+	const ElfW(Sym) * symbols = reinterpret_cast<const ElfW(Sym) *>(elf_dynamic_address(module, symtab));
+	const char * strings = reinterpret_cast<const char *>(elf_dynamic_address(module, strtab));
+	std::size_t count = elf_dynamic_symbol_count(module);
+
+	for(std::size_t i = 1; i < count; i++){
+		const ElfW(Sym)& symbol = symbols[i];
+		unsigned char type = ELF64_ST_TYPE(symbol.st_info);
+		if(symbol.st_shndx == SHN_UNDEF || type == STT_TLS || type == STT_SECTION || type == STT_FILE){
+			continue;
+		}
+		std::uintptr_t address = symbol.st_shndx == SHN_ABS ? symbol.st_value : module.base + symbol.st_value;
+		callback(strings + symbol.st_name, address, symbol);
+	}
+}
+
+inline void elf_build_address_index(address_index& index, const elf_module& module, bool demangle){
+	elf_for_each_defined_symbol(module, [&](const char * name, std::uintptr_t address, const ElfW(Sym)& symbol){
+		unsigned char type = ELF64_ST_TYPE(symbol.st_info);
+		if(type == STT_FUNC || type == STT_GNU_IFUNC || type == STT_OBJECT){
+			index.add(address, symbol.st_size, name, demangle ? detail::demangle(name) : std::string());
+		}
+	});
+}
+
+//Finds NT_GNU_BUILD_ID in a block of notes and returns it as lowercase hex.
+inline std::string elf_parse_build_id(const unsigned char * notes, std::size_t size){
+	static const char digits[] = "0123456789abcdef";
+	auto align = [](std::size_t value){ return (value + 3) & ~std::size_t(3); };
+	std::size_t offset = 0;
+	while(offset + sizeof(ElfW(Nhdr)) <= size){
+		ElfW(Nhdr) header;
+		std::memcpy(&header, notes + offset, sizeof(header));
+		std::size_t name = offset + sizeof(header);
+		std::size_t description = name + align(header.n_namesz);
+		std::size_t next = description + align(header.n_descsz);
+		if(next > size){
+			break;
+		}
+		if(header.n_type == NT_GNU_BUILD_ID && header.n_namesz == 4 && std::memcmp(notes + name, "GNU", 4) == 0){
+			std::string id;
+			for(std::size_t i = 0; i < header.n_descsz; i++){
+				id += digits[notes[description + i] >> 4];
+				id += digits[notes[description + i] & 0xf];
+			}
+			return id;
+		}
+		offset = next;
+	}
+	return "";
+}
+
+inline std::string elf_build_id(const elf_module& module){
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type == PT_NOTE){
+			std::string id = elf_parse_build_id(reinterpret_cast<const unsigned char *>(module.base + phdr.p_vaddr), phdr.p_memsz);
+			if(!id.empty()){
+				return id;
+			}
+		}
+	}
+	return "";
+}
+
+//Reads the build-id of a library on disk without loading it. Empty if the file
+//can't be read, isn't an ELF file of this class, or has no build-id.
+inline std::string elf_file_build_id(const std::string& path){
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		return "";
+	}
+	std::string id;
+	ElfW(Ehdr) header;
+	if(pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+		&& std::memcmp(header.e_ident, ELFMAG, SELFMAG) == 0
+		&& header.e_phentsize == sizeof(ElfW(Phdr))){
+		std::vector<ElfW(Phdr)> phdrs(header.e_phnum);
+		ssize_t phdrs_size = static_cast<ssize_t>(phdrs.size() * sizeof(ElfW(Phdr)));
+		if(pread(fd, phdrs.data(), static_cast<std::size_t>(phdrs_size), static_cast<off_t>(header.e_phoff)) == phdrs_size){
+			for(auto& phdr : phdrs){
+				if(phdr.p_type != PT_NOTE || phdr.p_filesz > (1 << 20)){
+					continue;
+				}
+				std::vector<unsigned char> notes(phdr.p_filesz);
+				if(pread(fd, notes.data(), notes.size(), static_cast<off_t>(phdr.p_offset)) == static_cast<ssize_t>(notes.size())){
+					id = elf_parse_build_id(notes.data(), notes.size());
+					if(!id.empty()){
+						break;
+					}
+				}
+			}
+		}
+	}
+	close(fd);
+	return id;
+}
+
+inline void elf_build_load_report(load_report& report, void * handle, const std::vector<elf_module>& before){
+	elf_module root;
+	if(!elf_find_module(handle, root)){
+		return;
+	}
+	std::vector<elf_module> after = elf_loaded_modules();
+
+	auto was_resident = [&before](const elf_module& module){
+		for(auto& old : before){
+			if(old.dynamic == module.dynamic){
+				return true;
+			}
+		}
+		return false;
+	};
+	auto add_entry = [&](const std::string& name, const elf_module * module){
+		dependency_entry entry;
+		entry.name = name;
+		if(module != nullptr){
+			entry.path = module->path;
+			entry.resolved = true;
+			entry.newly_mapped = !was_resident(*module);
+			entry.base = module->base;
+			entry.mapped_size = elf_mapped_size(*module);
+		}
+		report.entries.push_back(entry);
+		return report.entries.size() - 1;
+	};
+
+	//Breadth first over DT_NEEDED, every mapped object appears once.
+	std::vector<const elf_module *> queue;
+	std::vector<std::size_t> queue_entries;
+	for(auto& module : after){
+		if(module.dynamic == root.dynamic){
+			queue.push_back(&module);
+			break;
+		}
+	}
+	if(queue.empty()){
+		//Mapped by RLL's own loader, so the platform loader doesn't list it.
+		queue.push_back(&root);
+	}
+	queue_entries.push_back(add_entry(report.path, queue.front()));
+	for(std::size_t i = 0; i < queue.size(); i++){
+		for(auto& name : elf_needed(*queue[i])){
+			const elf_module * found = nullptr;
+			for(auto& module : after){
+				if(elf_module_matches(module, name)){
+					found = &module;
+					break;
+				}
+			}
+
+			std::size_t index = report.entries.size();
+			for(std::size_t j = 0; found != nullptr && j < queue.size(); j++){
+				if(queue[j] == found){
+					index = queue_entries[j];
+					break;
+				}
+			}
+			if(index == report.entries.size()){
+				index = add_entry(name, found);
+				if(found != nullptr){
+					queue.push_back(found);
+					queue_entries.push_back(index);
+				}
+			}
+			report.entries[queue_entries[i]].needed.push_back(index);
+		}
+	}
+}
+
+} //detail
@@ -0,0 +1,470 @@
+// This is inline content for the RLL headeronly file.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+
+//A minimal ELF loader for self-contained shared libraries. It maps the file,
+//applies relocations, binds imports against objects that are already loaded,
+//and runs the initializers, all without entering the platform loader (and so
+//without taking its global lock). Like the rest of the ELF helpers nothing
+//here throws; errors are returned as strings.
+
+namespace detail {
+
+inline std::uint32_t elf_gnu_hash(const char * name){
+	std::uint32_t hash = 5381;
+	for(; *name; name++){
+		hash = hash * 33 + static_cast<unsigned char>(*name);
+	}
+	return hash;
+}
+
+inline std::uint32_t elf_sysv_hash(const char * name){
+	std::uint32_t hash = 0;
+	for(; *name; name++){
+		hash = (hash << 4) + static_cast<unsigned char>(*name);
+		std::uint32_t high = hash & 0xf0000000;
+		if(high){
+			hash ^= high >> 24;
+		}
+		hash &= ~high;
+	}
+	return hash;
+}
+
+//Finds the default version of a symbol an object defines, through its hash
+//table. Returns null if it isn't defined there.
+inline const ElfW(Sym) * elf_lookup(const elf_module& module, const char * name){
+	std::uintptr_t symtab = elf_dynamic_entry(module, DT_SYMTAB);
+	std::uintptr_t strtab = elf_dynamic_entry(module, DT_STRTAB);
+	if(symtab == 0 || strtab == 0){
+		return nullptr;
+	}
+	const ElfW(Sym) * symbols = reinterpret_cast<const ElfW(Sym) *>(elf_dynamic_address(module, symtab));
+	const char * strings = reinterpret_cast<const char *>(elf_dynamic_address(module, strtab));
+	std::uintptr_t versym_entry = elf_dynamic_entry(module, DT_VERSYM);
+	const ElfW(Half) * versym = versym_entry ? reinterpret_cast<const ElfW(Half) *>(elf_dynamic_address(module, versym_entry)) : nullptr;
+
+	auto matches = [&](std::uint32_t index){
+		const ElfW(Sym)& symbol = symbols[index];
+		unsigned char bind = ELF64_ST_BIND(symbol.st_info);
+		return symbol.st_shndx != SHN_UNDEF
+			&& (bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE)
+			&& (versym == nullptr || (versym[index] & 0x8000) == 0)
+			&& std::strcmp(strings + symbol.st_name, name) == 0;
+	};
+
+	std::uintptr_t gnu_hash = elf_dynamic_entry(module, DT_GNU_HASH);
+	if(gnu_hash != 0){
+		const std::uint32_t * table = reinterpret_cast<const std::uint32_t *>(elf_dynamic_address(module, gnu_hash));
+		std::uint32_t bucket_count = table[0];
+		std::uint32_t symbol_offset = table[1];
+		std::uint32_t bloom_size = table[2];
+		std::uint32_t bloom_shift = table[3];
+		const ElfW(Addr) * bloom = reinterpret_cast<const ElfW(Addr) *>(table + 4);
+		const std::uint32_t * buckets = reinterpret_cast<const std::uint32_t *>(bloom + bloom_size);
+		const std::uint32_t * chains = buckets + bucket_count;
+
+		const std::uint32_t bits = sizeof(ElfW(Addr)) * 8;
+		std::uint32_t hash = elf_gnu_hash(name);
+		ElfW(Addr) word = bloom[(hash / bits) % bloom_size];
+		ElfW(Addr) mask = (ElfW(Addr)(1) << (hash % bits)) | (ElfW(Addr)(1) << ((hash >> bloom_shift) % bits));
+		if((word & mask) != mask){
+			return nullptr;
+		}
+		std::uint32_t index = buckets[hash % bucket_count];
+		if(index < symbol_offset){
+			return nullptr;
+		}
+		for(;; index++){
+			std::uint32_t chain_hash = chains[index - symbol_offset];
+			if((hash | 1) == (chain_hash | 1) && matches(index)){
+				return &symbols[index];
+			}
+			if(chain_hash & 1){
+				return nullptr;
+			}
+		}
+	}
+
+	std::uintptr_t hash_entry = elf_dynamic_entry(module, DT_HASH);
+	if(hash_entry != 0){
+		const std::uint32_t * table = reinterpret_cast<const std::uint32_t *>(elf_dynamic_address(module, hash_entry));
+		std::uint32_t bucket_count = table[0];
+		const std::uint32_t * buckets = table + 2;
+		const std::uint32_t * chains = buckets + bucket_count;
+		for(std::uint32_t index = buckets[elf_sysv_hash(name) % bucket_count]; index != 0; index = chains[index]){
+			if(matches(index)){
+				return &symbols[index];
+			}
+		}
+	}
+	return nullptr;
+}
+
+//The run-time address of a defined symbol, calling the resolver of IFUNCs.
+inline std::uintptr_t elf_symbol_address(const elf_module& module, const ElfW(Sym)& symbol){
+	std::uintptr_t address = symbol.st_shndx == SHN_ABS ? symbol.st_value : module.base + symbol.st_value;
+	if(ELF64_ST_TYPE(symbol.st_info) == STT_GNU_IFUNC){
+		#if defined(__aarch64__)
+		address = reinterpret_cast<std::uintptr_t (*)(std::uint64_t, void *)>(address)(getauxval(AT_HWCAP), nullptr);
+		#else
+		address = reinterpret_cast<std::uintptr_t (*)()>(address)();
+		#endif
+	}
+	return address;
+}
+
+//The default versions of the symbols an object exports, as `elf_lookup` would
+//find them.
+inline void elf_exported_symbols(const elf_module& module, std::vector<std::pair<std::string, void *>>& exports){
+	std::uintptr_t versym_entry = elf_dynamic_entry(module, DT_VERSYM);
+	const ElfW(Half) * versym = versym_entry ? reinterpret_cast<const ElfW(Half) *>(elf_dynamic_address(module, versym_entry)) : nullptr;
+	const ElfW(Sym) * symbols = reinterpret_cast<const ElfW(Sym) *>(elf_dynamic_address(module, elf_dynamic_entry(module, DT_SYMTAB)));
+	elf_for_each_defined_symbol(module, [&](const char * name, std::uintptr_t, const ElfW(Sym)& symbol){
+		unsigned char bind = ELF64_ST_BIND(symbol.st_info);
+		std::size_t index = static_cast<std::size_t>(&symbol - symbols);
+		if((bind == STB_GLOBAL || bind == STB_WEAK || bind == STB_GNU_UNIQUE) && (versym == nullptr || (versym[index] & 0x8000) == 0)){
+			exports.emplace_back(name, reinterpret_cast<void *>(elf_symbol_address(module, symbol)));
+		}
+	});
+}
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define RLL_HAS_USERSPACE_LOADER
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A shared library mapped by RLL instead of the platform loader.
+///
+/// @details Only self-contained libraries are supported: no thread-local
+/// storage, and every `DT_NEEDED` dependency must already be loaded. Symbols
+/// the library defines bind to its own definitions (like `LOAD_DEEPBIND`),
+/// other imports bind to the default version of the first definition among the
+/// loaded objects. The platform loader and unwinder don't know about the
+/// image, so exceptions can't propagate out of it and `dladdr` won't find it.
+////////////////////////////////////////////////////////////////////////////////
+class elf_image {
+	private:
+		elf_image(const elf_image&);
+		elf_image& operator=(const elf_image&);
+		//
+		void * mapping = nullptr;
+		std::size_t mapping_size = 0;
+		std::vector<ElfW(Phdr)> phdrs;
+		elf_module module;
+		bool initialized = false;
+
+		bool relocate(const std::vector<elf_module>& loaded, std::uintptr_t table, std::size_t size, std::string& error);
+		bool relocate_relr(std::uintptr_t table, std::size_t size);
+		bool protect();
+		void run_initializers();
+		void run_finalizers();
+	public:
+		elf_image() = default;
+		~elf_image();
+
+		bool load(const std::string& path, std::string& error);
+		void * get_symbol(const char * name) const;
+		const elf_module& get_module() const { return module; }
+};
+
+inline elf_image::~elf_image(){
+	{
+		elf_image_registry& images = elf_images();
+		std::lock_guard<std::mutex> lock(images.mutex);
+		images.modules.erase(this);
+	}
+	if(initialized){
+		run_finalizers();
+	}
+	if(mapping != nullptr){
+		munmap(mapping, mapping_size);
+	}
+}
+
+inline bool elf_image::load(const std::string& path, std::string& error){
+	#if defined(__x86_64__)
+	const ElfW(Half) machine = EM_X86_64;
+	#else
+	const ElfW(Half) machine = EM_AARCH64;
+	#endif
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	struct fd_closer {
+		int fd;
+		~fd_closer(){ close(fd); }
+	} closer { fd };
+
+	ElfW(Ehdr) header;
+	if(pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))
+		|| std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0
+		|| header.e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32)
+		|| header.e_type != ET_DYN
+		|| header.e_machine != machine
+		|| header.e_phentsize != sizeof(ElfW(Phdr))){
+		error = path + ": not a shared library for this machine.";
+		return false;
+	}
+	phdrs.resize(header.e_phnum);
+	ssize_t phdrs_size = static_cast<ssize_t>(phdrs.size() * sizeof(ElfW(Phdr)));
+	if(pread(fd, phdrs.data(), static_cast<std::size_t>(phdrs_size), static_cast<off_t>(header.e_phoff)) != phdrs_size){
+		error = path + ": couldn't read the program headers.";
+		return false;
+	}
+
+	std::uintptr_t low = UINTPTR_MAX, high = 0;
+	for(auto& phdr : phdrs){
+		if(phdr.p_type == PT_TLS){
+			error = path + ": libraries with thread-local storage can't be loaded by the userspace loader.";
+			return false;
+		}
+		if(phdr.p_type == PT_LOAD){
+			low = std::min<std::uintptr_t>(low, phdr.p_vaddr & ~(page - 1));
+			high = std::max<std::uintptr_t>(high, (phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1));
+		}
+	}
+	if(high <= low){
+		error = path + ": no loadable segments.";
+		return false;
+	}
+
+	//Reserve the whole span first so the segments keep their relative layout.
+	mapping_size = high - low;
+	mapping = mmap(nullptr, mapping_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapping == MAP_FAILED){
+		mapping = nullptr;
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	std::uintptr_t base = reinterpret_cast<std::uintptr_t>(mapping) - low;
+
+	for(auto& phdr : phdrs){
+		if(phdr.p_type != PT_LOAD){
+			continue;
+		}
+		std::uintptr_t start = (base + phdr.p_vaddr) & ~(page - 1);
+		std::uintptr_t file_end = base + phdr.p_vaddr + phdr.p_filesz;
+		std::uintptr_t end = (base + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+		std::uintptr_t file_pages_end = (file_end + page - 1) & ~(page - 1);
+
+		if(phdr.p_filesz != 0){
+			void * segment = mmap(reinterpret_cast<void *>(start), file_pages_end - start, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, static_cast<off_t>(phdr.p_offset & ~(page - 1)));
+			if(segment == MAP_FAILED){
+				error = path + ": " + std::strerror(errno);
+				return false;
+			}
+			if(phdr.p_memsz > phdr.p_filesz){
+				std::memset(reinterpret_cast<void *>(file_end), 0, file_pages_end - file_end);
+			}
+		} else {
+			file_pages_end = start;
+		}
+		if(end > file_pages_end){
+			if(mprotect(reinterpret_cast<void *>(file_pages_end), end - file_pages_end, PROT_READ | PROT_WRITE) != 0){
+				error = path + ": " + std::strerror(errno);
+				return false;
+			}
+		}
+	}
+
+	module.path = path;
+	module.base = base;
+	module.phdrs = phdrs.data();
+	module.phnum = phdrs.size();
+	module.dynamic = elf_find_dynamic(base, module.phdrs, module.phnum);
+	if(module.dynamic == nullptr){
+		error = path + ": no dynamic section.";
+		return false;
+	}
+
+	std::vector<elf_module> loaded = elf_loaded_modules();
+	for(auto& needed : elf_needed(module)){
+		bool found = false;
+		for(auto& other : loaded){
+			if(elf_module_matches(other, needed)){
+				found = true;
+				break;
+			}
+		}
+		if(!found){
+			error = path + ": the dependency " + needed + " must be loaded before using the userspace loader.";
+			return false;
+		}
+	}
+
+	if(elf_dynamic_entry(module, DT_PLTREL) == DT_REL || elf_dynamic_entry(module, DT_REL) != 0){
+		error = path + ": REL relocations aren't supported.";
+		return false;
+	}
+	if(!relocate_relr(elf_dynamic_entry(module, DT_RELR), elf_dynamic_entry(module, DT_RELRSZ))
+		|| !relocate(loaded, elf_dynamic_entry(module, DT_RELA), elf_dynamic_entry(module, DT_RELASZ), error)
+		|| !relocate(loaded, elf_dynamic_entry(module, DT_JMPREL), elf_dynamic_entry(module, DT_PLTRELSZ), error)){
+		return false;
+	}
+	if(!protect()){
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+
+	run_initializers();
+	initialized = true;
+
+	elf_image_registry& images = elf_images();
+	std::lock_guard<std::mutex> lock(images.mutex);
+	images.modules[this] = module;
+	return true;
+}
+
+inline bool elf_image::relocate_relr(std::uintptr_t table, std::size_t size){
+	if(table == 0){
+		return true;
+	}
+	const ElfW(Addr) * entries = reinterpret_cast<const ElfW(Addr) *>(module.base + table);
+	ElfW(Addr) * where = nullptr;
+	for(std::size_t i = 0; i < size / sizeof(ElfW(Addr)); i++){
+		ElfW(Addr) entry = entries[i];
+		if((entry & 1) == 0){
+			where = reinterpret_cast<ElfW(Addr) *>(module.base + entry);
+			*where++ += module.base;
+		} else {
+			for(std::size_t bit = 0; (entry >>= 1) != 0; bit++){
+				if(entry & 1){
+					where[bit] += module.base;
+				}
+			}
+			where += sizeof(ElfW(Addr)) * 8 - 1;
+		}
+	}
+	return true;
+}
+
+inline bool elf_image::relocate(const std::vector<elf_module>& loaded, std::uintptr_t table, std::size_t size, std::string& error){
+	if(table == 0){
+		return true;
+	}
+	#if defined(__x86_64__)
+	enum { RELOC_NONE = R_X86_64_NONE, RELOC_ABSOLUTE = R_X86_64_64, RELOC_GLOB_DAT = R_X86_64_GLOB_DAT,
+		RELOC_JUMP_SLOT = R_X86_64_JUMP_SLOT, RELOC_RELATIVE = R_X86_64_RELATIVE, RELOC_IRELATIVE = R_X86_64_IRELATIVE };
+	#else
+	enum { RELOC_NONE = R_AARCH64_NONE, RELOC_ABSOLUTE = R_AARCH64_ABS64, RELOC_GLOB_DAT = R_AARCH64_GLOB_DAT,
+		RELOC_JUMP_SLOT = R_AARCH64_JUMP_SLOT, RELOC_RELATIVE = R_AARCH64_RELATIVE, RELOC_IRELATIVE = R_AARCH64_IRELATIVE };
+	#endif
+
+	const ElfW(Sym) * symbols = reinterpret_cast<const ElfW(Sym) *>(elf_dynamic_address(module, elf_dynamic_entry(module, DT_SYMTAB)));
+	const char * strings = reinterpret_cast<const char *>(elf_dynamic_address(module, elf_dynamic_entry(module, DT_STRTAB)));
+	const ElfW(Rela) * relocations = reinterpret_cast<const ElfW(Rela) *>(module.base + table);
+
+	for(std::size_t i = 0; i < size / sizeof(ElfW(Rela)); i++){
+		const ElfW(Rela)& relocation = relocations[i];
+		std::uint32_t type = static_cast<std::uint32_t>(ELF64_R_TYPE(relocation.r_info));
+		std::uint32_t index = static_cast<std::uint32_t>(ELF64_R_SYM(relocation.r_info));
+		ElfW(Addr) * where = reinterpret_cast<ElfW(Addr) *>(module.base + relocation.r_offset);
+
+		if(type == RELOC_NONE){
+			continue;
+		} else if(type == RELOC_RELATIVE){
+			*where = module.base + relocation.r_addend;
+			continue;
+		} else if(type == RELOC_IRELATIVE){
+			*where = reinterpret_cast<std::uintptr_t (*)()>(module.base + relocation.r_addend)();
+			continue;
+		} else if(type != RELOC_ABSOLUTE && type != RELOC_GLOB_DAT && type != RELOC_JUMP_SLOT){
+			error = module.path + ": unsupported relocation type " + std::to_string(type) + ".";
+			return false;
+		}
+
+		std::uintptr_t value = 0;
+		if(index != 0){
+			const ElfW(Sym)& symbol = symbols[index];
+			const char * name = strings + symbol.st_name;
+			if(symbol.st_shndx != SHN_UNDEF){
+				value = elf_symbol_address(module, symbol);
+			} else {
+				bool found = false;
+				for(auto& other : loaded){
+					if(const ElfW(Sym) * definition = elf_lookup(other, name)){
+						if(ELF64_ST_TYPE(definition->st_info) == STT_TLS){
+							error = module.path + ": " + name + " is thread-local, which isn't supported.";
+							return false;
+						}
+						value = elf_symbol_address(other, *definition);
+						found = true;
+						break;
+					}
+				}
+				if(!found && ELF64_ST_BIND(symbol.st_info) != STB_WEAK){
+					error = module.path + ": undefined symbol " + name + ".";
+					return false;
+				}
+			}
+		}
+		*where = value + relocation.r_addend;
+	}
+	return true;
+}
+
+inline bool elf_image::protect(){
+	const std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+	for(auto& phdr : phdrs){
+		if(phdr.p_type != PT_LOAD){
+			continue;
+		}
+		int protection = ((phdr.p_flags & PF_R) ? PROT_READ : 0) | ((phdr.p_flags & PF_W) ? PROT_WRITE : 0) | ((phdr.p_flags & PF_X) ? PROT_EXEC : 0);
+		std::uintptr_t start = (module.base + phdr.p_vaddr) & ~(page - 1);
+		std::uintptr_t end = (module.base + phdr.p_vaddr + phdr.p_memsz + page - 1) & ~(page - 1);
+		if(mprotect(reinterpret_cast<void *>(start), end - start, protection) != 0){
+			return false;
+		}
+	}
+	for(auto& phdr : phdrs){
+		if(phdr.p_type == PT_GNU_RELRO){
+			std::uintptr_t start = (module.base + phdr.p_vaddr) & ~(page - 1);
+			std::uintptr_t end = (module.base + phdr.p_vaddr + phdr.p_memsz) & ~(page - 1);
+			if(end > start && mprotect(reinterpret_cast<void *>(start), end - start, PROT_READ) != 0){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+inline void elf_image::run_initializers(){
+	using initializer = void (*)(int, char **, char **);
+	if(std::uintptr_t init = elf_dynamic_entry(module, DT_INIT)){
+		reinterpret_cast<initializer>(module.base + init)(0, nullptr, environ);
+	}
+	std::uintptr_t array = elf_dynamic_entry(module, DT_INIT_ARRAY);
+	std::size_t count = elf_dynamic_entry(module, DT_INIT_ARRAYSZ) / sizeof(ElfW(Addr));
+	for(std::size_t i = 0; array != 0 && i < count; i++){
+		reinterpret_cast<initializer const *>(module.base + array)[i](0, nullptr, environ);
+	}
+}
+
+inline void elf_image::run_finalizers(){
+	using finalizer = void (*)();
+	std::uintptr_t array = elf_dynamic_entry(module, DT_FINI_ARRAY);
+	std::size_t count = elf_dynamic_entry(module, DT_FINI_ARRAYSZ) / sizeof(ElfW(Addr));
+	for(std::size_t i = count; array != 0 && i > 0; i--){
+		reinterpret_cast<finalizer const *>(module.base + array)[i - 1]();
+	}
+	if(std::uintptr_t fini = elf_dynamic_entry(module, DT_FINI)){
+		reinterpret_cast<finalizer>(module.base + fini)();
+	}
+}
+
+inline void * elf_image::get_symbol(const char * name) const {
+	const ElfW(Sym) * symbol = elf_lookup(module, name);
+	if(symbol == nullptr){
+		return nullptr;
+	}
+	return reinterpret_cast<void *>(elf_symbol_address(module, *symbol));
+}
+
+#endif
+
+} //detail
@@ -0,0 +1,221 @@
+// This is inline content for the RLL headeronly file.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+
+//Persistent symbol offsets for `rll_flags::CACHE_SYMBOL_OFFSETS`. A cache file
+//belongs to one build of one library and is mapped straight into memory:
+//
+//	header | entries sorted by name hash | name strings
+//
+//All the fields are native endian, the files aren't meant to be shared across
+//machines.
+
+namespace detail {
+
+struct offset_cache_header {
+	char magic[8];
+	char build_id[128];
+	std::uint64_t count;
+	std::uint64_t strings_size;
+};
+
+struct offset_cache_entry {
+	std::uint64_t hash;
+	std::uint32_t name_offset;
+	std::uint32_t name_size;
+	std::uint64_t offset;
+};
+
+static const char offset_cache_magic[8] = { 'R', 'L', 'L', 'O', 'F', 'F', '0', '1' };
+
+inline std::uint64_t offset_cache_hash(const char * name, std::size_t size){
+	std::uint64_t hash = 14695981039346656037ull;
+	for(std::size_t i = 0; i < size; i++){
+		hash = (hash ^ static_cast<unsigned char>(name[i])) * 1099511628211ull;
+	}
+	return hash;
+}
+
+class symbol_offset_cache {
+	private:
+		symbol_offset_cache(const symbol_offset_cache&);
+		symbol_offset_cache& operator=(const symbol_offset_cache&);
+		//
+		elf_module module;
+		std::string file;
+		std::string build_id;
+		void * mapping = nullptr;
+		std::size_t mapping_size = 0;
+		const offset_cache_entry * entries = nullptr;
+		std::size_t count = 0;
+		const char * strings = nullptr;
+		std::mutex added_mutex;
+		std::vector<std::pair<std::string, std::uintptr_t>> added;
+
+		bool map();
+		bool owns(std::uintptr_t address) const;
+	public:
+		symbol_offset_cache(const elf_module& module, const std::string& file, const std::string& build_id)
+			: module(module), file(file), build_id(build_id){ map(); }
+		~symbol_offset_cache();
+
+		//Returns null if the symbol isn't in the mapped file.
+		void * find(const std::string& name) const noexcept;
+		//Remembers a symbol resolved the slow way, for the next `save()`.
+		void add(const std::string& name, void * address);
+		//Rewrites the file if symbols were added since it was mapped.
+		bool save();
+};
+
+inline symbol_offset_cache::~symbol_offset_cache(){
+	if(mapping != nullptr){
+		munmap(mapping, mapping_size);
+	}
+}
+
+inline bool symbol_offset_cache::map(){
+	int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		return false;
+	}
+	struct stat status;
+	if(fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(offset_cache_header)){
+		close(fd);
+		return false;
+	}
+	void * mapped = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED){
+		return false;
+	}
+
+	std::size_t size = static_cast<std::size_t>(status.st_size);
+	const offset_cache_header * header = static_cast<const offset_cache_header *>(mapped);
+	bool valid = std::memcmp(header->magic, offset_cache_magic, sizeof(header->magic)) == 0
+		&& build_id.size() < sizeof(header->build_id)
+		&& std::strncmp(header->build_id, build_id.c_str(), sizeof(header->build_id)) == 0
+		&& header->count <= (size - sizeof(offset_cache_header)) / sizeof(offset_cache_entry)
+		&& header->strings_size == size - sizeof(offset_cache_header) - header->count * sizeof(offset_cache_entry);
+	const offset_cache_entry * mapped_entries = reinterpret_cast<const offset_cache_entry *>(header + 1);
+	for(std::uint64_t i = 0; valid && i < header->count; i++){
+		valid = std::uint64_t(mapped_entries[i].name_offset) + mapped_entries[i].name_size <= header->strings_size;
+	}
+	if(!valid){
+		munmap(mapped, size);
+		return false;
+	}
+
+	mapping = mapped;
+	mapping_size = size;
+	entries = mapped_entries;
+	count = static_cast<std::size_t>(header->count);
+	strings = reinterpret_cast<const char *>(entries + count);
+	return true;
+}
+
+inline bool symbol_offset_cache::owns(std::uintptr_t address) const {
+	for(std::size_t i = 0; i < module.phnum; i++){
+		const ElfW(Phdr)& phdr = module.phdrs[i];
+		if(phdr.p_type == PT_LOAD && address >= module.base + phdr.p_vaddr && address < module.base + phdr.p_vaddr + phdr.p_memsz){
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void * symbol_offset_cache::find(const std::string& name) const noexcept {
+	if(count == 0){
+		return nullptr;
+	}
+	std::uint64_t hash = offset_cache_hash(name.data(), name.size());
+	const offset_cache_entry * it = std::lower_bound(entries, entries + count, hash, [](const offset_cache_entry& entry, std::uint64_t value){
+		return entry.hash < value;
+	});
+	for(; it != entries + count && it->hash == hash; ++it){
+		if(it->name_size == name.size() && std::memcmp(strings + it->name_offset, name.data(), name.size()) == 0){
+			//Checked on every lookup, not once in `map()`: the file is mapped
+			//shared, so it can still change under us. An offset outside the
+			//library is answered the slow way.
+			std::uintptr_t address = module.base + it->offset;
+			return owns(address) ? reinterpret_cast<void *>(address) : nullptr;
+		}
+	}
+	return nullptr;
+}
+
+inline void symbol_offset_cache::add(const std::string& name, void * address){
+	std::uintptr_t value = reinterpret_cast<std::uintptr_t>(address);
+	//Symbols defined elsewhere or picked by an IFUNC resolver can't be
+	//cached as an offset into this library.
+	if(!owns(value) || find(name) != nullptr){
+		return;
+	}
+	const ElfW(Sym) * symbol = elf_lookup(module, name.c_str());
+	if(symbol != nullptr && ELF64_ST_TYPE(symbol->st_info) == STT_GNU_IFUNC){
+		return;
+	}
+	std::lock_guard<std::mutex> lock(added_mutex);
+	added.emplace_back(name, value - module.base);
+}
+
+inline bool symbol_offset_cache::save(){
+	std::vector<std::pair<std::string, std::uintptr_t>> symbols;
+	{
+		std::lock_guard<std::mutex> lock(added_mutex);
+		if(added.empty()){
+			return true;
+		}
+		symbols.swap(added);
+	}
+	for(std::size_t i = 0; i < count; i++){
+		symbols.emplace_back(std::string(strings + entries[i].name_offset, entries[i].name_size), entries[i].offset);
+	}
+
+	std::vector<offset_cache_entry> sorted;
+	std::string names;
+	std::unordered_set<std::string> seen;
+	for(auto& symbol : symbols){
+		if(!seen.insert(symbol.first).second){
+			continue;
+		}
+		offset_cache_entry entry;
+		entry.hash = offset_cache_hash(symbol.first.data(), symbol.first.size());
+		entry.name_offset = static_cast<std::uint32_t>(names.size());
+		entry.name_size = static_cast<std::uint32_t>(symbol.first.size());
+		entry.offset = symbol.second;
+		sorted.push_back(entry);
+		names += symbol.first;
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const offset_cache_entry& a, const offset_cache_entry& b){
+		return a.hash < b.hash;
+	});
+
+	offset_cache_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, offset_cache_magic, sizeof(header.magic));
+	std::strncpy(header.build_id, build_id.c_str(), sizeof(header.build_id) - 1);
+	header.count = sorted.size();
+	header.strings_size = names.size();
+
+	//Written next to the file and renamed over it, so mapped copies in other
+	//processes stay intact.
+	std::string temporary = file + ".tmp" + std::to_string(getpid()) + "." + std::to_string(reinterpret_cast<std::uintptr_t>(this));
+	{
+		std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(sorted.data()), static_cast<std::streamsize>(sorted.size() * sizeof(offset_cache_entry)));
+		out.write(names.data(), static_cast<std::streamsize>(names.size()));
+		if(!out){
+			out.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	if(std::rename(temporary.c_str(), file.c_str()) != 0){
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+} //detail
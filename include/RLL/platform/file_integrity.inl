@@ -0,0 +1,323 @@
+// This is inline content for the RLL headeronly file.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+
+//Integrity verification for `rll_flags::VERIFY_INTEGRITY`. Files are hashed
+//with XXH64 and the digests are cached by the file's identity and change
+//times, in memory and optionally in a file shared between processes:
+//
+//	RLL-INTEGRITY 1
+//	<device> <inode> <size> <mtime> <ctime> <digest>
+//
+//The times are in nanoseconds. The ctime can't be set from user space, so a
+//file rewritten with its old mtime restored still misses the cache. Lines are
+//only ever appended; later lines win. A cache file that isn't owned by the
+//effective user, or that others can write, is ignored: whoever can write it
+//can make RLL trust any file.
+
+#define RLL_HAS_INTEGRITY_VERIFICATION
+
+namespace detail {
+
+class xxh64 {
+	public:
+		static std::uint64_t digest(const unsigned char * data, std::size_t size, std::uint64_t seed = 0) noexcept {
+			const unsigned char * end = data + size;
+			std::uint64_t hash;
+			if(size >= 32){
+				std::uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+				//Four independent lanes, which compilers keep in registers
+				//and the CPU runs side by side.
+				for(; end - data >= 32; data += 32){
+					lanes[0] = round(lanes[0], read64(data));
+					lanes[1] = round(lanes[1], read64(data + 8));
+					lanes[2] = round(lanes[2], read64(data + 16));
+					lanes[3] = round(lanes[3], read64(data + 24));
+				}
+				hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+				for(std::uint64_t lane : lanes){
+					hash = (hash ^ round(0, lane)) * prime1 + prime4;
+				}
+			} else {
+				hash = seed + prime5;
+			}
+			hash += size;
+
+			for(; end - data >= 8; data += 8){
+				hash = rotate(hash ^ round(0, read64(data)), 27) * prime1 + prime4;
+			}
+			if(end - data >= 4){
+				hash = rotate(hash ^ (read32(data) * prime1), 23) * prime2 + prime3;
+				data += 4;
+			}
+			for(; data < end; data++){
+				hash = rotate(hash ^ (*data * prime5), 11) * prime1;
+			}
+			hash ^= hash >> 33;
+			hash *= prime2;
+			hash ^= hash >> 29;
+			hash *= prime3;
+			hash ^= hash >> 32;
+			return hash;
+		}
+	private:
+		static constexpr std::uint64_t prime1 = 11400714785074694791ull;
+		static constexpr std::uint64_t prime2 = 14029467366897019727ull;
+		static constexpr std::uint64_t prime3 = 1609587929392839161ull;
+		static constexpr std::uint64_t prime4 = 9650029242287828579ull;
+		static constexpr std::uint64_t prime5 = 2870177450012600261ull;
+
+		static std::uint64_t rotate(std::uint64_t value, int bits) noexcept {
+			return (value << bits) | (value >> (64 - bits));
+		}
+		static std::uint64_t round(std::uint64_t accumulator, std::uint64_t input) noexcept {
+			return rotate(accumulator + input * prime2, 31) * prime1;
+		}
+		static std::uint64_t read64(const unsigned char * data) noexcept {
+			std::uint64_t value = 0;
+			for(int i = 7; i >= 0; i--){
+				value = value << 8 | data[i];
+			}
+			return value;
+		}
+		static std::uint64_t read32(const unsigned char * data) noexcept {
+			return std::uint64_t(data[0]) | std::uint64_t(data[1]) << 8 | std::uint64_t(data[2]) << 16 | std::uint64_t(data[3]) << 24;
+		}
+};
+
+inline std::string format_digest(std::uint64_t digest){
+	char text[17];
+	std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(digest));
+	return text;
+}
+
+struct file_identity {
+	std::uint64_t device;
+	std::uint64_t inode;
+	std::uint64_t size;
+	std::int64_t mtime;
+	std::int64_t ctime;
+
+	bool operator==(const file_identity& other) const noexcept {
+		return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime && ctime == other.ctime;
+	}
+};
+
+struct file_identity_hash {
+	std::size_t operator()(const file_identity& identity) const noexcept {
+		std::uint64_t fields[5] = { identity.device, identity.inode, identity.size, static_cast<std::uint64_t>(identity.mtime), static_cast<std::uint64_t>(identity.ctime) };
+		return static_cast<std::size_t>(xxh64::digest(reinterpret_cast<const unsigned char *>(fields), sizeof(fields)));
+	}
+};
+
+inline file_identity identify_file(const struct stat& status){
+	file_identity identity;
+	identity.device = static_cast<std::uint64_t>(status.st_dev);
+	identity.inode = static_cast<std::uint64_t>(status.st_ino);
+	identity.size = static_cast<std::uint64_t>(status.st_size);
+	identity.mtime = std::int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+	identity.ctime = std::int64_t(status.st_ctim.tv_sec) * 1000000000 + status.st_ctim.tv_nsec;
+	return identity;
+}
+
+//Whether a cache file opened as `fd` can only have been written by us.
+inline bool is_private_file(int fd){
+	struct stat status;
+	return fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_uid == geteuid() && (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+class integrity_cache {
+	public:
+		void set_file(const std::string& path){
+			std::lock_guard<std::mutex> lock(mutex);
+			file = path;
+			read = false;
+		}
+
+		void set_trusted(const std::vector<std::string>& digests){
+			std::lock_guard<std::mutex> lock(mutex);
+			trusted.clear();
+			for(auto& digest : digests){
+				std::string lower = digest;
+				for(char& c : lower){
+					if(c >= 'A' && c <= 'F'){
+						c = static_cast<char>(c - 'A' + 'a');
+					}
+				}
+				trusted.insert(lower);
+			}
+		}
+
+		bool is_trusted(const std::string& digest){
+			std::lock_guard<std::mutex> lock(mutex);
+			return trusted.count(digest) != 0;
+		}
+
+		//The digest of an open file, hashed only if the cache doesn't know it.
+		bool digest(int fd, std::string& out, std::string& error){
+			struct stat status;
+			if(fstat(fd, &status) != 0){
+				error = std::string("Couldn't stat the library: ") + std::strerror(errno);
+				return false;
+			}
+			file_identity identity = identify_file(status);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				load();
+				auto found = digests.find(identity);
+				if(found != digests.end()){
+					out = found->second;
+					return true;
+				}
+			}
+
+			std::uint64_t hash = 0;
+			if(identity.size == 0){
+				hash = xxh64::digest(nullptr, 0);
+			} else {
+				void * mapped = mmap(nullptr, static_cast<std::size_t>(identity.size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if(mapped == MAP_FAILED){
+					error = std::string("Couldn't map the library to hash it: ") + std::strerror(errno);
+					return false;
+				}
+				madvise(mapped, static_cast<std::size_t>(identity.size), MADV_SEQUENTIAL);
+				hash = xxh64::digest(static_cast<const unsigned char *>(mapped), static_cast<std::size_t>(identity.size));
+				munmap(mapped, static_cast<std::size_t>(identity.size));
+			}
+			out = format_digest(hash);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			digests[identity] = out;
+			append(identity, out);
+			return true;
+		}
+	private:
+		std::mutex mutex;
+		std::string file;
+		bool read = false;
+		std::unordered_map<file_identity, std::string, file_identity_hash> digests;
+		std::unordered_set<std::string> trusted;
+
+		void load(){
+			if(read || file.empty()){
+				return;
+			}
+			read = true;
+			//Checked on the descriptor that is read, so the file can't be
+			//swapped after the check.
+			int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+			if(fd < 0){
+				return;
+			}
+			std::string contents;
+			if(is_private_file(fd)){
+				char buffer[4096];
+				ssize_t got;
+				while((got = ::read(fd, buffer, sizeof(buffer))) > 0 || (got < 0 && errno == EINTR)){
+					if(got > 0){
+						contents.append(buffer, static_cast<std::size_t>(got));
+					}
+				}
+			}
+			close(fd);
+			std::istringstream in(contents);
+			std::string header;
+			if(!std::getline(in, header) || header != "RLL-INTEGRITY 1"){
+				return;
+			}
+			file_identity identity;
+			std::string digest;
+			while(in >> identity.device >> identity.inode >> identity.size >> identity.mtime >> identity.ctime >> digest){
+				if(digest.size() == 16){
+					digests[identity] = digest;
+				}
+			}
+		}
+
+		//One `write` per line on an `O_APPEND` descriptor, so processes
+		//sharing the file don't interleave their lines.
+		void append(const file_identity& identity, const std::string& digest){
+			if(file.empty()){
+				return;
+			}
+			int fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+			if(fd < 0){
+				return;
+			}
+			if(!is_private_file(fd)){
+				close(fd);
+				return;
+			}
+			std::string line;
+			struct stat status;
+			if(fstat(fd, &status) == 0 && status.st_size == 0){
+				line = "RLL-INTEGRITY 1\n";
+			}
+			line += std::to_string(identity.device) + " " + std::to_string(identity.inode) + " " + std::to_string(identity.size) + " "
+				+ std::to_string(identity.mtime) + " " + std::to_string(identity.ctime) + " " + digest + "\n";
+			ssize_t written = ::write(fd, line.data(), line.size());
+			(void) written;
+			close(fd);
+		}
+};
+
+inline integrity_cache& get_integrity_cache(){
+	static integrity_cache cache;
+	return cache;
+}
+
+//An open descriptor of a verified file. Loading through its `/proc` path
+//loads the file that was hashed even if the path is swapped for another file
+//in the meantime. That doesn't stop the file itself from being rewritten in
+//place, so `unchanged()` is checked again once it is loaded; a rewrite after
+//that isn't caught, the file needs permissions that don't allow it.
+class verified_file {
+	public:
+		verified_file() = default;
+		verified_file(const verified_file&) = delete;
+		verified_file& operator=(const verified_file&) = delete;
+		~verified_file(){
+			if(fd >= 0){
+				close(fd);
+			}
+		}
+
+		std::string path() const { return "/proc/self/fd/" + std::to_string(fd); }
+
+		//Whether the file still has the identity it had when it was hashed.
+		//Any write changes its ctime.
+		bool unchanged() const {
+			struct stat status;
+			return fstat(fd, &status) == 0 && identify_file(status) == identity;
+		}
+
+		int fd = -1;
+		file_identity identity{};
+};
+
+//Opens and hashes `path` and checks the digest against the trusted ones.
+inline bool verify_library(const std::string& path, verified_file& file, std::string& error){
+	file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(file.fd < 0){
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	struct stat status;
+	if(fstat(file.fd, &status) != 0){
+		error = path + ": " + std::strerror(errno);
+		return false;
+	}
+	file.identity = identify_file(status);
+	std::string digest;
+	if(!get_integrity_cache().digest(file.fd, digest, error)){
+		error = path + ": " + error;
+		return false;
+	}
+	if(!get_integrity_cache().is_trusted(digest)){
+		error = path + ": failed integrity verification (XXH64 " + digest + " isn't trusted).";
+		return false;
+	}
+	return true;
+}
+
+} //detail
@@ -0,0 +1,485 @@
+// This is inline content for the RLL headeronly file.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+
+//Transparent loading of LZ4 compressed libraries. A library file that starts
+//with the LZ4 frame magic is decompressed into an anonymous memory file
+//(`memfd_create`) and loaded from there. The file is read on a background
+//thread while the frames are decoded, so the disk and the decoder work at the
+//same time. The decoder follows the LZ4 frame and block format
+//specifications (https://github.com/lz4/lz4/tree/dev/doc) and checks every
+//checksum the frames carry. Like the other ELF helpers nothing here throws;
+//errors are returned as strings.
+
+#define RLL_HAS_COMPRESSED_LIBRARIES
+
+namespace detail {
+
+class xxh32 {
+	public:
+		explicit xxh32(std::uint32_t seed = 0) noexcept : seed(seed) {
+			lanes[0] = seed + prime1 + prime2;
+			lanes[1] = seed + prime2;
+			lanes[2] = seed;
+			lanes[3] = seed - prime1;
+		}
+
+		void update(const unsigned char * data, std::size_t size) noexcept {
+			total += size;
+			if(buffered + size < 16){
+				std::memcpy(buffer + buffered, data, size);
+				buffered += size;
+				return;
+			}
+			if(buffered != 0){
+				std::size_t fill = 16 - buffered;
+				std::memcpy(buffer + buffered, data, fill);
+				consume(buffer);
+				data += fill;
+				size -= fill;
+				buffered = 0;
+			}
+			for(; size >= 16; data += 16, size -= 16){
+				consume(data);
+			}
+			std::memcpy(buffer, data, size);
+			buffered = size;
+		}
+
+		std::uint32_t digest() const noexcept {
+			std::uint32_t hash = total >= 16
+				? rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18)
+				: seed + prime5;
+			hash += static_cast<std::uint32_t>(total);
+			std::size_t i = 0;
+			for(; i + 4 <= buffered; i += 4){
+				hash = rotate(hash + read32(buffer + i) * prime3, 17) * prime4;
+			}
+			for(; i < buffered; i++){
+				hash = rotate(hash + buffer[i] * prime5, 11) * prime1;
+			}
+			hash ^= hash >> 15;
+			hash *= prime2;
+			hash ^= hash >> 13;
+			hash *= prime3;
+			hash ^= hash >> 16;
+			return hash;
+		}
+
+		static std::uint32_t read32(const unsigned char * data) noexcept {
+			return std::uint32_t(data[0]) | std::uint32_t(data[1]) << 8 | std::uint32_t(data[2]) << 16 | std::uint32_t(data[3]) << 24;
+		}
+	private:
+		static constexpr std::uint32_t prime1 = 2654435761u;
+		static constexpr std::uint32_t prime2 = 2246822519u;
+		static constexpr std::uint32_t prime3 = 3266489917u;
+		static constexpr std::uint32_t prime4 = 668265263u;
+		static constexpr std::uint32_t prime5 = 374761393u;
+
+		std::uint32_t seed;
+		std::uint32_t lanes[4];
+		unsigned char buffer[16];
+		std::size_t buffered = 0;
+		std::uint64_t total = 0;
+
+		static std::uint32_t rotate(std::uint32_t value, int bits) noexcept {
+			return (value << bits) | (value >> (32 - bits));
+		}
+		void consume(const unsigned char * data) noexcept {
+			for(int i = 0; i < 4; i++){
+				lanes[i] = rotate(lanes[i] + read32(data + 4 * i) * prime2, 13) * prime1;
+			}
+		}
+};
+
+inline std::uint32_t xxh32_digest(const unsigned char * data, std::size_t size){
+	xxh32 hash;
+	hash.update(data, size);
+	return hash.digest();
+}
+
+//Reads a file in chunks on a background thread, a few chunks ahead of the
+//consumer.
+class read_ahead {
+	public:
+		explicit read_ahead(int fd) : fd(fd), reader(&read_ahead::fill, this) {}
+		read_ahead(const read_ahead&) = delete;
+		read_ahead& operator=(const read_ahead&) = delete;
+		~read_ahead(){
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			changed.notify_all();
+			reader.join();
+		}
+
+		//Copies exactly `size` bytes, false if the file ends first.
+		bool read(unsigned char * out, std::size_t size){
+			while(size != 0){
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [this](){ return !chunks.empty() || finished; });
+				if(chunks.empty()){
+					return false;
+				}
+				std::vector<unsigned char>& front = chunks.front();
+				std::size_t taken = std::min(size, front.size() - offset);
+				std::memcpy(out, front.data() + offset, taken);
+				out += taken;
+				size -= taken;
+				offset += taken;
+				if(offset == front.size()){
+					chunks.pop_front();
+					offset = 0;
+					changed.notify_all();
+				}
+			}
+			return true;
+		}
+
+		//Whether every byte of the file has been read.
+		bool at_end(){
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this](){ return !chunks.empty() || finished; });
+			return chunks.empty();
+		}
+
+		//The `errno` the reader thread's read failed with, 0 if none did.
+		int error_number(){
+			std::lock_guard<std::mutex> lock(mutex);
+			return read_errno;
+		}
+	private:
+		static constexpr std::size_t chunk_size = 1 << 20;
+		static constexpr std::size_t max_chunks = 4;
+
+		int fd;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<std::vector<unsigned char>> chunks;
+		std::size_t offset = 0;
+		bool finished = false;
+		bool stopping = false;
+		int read_errno = 0;
+		std::thread reader;
+
+		void fill(){
+			for(;;){
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					changed.wait(lock, [this](){ return stopping || chunks.size() < max_chunks; });
+					if(stopping){
+						return;
+					}
+				}
+				std::vector<unsigned char> chunk(chunk_size);
+				ssize_t count;
+				do {
+					count = ::read(fd, chunk.data(), chunk.size());
+				} while(count < 0 && errno == EINTR);
+				int code = count < 0 ? errno : 0;
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if(count <= 0){
+					read_errno = code;
+					finished = true;
+					changed.notify_all();
+					return;
+				}
+				chunk.resize(static_cast<std::size_t>(count));
+				chunks.push_back(std::move(chunk));
+				changed.notify_all();
+			}
+		}
+};
+
+static const std::uint32_t lz4_frame_magic = 0x184D2204;
+
+//Decodes one LZ4 block, appending to `out`. Earlier output stays in `out` for
+//matches that reach back into previous blocks.
+inline bool lz4_decode_block(const unsigned char * in, std::size_t size, std::vector<unsigned char>& out, std::size_t history, std::size_t limit){
+	const unsigned char * end = in + size;
+	const std::size_t start = out.size();
+	while(in < end){
+		unsigned int token = *in++;
+		std::size_t literals = token >> 4;
+		if(literals == 15){
+			unsigned char extra;
+			do {
+				if(in == end){
+					return false;
+				}
+				extra = *in++;
+				literals += extra;
+			} while(extra == 255);
+		}
+		if(literals > static_cast<std::size_t>(end - in) || out.size() - start + literals > limit){
+			return false;
+		}
+		out.insert(out.end(), in, in + literals);
+		in += literals;
+		//The last sequence is literals only.
+		if(in == end){
+			break;
+		}
+
+		if(end - in < 2){
+			return false;
+		}
+		std::size_t distance = std::size_t(in[0]) | std::size_t(in[1]) << 8;
+		in += 2;
+		std::size_t length = token & 15;
+		if(length == 15){
+			unsigned char extra;
+			do {
+				if(in == end){
+					return false;
+				}
+				extra = *in++;
+				length += extra;
+			} while(extra == 255);
+		}
+		length += 4;
+		if(distance == 0 || distance > out.size() - start + history || out.size() - start + length > limit){
+			return false;
+		}
+		std::size_t from = out.size() - distance;
+		out.resize(out.size() + length);
+		unsigned char * target = out.data() + out.size() - length;
+		const unsigned char * source = out.data() + from;
+		if(distance >= length){
+			std::memcpy(target, source, length);
+		} else {
+			//Overlapping matches repeat the last `distance` bytes.
+			for(std::size_t i = 0; i < length; i++){
+				target[i] = source[i];
+			}
+		}
+	}
+	return true;
+}
+
+inline bool write_all(int fd, const unsigned char * data, std::size_t size){
+	while(size != 0){
+		ssize_t written = ::write(fd, data, size);
+		if(written < 0){
+			if(errno == EINTR){
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+//A read that came up short means the file was truncated, unless the reader
+//thread's read failed. Its `errno` is passed back, this thread's is unrelated.
+inline bool read_failed(read_ahead& input, const char * truncated, std::string& error){
+	int code = input.error_number();
+	error = code != 0 ? std::string("Couldn't read the compressed library: ") + std::strerror(code) : truncated;
+	return false;
+}
+
+//Decodes the LZ4 frames (and skips the skippable frames) of `input` into `fd`.
+inline bool lz4_decompress(read_ahead& input, int fd, std::string& error){
+	//Decoded bytes are written out after every block, but the last 64 KiB stay
+	//around for blocks that depend on the ones before them.
+	const std::size_t window = 64 * 1024;
+	std::vector<unsigned char> out;
+	std::vector<unsigned char> block;
+
+	do {
+		unsigned char magic[4];
+		if(!input.read(magic, sizeof(magic))){
+			return read_failed(input, "Truncated LZ4 frame.", error);
+		}
+		std::uint32_t frame_magic = xxh32::read32(magic);
+		if((frame_magic & 0xFFFFFFF0u) == 0x184D2A50u){
+			unsigned char size_bytes[4];
+			if(!input.read(size_bytes, sizeof(size_bytes))){
+				return read_failed(input, "Truncated LZ4 skippable frame.", error);
+			}
+			//Its size isn't bounded by the block size, so it is skipped a
+			//piece at a time rather than read whole.
+			unsigned char skipped[4096];
+			for(std::uint32_t left = xxh32::read32(size_bytes); left > 0;){
+				std::size_t piece = std::min<std::size_t>(left, sizeof(skipped));
+				if(!input.read(skipped, piece)){
+					return read_failed(input, "Truncated LZ4 skippable frame.", error);
+				}
+				left -= static_cast<std::uint32_t>(piece);
+			}
+			continue;
+		}
+		if(frame_magic != lz4_frame_magic){
+			error = "Not an LZ4 frame.";
+			return false;
+		}
+
+		unsigned char descriptor[15];
+		if(!input.read(descriptor, 2)){
+			return read_failed(input, "Truncated LZ4 frame descriptor.", error);
+		}
+		unsigned int flags = descriptor[0];
+		unsigned int block_code = (descriptor[1] >> 4) & 7;
+		if((flags >> 6) != 1 || (flags & 0x02) || (descriptor[1] & 0x8F) || block_code < 4){
+			error = "Unsupported LZ4 frame descriptor.";
+			return false;
+		}
+		bool independent = flags & 0x20;
+		bool block_checksums = flags & 0x10;
+		bool content_size = flags & 0x08;
+		bool content_checksum = flags & 0x04;
+		bool dictionary = flags & 0x01;
+		std::size_t descriptor_size = 2 + (content_size ? 8 : 0) + (dictionary ? 4 : 0);
+		if(!input.read(descriptor + 2, descriptor_size - 2 + 1)){
+			return read_failed(input, "Truncated LZ4 frame descriptor.", error);
+		}
+		if(((xxh32_digest(descriptor, descriptor_size) >> 8) & 0xFF) != descriptor[descriptor_size]){
+			error = "Corrupted LZ4 frame descriptor.";
+			return false;
+		}
+		if(dictionary){
+			error = "LZ4 frames that need a dictionary aren't supported.";
+			return false;
+		}
+		const std::size_t block_limit = std::size_t(1) << (8 + 2 * block_code);
+		std::uint64_t expected_size = 0;
+		for(int i = 7; content_size && i >= 0; i--){
+			expected_size = expected_size << 8 | descriptor[2 + i];
+		}
+
+		xxh32 checksum;
+		std::uint64_t frame_size = 0;
+		for(;;){
+			unsigned char header[4];
+			if(!input.read(header, sizeof(header))){
+				return read_failed(input, "Truncated LZ4 block.", error);
+			}
+			std::uint32_t block_size = xxh32::read32(header);
+			if(block_size == 0){
+				break;
+			}
+			bool stored = block_size & 0x80000000u;
+			block_size &= 0x7FFFFFFFu;
+			if(block_size > block_limit){
+				error = "LZ4 block larger than the frame allows.";
+				return false;
+			}
+			block.resize(block_size + (block_checksums ? 4 : 0));
+			if(!input.read(block.data(), block.size())){
+				return read_failed(input, "Truncated LZ4 block.", error);
+			}
+			if(block_checksums && xxh32_digest(block.data(), block_size) != xxh32::read32(block.data() + block_size)){
+				error = "Corrupted LZ4 block.";
+				return false;
+			}
+
+			std::size_t history = independent ? 0 : out.size();
+			std::size_t start = out.size();
+			if(stored){
+				out.insert(out.end(), block.data(), block.data() + block_size);
+			} else if(!lz4_decode_block(block.data(), block_size, out, history, block_limit)){
+				error = "Corrupted LZ4 block.";
+				return false;
+			}
+			std::size_t produced = out.size() - start;
+			if(content_checksum){
+				checksum.update(out.data() + start, produced);
+			}
+			if(!write_all(fd, out.data() + start, produced)){
+				error = std::string("Couldn't write the decompressed library: ") + std::strerror(errno);
+				return false;
+			}
+			frame_size += produced;
+			if(out.size() > 4 * window){
+				out.erase(out.begin(), out.end() - window);
+			}
+		}
+
+		if(content_checksum){
+			unsigned char stored_checksum[4];
+			if(!input.read(stored_checksum, sizeof(stored_checksum))){
+				return read_failed(input, "Truncated LZ4 frame.", error);
+			}
+			if(checksum.digest() != xxh32::read32(stored_checksum)){
+				error = "Corrupted LZ4 frame, the content checksum doesn't match.";
+				return false;
+			}
+		}
+		if(content_size && frame_size != expected_size){
+			error = "Corrupted LZ4 frame, the content size doesn't match.";
+			return false;
+		}
+		out.clear();
+	} while(!input.at_end());
+
+	if(input.error_number() != 0){
+		return read_failed(input, "", error);
+	}
+	return true;
+}
+
+//An anonymous memory file that is closed when it goes away.
+class memory_file {
+	public:
+		memory_file() = default;
+		memory_file(const memory_file&) = delete;
+		memory_file& operator=(const memory_file&) = delete;
+		~memory_file(){
+			if(fd >= 0){
+				close(fd);
+			}
+		}
+
+		bool is_open() const noexcept { return fd >= 0; }
+		//A path the file can be opened through, e.g. by `dlopen`.
+		std::string path() const { return "/proc/self/fd/" + std::to_string(fd); }
+
+		int fd = -1;
+};
+
+//Decompresses the library at `source` (opened as `path`, which can be a
+//verified descriptor's path) into `file` if it is LZ4 compressed. Leaves
+//`file` closed for any other file (and for files that can't be opened, so the
+//platform loader reports those). Returns false only for compressed files that
+//can't be decompressed.
+inline bool decompress_library(const std::string& source, const std::string& path, memory_file& file, std::string& error){
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0){
+		return true;
+	}
+	unsigned char magic[4];
+	if(pread(fd, magic, sizeof(magic), 0) != sizeof(magic) || xxh32::read32(magic) != lz4_frame_magic){
+		close(fd);
+		return true;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	std::string::size_type slash = source.find_last_of('/');
+	std::string name = "rll:" + (slash == std::string::npos ? source : source.substr(slash + 1));
+	file.fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if(file.fd < 0){
+		error = std::string("Couldn't create a memory file for the decompressed library: ") + std::strerror(errno);
+		close(fd);
+		return false;
+	}
+
+	bool decompressed;
+	{
+		read_ahead input(fd);
+		decompressed = lz4_decompress(input, file.fd, error);
+	}
+	close(fd);
+	if(!decompressed){
+		error = source + ": " + error;
+		return false;
+	}
+	//Nobody can change the code after it is loaded.
+	fcntl(file.fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+	return true;
+}
+
+} //detail
@@ -2,93 +2,832 @@
 // It is public domain:
 // Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
 
-inline std::mutex shared_library::_mutex;
-
-inline shared_library::shared_library(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline basic_shared_library<lock_policy, error_policy, cache_policy>::basic_shared_library(){
 	lib_handle = nullptr;
 }
 
-inline shared_library::~shared_library(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline basic_shared_library<lock_policy, error_policy, cache_policy>::~basic_shared_library(){
 	unload();
 }
 
-inline void shared_library::load(const std::string& path, int flags){
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline bool basic_shared_library<lock_policy, error_policy, cache_policy>::load(const std::string& path, int flags, unsigned int options){
+	RLL_TRACE_SCOPE("load", path);
+	//Libraries are verified and decompressed before taking any lock, so
+	//several of them are processed in parallel.
+	std::string file = path;
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	detail::verified_file verified;
+	if(options & rll_flags::VERIFY_INTEGRITY){
+		std::string error;
+		if(!detail::verify_library(path, verified, error)){
+			error_policy::template raise<exception::library_loading_error>(error);
+			return false;
+		}
+		file = verified.path();
+	}
+	#else
+	if(options & rll_flags::VERIFY_INTEGRITY){
+		error_policy::template raise<exception::not_supported>("rll_flags::VERIFY_INTEGRITY needs /proc/self/fd.");
+		return false;
+	}
+	#endif
+	#ifndef RLL_HAS_LINK_MAP_NAMESPACES
+	if(options & rll_flags::NEW_NAMESPACE){
+		error_policy::template raise<exception::not_supported>("rll_flags::NEW_NAMESPACE needs dlmopen.");
+		return false;
+	}
+	#endif
+	#ifdef RLL_HAS_COMPRESSED_LIBRARIES
+	detail::memory_file decompressed;
+	{
+		std::string error;
+		if(!detail::decompress_library(path, file, decompressed, error)){
+			error_policy::template raise<exception::library_loading_error>(error);
+			return false;
+		}
+		if(decompressed.is_open()){
+			file = decompressed.path();
+		}
+	}
+	#endif
+
+	#ifdef RLL_HAS_USERSPACE_LOADER
+	if(options & rll_flags::USERSPACE_LOADER){
+		return load_image(path, file, options);
+	}
+	#endif
+
+	RLL_TRACE_LOCK(loader_lock, detail::loader_mutex());
+	RLL_TRACE_LOCK(lock, lib_lock);
 
 	if(lib_handle != nullptr){ 
-		throw exception::library_already_loaded(path);
+		error_policy::template raise<exception::library_already_loaded>(path);
+		return false;
+	}
+
+	#ifdef RLL_PLATFORM_IS_ELF
+	std::vector<detail::elf_module> resident;
+	if(options & rll_flags::RECORD_LOAD_REPORT){
+		resident = detail::elf_loaded_modules();
+	}
+	#endif
+
+	if(options & rll_flags::WARM_BINDINGS){
+		flags = (flags & ~RTLD_LAZY) | RTLD_NOW;
+	}
+
+	//Verified and decompressed libraries are loaded through their descriptor.
+	int * descriptor = nullptr;
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	if(verified.fd >= 0){
+		descriptor = &verified.fd;
+	}
+	#endif
+	#ifdef RLL_HAS_COMPRESSED_LIBRARIES
+	if(decompressed.is_open()){
+		descriptor = &decompressed.fd;
 	}
+	#endif
+	#if defined(RLL_HAS_INTEGRITY_VERIFICATION) || defined(RLL_HAS_COMPRESSED_LIBRARIES)
+	if(descriptor != nullptr){
+		file = detail::elf_unaliased_fd_path(*descriptor);
+	}
+	#endif
 
-	lib_handle = dlopen(path.c_str(), flags);
+	std::vector<void *> evicted;
+	bool pooled = false;
+	auto start = std::chrono::steady_clock::now();
+	#ifdef RLL_HAS_LINK_MAP_NAMESPACES
+	if(options & rll_flags::NEW_NAMESPACE){
+		lib_handle = dlmopen(LM_ID_NEWLM, file.c_str(), flags);
+	} else
+	#endif
+	{
+		lib_handle = detail::get_warm_pool().take(path, flags, evicted);
+		#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+		//A parked handle is only used if it is the file that was just verified.
+		if(lib_handle != nullptr && descriptor == &verified.fd && !detail::elf_module_backed_by(lib_handle, verified.fd)){
+			evicted.push_back(lib_handle);
+			lib_handle = nullptr;
+		}
+		#endif
+		pooled = lib_handle != nullptr;
+		if(lib_handle == nullptr){
+			lib_handle = dlopen(file.c_str(), flags);
+		}
+	}
+	auto load_time = std::chrono::steady_clock::now() - start;
+	for(void * handle : evicted){
+		dlclose(handle);
+	}
 	
 	if(lib_handle == nullptr){
 		const char* error = dlerror();
-		throw exception::library_loading_error(error ? error : "Unknown error from dlopen()");
+		error_policy::template raise<exception::library_loading_error>(error ? error : "Unknown error from dlopen()");
+		return false;
+	}
+
+	#if defined(RLL_HAS_INTEGRITY_VERIFICATION) || defined(RLL_HAS_COMPRESSED_LIBRARIES)
+	if(descriptor != nullptr && !pooled && !detail::elf_module_backed_by(lib_handle, *descriptor)){
+		dlclose(lib_handle);
+		lib_handle = nullptr;
+		error_policy::template raise<exception::library_loading_error>(path + ": the loader returned an already loaded library instead of the one that was verified or decompressed.");
+		return false;
 	}
+	#endif
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	if(verified.fd >= 0 && !verified.unchanged()){
+		dlclose(lib_handle);
+		lib_handle = nullptr;
+		error_policy::template raise<exception::library_loading_error>(path + ": the file was modified while it was being verified and loaded.");
+		return false;
+	}
+	#endif
 	
 	lib_path = path;
+	lib_flags = flags;
+	lib_namespaced = (options & rll_flags::NEW_NAMESPACE) != 0;
+	lib_symbols.clear();
+	if(cache_policy::enabled){
+		startup_manifest::get_resolved_symbols(lib_handle, lib_symbols);
+	}
+	if(startup_manifest * manifest = startup_manifest::get_recording()){
+		manifest->record_load(path, lib_handle, static_cast<unsigned int>(flags), options);
+	}
+	lib_report = load_report();
+	lib_report.path = path;
+	lib_report.load_time = std::chrono::duration_cast<std::chrono::nanoseconds>(load_time);
+
+	#ifdef RLL_PLATFORM_IS_ELF
+	if(options & rll_flags::RECORD_LOAD_REPORT){
+		detail::elf_build_load_report(lib_report, lib_handle, resident);
+	}
+	if(options & rll_flags::INDEX_SYMBOLS){
+		index_symbols();
+	}
+	if(cache_policy::enabled && (options & rll_flags::CACHE_SYMBOL_OFFSETS)){
+		open_offset_cache();
+	}
+	#endif
+	return true;
+}
+
+#ifdef RLL_PLATFORM_IS_ELF
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::index_symbols(){
+	//Only `shared_library` is indexed, so other instantiations don't
+	//enumerate the exports (and run their IFUNC resolvers) for nothing.
+	if constexpr(std::is_same<basic_shared_library, shared_library>::value){
+		detail::elf_module module;
+		if(detail::elf_find_module(lib_handle, module)){
+			std::vector<std::pair<std::string, void *>> exports;
+			detail::elf_exported_symbols(module, exports);
+			symbol_index::global().add(this, exports);
+			lib_indexed = true;
+		}
+	}
 }
 
-inline void shared_library::load(const std::string& path, loader_flags flags){
-	load(path, flags.get_unix_flags());
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::open_offset_cache(){
+	std::string directory = detail::offset_cache_directory().get();
+	detail::elf_module module;
+	if(directory.empty() || !detail::elf_find_module(lib_handle, module)){
+		return;
+	}
+	std::string build_id = detail::elf_build_id(module);
+	if(!build_id.empty()){
+		lib_offsets = std::make_shared<detail::symbol_offset_cache>(module, directory + "/" + build_id + ".offsets", build_id);
+	}
 }
+#endif
 
-inline void shared_library::unload(){
-	std::lock_guard<std::mutex> lock(_mutex);
+#ifdef RLL_HAS_USERSPACE_LOADER
+//Doesn't take the loader mutex or enter the platform loader, so different
+//libraries load in parallel.
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline bool basic_shared_library<lock_policy, error_policy, cache_policy>::load_image(const std::string& path, const std::string& file, unsigned int options){
+	RLL_TRACE_LOCK(lock, lib_lock);
 
 	if(lib_handle != nullptr){
-		dlclose(lib_handle);
+		error_policy::template raise<exception::library_already_loaded>(path);
+		return false;
+	}
+
+	std::vector<detail::elf_module> resident;
+	if(options & rll_flags::RECORD_LOAD_REPORT){
+		resident = detail::elf_loaded_modules();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::shared_ptr<detail::elf_image> image = std::make_shared<detail::elf_image>();
+	std::string error;
+	if(!image->load(file, error)){
+		error_policy::template raise<exception::library_loading_error>(error);
+		return false;
+	}
+	auto load_time = std::chrono::steady_clock::now() - start;
+
+	lib_image = image;
+	lib_handle = image.get();
+	lib_path = path;
+	lib_symbols.clear();
+	if(cache_policy::enabled){
+		startup_manifest::get_resolved_symbols(lib_handle, lib_symbols);
+	}
+	if(startup_manifest * manifest = startup_manifest::get_recording()){
+		manifest->record_load(path, lib_handle, 0, options);
+	}
+	lib_report = load_report();
+	lib_report.path = path;
+	lib_report.load_time = std::chrono::duration_cast<std::chrono::nanoseconds>(load_time);
+
+	if(options & rll_flags::RECORD_LOAD_REPORT){
+		detail::elf_build_load_report(lib_report, lib_handle, resident);
+	}
+	if(options & rll_flags::INDEX_SYMBOLS){
+		index_symbols();
+	}
+	if(cache_policy::enabled && (options & rll_flags::CACHE_SYMBOL_OFFSETS)){
+		open_offset_cache();
+	}
+	return true;
+}
+#endif
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::load(const std::string& path, loader_flags flags){
+	bool loaded = load(path, flags.get_unix_flags(), flags.get_rll_flags());
+	#ifdef RLL_PLATFORM_IS_ELF
+	//Outside the loader mutex, prefaulting a big library doesn't hold up
+	//other loads.
+	if(loaded){
+		warm(flags.get_rll_flags());
+	}
+	#else
+	(void) loaded;
+	#endif
+}
+
+#ifdef RLL_PLATFORM_IS_ELF
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::warm(unsigned int options){
+	bool lock_memory = options & rll_flags::LOCK_MEMORY;
+	if(!lock_memory && !(options & rll_flags::PREFAULT)){
+		return;
+	}
+	RLL_TRACE_SCOPE("warm", lib_path);
+	RLL_TRACE_LOCK(lock, lib_lock);
+	detail::elf_module module;
+	if(lib_handle != nullptr && detail::elf_find_module(lib_handle, module)){
+		auto start = std::chrono::steady_clock::now();
+		detail::elf_warm_module(module, true, lock_memory, lib_report);
+		lib_report.warm_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+	}
+}
+#endif
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::unload(){
+	unload(true);
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::unload(bool park){
+	RLL_TRACE_SCOPE("unload", lib_path);
+	std::shared_ptr<detail::symbol_offset_cache> offsets;
+	{
+		RLL_TRACE_LOCK(lock, lib_lock);
+		offsets = std::move(lib_offsets);
+		if(lib_indexed){
+			if constexpr(std::is_same<basic_shared_library, shared_library>::value){
+				symbol_index::global().remove(this);
+			}
+			lib_indexed = false;
+		}
+	}
+	if(offsets){
+		offsets->save();
+	}
+	if(lib_image){
+		RLL_TRACE_LOCK(lock, lib_lock);
 		lib_handle = nullptr;
+		lib_image.reset();
+		lib_path.clear();
+		lib_report = load_report();
+		lib_address_index.reset();
+		lib_demangled.reset();
+		lib_symbols.clear();
+		return;
 	}
 
-	lib_path.clear();
+	//The platform loader serializes closes itself, so they happen after
+	//releasing the loader mutex.
+	std::vector<void *> evicted;
+	{
+		RLL_TRACE_LOCK(loader_lock, detail::loader_mutex());
+		RLL_TRACE_LOCK(lock, lib_lock);
+
+		if(lib_handle != nullptr){
+			std::size_t size = 0;
+			#ifdef RLL_PLATFORM_IS_ELF
+			detail::elf_module module;
+			if(detail::elf_find_module(lib_handle, module)){
+				size = detail::elf_mapped_size(module);
+			}
+			#endif
+			//A namespaced handle must not be handed to a plain load.
+			if(park && !lib_namespaced){
+				detail::get_warm_pool().park(lib_path, lib_flags, lib_handle, size, evicted);
+			} else {
+				evicted.push_back(lib_handle);
+			}
+			lib_handle = nullptr;
+		}
+
+		lib_path.clear();
+		lib_report = load_report();
+		lib_address_index.reset();
+		lib_demangled.reset();
+		lib_symbols.clear();
+	}
+	for(void * handle : evicted){
+		dlclose(handle);
+	}
+}
+
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline unload_verification basic_shared_library<lock_policy, error_policy, cache_policy>::unload_and_verify(bool bypass_warm_pool){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return unload_verification();
+	}
+
+	#ifdef RLL_PLATFORM_IS_ELF
+	detail::elf_module module;
+	if(detail::elf_find_module(lib_handle, module)){
+		unload_verification result;
+		result.path = module.path;
+		const ElfW(Dyn) * dynamic = module.dynamic;
+		void * handle = lib_handle;
+		bool nodelete_flag = (detail::elf_dynamic_entry(module, DT_FLAGS_1) & DF_1_NODELETE) != 0;
+		bool nodelete_load = !lib_image && (lib_flags & RTLD_NODELETE) != 0;
+		bool unique_symbols = false;
+		detail::elf_for_each_defined_symbol(module, [&unique_symbols](const char *, std::uintptr_t, const ElfW(Sym)& symbol){
+			unique_symbols = unique_symbols || ELF64_ST_BIND(symbol.st_info) == STB_GNU_UNIQUE;
+		});
+
+		unload(!bypass_warm_pool);
+
+		detail::elf_module remaining;
+		std::vector<detail::elf_module> loaded = detail::elf_loaded_modules();
+		{
+			detail::elf_image_registry& images = detail::elf_images();
+			std::lock_guard<std::mutex> lock(images.mutex);
+			for(auto& image : images.modules){
+				loaded.push_back(image.second);
+			}
+		}
+		bool mapped = false;
+		for(auto& other : loaded){
+			if(other.dynamic == dynamic){
+				mapped = true;
+				remaining = other;
+			}
+		}
+		if(!mapped){
+			result.unmapped = true;
+			return result;
+		}
+
+		if(nodelete_flag){
+			result.blockers |= unload_blockers::NODELETE_FLAG;
+		}
+		if(nodelete_load){
+			result.blockers |= unload_blockers::NODELETE_LOAD;
+		}
+		if(unique_symbols){
+			result.blockers |= unload_blockers::UNIQUE_SYMBOLS;
+		}
+		if(detail::get_warm_pool().contains(handle)){
+			result.blockers |= unload_blockers::WARM_POOL;
+		}
+		for(auto& other : loaded){
+			if(other.dynamic == dynamic){
+				continue;
+			}
+			for(auto& needed : detail::elf_needed(other)){
+				if(detail::elf_module_matches(remaining, needed)){
+					result.dependents.push_back(other.path);
+					result.blockers |= unload_blockers::DEPENDENTS;
+					break;
+				}
+			}
+		}
+		if(result.blockers == 0){
+			result.blockers = unload_blockers::OTHER_REFERENCES;
+		}
+		return result;
+	}
+	#endif
+	//Still unloaded, it just can't be checked.
+	unload(!bypass_warm_pool);
+	error_policy::template raise<exception::not_supported>("shared_library::unload_and_verify() needs dl_iterate_phdr, the library was unloaded without verifying it.");
+	return unload_verification();
 }
 
+//Forgets the library without closing it, for shutting down without running its
+//finalizers.
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::leak(){
+	RLL_TRACE_LOCK(lock, lib_lock);
+	std::shared_ptr<detail::symbol_offset_cache> offsets = std::move(lib_offsets);
+	if(offsets){
+		offsets->save();
+	}
+	if(lib_indexed){
+		if constexpr(std::is_same<basic_shared_library, shared_library>::value){
+			symbol_index::global().remove(this);
+		}
+		lib_indexed = false;
+	}
+	if(lib_image){
+		new std::shared_ptr<detail::elf_image>(std::move(lib_image));
+	}
+	lib_handle = nullptr;
+	lib_path.clear();
+	lib_report = load_report();
+	lib_address_index.reset();
+	lib_demangled.reset();
+	lib_symbols.clear();
+}
 
-inline bool shared_library::is_loaded(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline bool basic_shared_library<lock_policy, error_policy, cache_policy>::is_loaded(){
 	return lib_handle != nullptr;
 }
 
 
-inline void * shared_library::get_symbol(const std::string& name){
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_symbol(const std::string& name){
+	//Held across the platform lookup so an unload can't close the handle,
+	//free the image or drop the offset cache under it.
+	RLL_TRACE_SHARED_LOCK(lock, lib_lock);
+	if constexpr(cache_policy::enabled){
+		#ifdef RLL_PLATFORM_IS_ELF
+		if(lib_offsets){
+			if(void * cached = lib_offsets->find(name)){
+				return cached;
+			}
+		}
+		#endif
+		if(!lib_symbols.empty()){
+			auto cached = lib_symbols.find(name);
+			if(cached != lib_symbols.end()){
+				return cached->second;
+			}
+		}
+	}
+
+	if(lib_image){
+		void * result = lib_image->get_symbol(name.c_str());
+		if(result == nullptr){
+			error_policy::template raise<exception::symbol_not_found>(name);
+			return nullptr;
+		}
+		if(lib_offsets){
+			lib_offsets->add(name, result);
+		}
+		if(startup_manifest * manifest = startup_manifest::get_recording()){
+			manifest->record_symbol(lib_handle, name);
+		}
+		return result;
+	}
 
 	if(lib_handle != nullptr){
+		RLL_TRACE_SCOPE("get_symbol miss", name);
 		void * result = dlsym(lib_handle, name.c_str());
 		char * error = dlerror();
 
 		if(error != nullptr){
 			if(std::strcmp(error, "") != 0){
-				throw exception::symbol_not_found(name);
+				error_policy::template raise<exception::symbol_not_found>(name);
+				return nullptr;
 			}
 		}
 		
+		if(lib_offsets && result != nullptr){
+			lib_offsets->add(name, result);
+		}
+		if(startup_manifest * manifest = startup_manifest::get_recording()){
+			manifest->record_symbol(lib_handle, name);
+		}
 		return result;
 	} else {
-		throw exception::library_not_loaded();
+		error_policy::template raise<exception::library_not_loaded>();
+		return nullptr;
 	}
 }
 
-inline void * shared_library::get_symbol_fast(const std::string& name) noexcept {
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_symbol_fast(const std::string& name) noexcept {
+	//Held across the platform lookup so an unload can't close the handle,
+	//free the image or drop the offset cache under it.
+	RLL_TRACE_SHARED_LOCK(lock, lib_lock);
+	if constexpr(cache_policy::enabled){
+		#ifdef RLL_PLATFORM_IS_ELF
+		if(lib_offsets){
+			if(void * cached = lib_offsets->find(name)){
+				return cached;
+			}
+		}
+		#endif
+		if(!lib_symbols.empty()){
+			auto cached = lib_symbols.find(name);
+			if(cached != lib_symbols.end()){
+				return cached->second;
+			}
+		}
+	}
 
-	if(lib_handle != nullptr){
-		return dlsym(lib_handle, name.c_str());
-	} else {
+	void * result = nullptr;
+	if(lib_image){
+		result = lib_image->get_symbol(name.c_str());
+	} else if(lib_handle != nullptr){
+		RLL_TRACE_SCOPE("get_symbol miss", name);
+		result = dlsym(lib_handle, name.c_str());
+	}
+	if(lib_offsets && result != nullptr){
+		detail::ignore_exceptions([&](){ lib_offsets->add(name, result); });
+	}
+	startup_manifest * manifest = startup_manifest::get_recording();
+	if(manifest != nullptr && result != nullptr){
+		detail::ignore_exceptions([&](){ manifest->record_symbol(lib_handle, name); });
+	}
+	return result;
+}
+
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_demangled_symbol(const std::string& signature){
+	std::shared_ptr<const std::unordered_map<std::string, void *>> index;
+	{
+		RLL_TRACE_LOCK(lock, lib_lock);
+		if(lib_handle == nullptr){
+			error_policy::template raise<exception::library_not_loaded>();
+			return nullptr;
+		}
+		#ifdef RLL_PLATFORM_IS_ELF
+		detail::elf_module module;
+		if(!lib_demangled && detail::elf_find_module(lib_handle, module)){
+			std::shared_ptr<std::unordered_map<std::string, void *>> built = std::make_shared<std::unordered_map<std::string, void *>>();
+			std::string build_id = detail::elf_build_id(module);
+			std::string directory = detail::demangle_cache_directory().get();
+			std::string cache_file;
+			if(!directory.empty() && !build_id.empty()){
+				cache_file = directory + "/" + build_id + ".demangled";
+			}
+
+			//A cached index only saves the demangling, the addresses are
+			//looked up again through the hash table.
+			std::vector<std::pair<std::string, std::string>> names;
+			if(!cache_file.empty() && detail::read_demangle_cache(cache_file, build_id, names)){
+				for(auto& name : names){
+					if(const ElfW(Sym) * symbol = detail::elf_lookup(module, name.second.c_str())){
+						built->emplace(name.first, reinterpret_cast<void *>(detail::elf_symbol_address(module, *symbol)));
+					}
+				}
+			} else {
+				std::vector<std::pair<std::string, void *>> exports;
+				detail::elf_exported_symbols(module, exports);
+				for(auto& symbol : exports){
+					std::string demangled = detail::demangle(symbol.first.c_str());
+					if(!demangled.empty() && built->emplace(demangled, symbol.second).second){
+						names.emplace_back(demangled, symbol.first);
+					}
+				}
+				if(!cache_file.empty()){
+					detail::write_demangle_cache(cache_file, build_id, names);
+				}
+			}
+			lib_demangled = built;
+		}
+		#endif
+		if(!lib_demangled){
+			error_policy::template raise<exception::not_supported>("shared_library::get_demangled_symbol() needs the ELF dynamic symbol table.");
+			return nullptr;
+		}
+		index = lib_demangled;
+	}
+
+	auto found = index->find(signature);
+	if(found == index->end()){
+		error_policy::template raise<exception::symbol_not_found>(signature);
 		return nullptr;
 	}
+	return found->second;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_demangle_cache_directory(const std::string& directory){
+	detail::demangle_cache_directory().set(directory);
 }
 
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_offset_cache_directory(const std::string& directory){
+	detail::offset_cache_directory().set(directory);
+}
 
-inline const std::string& shared_library::get_path(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_trusted_digests(const std::vector<std::string>& digests){
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	detail::get_integrity_cache().set_trusted(digests);
+	#else
+	(void) digests;
+	#endif
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_integrity_cache_file(const std::string& file){
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	detail::get_integrity_cache().set_file(file);
+	#else
+	(void) file;
+	#endif
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::string basic_shared_library<lock_policy, error_policy, cache_policy>::get_file_digest(const std::string& path){
+	#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+	detail::verified_file file;
+	file.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	std::string digest, error;
+	if(file.fd < 0){
+		error = path + ": " + std::strerror(errno);
+	} else if(detail::get_integrity_cache().digest(file.fd, digest, error)){
+		return digest;
+	}
+	error_policy::template raise<exception::library_loading_error>(error);
+	return "";
+	#else
+	(void) path;
+	error_policy::template raise<exception::not_supported>("shared_library::get_file_digest() needs /proc/self/fd.");
+	return "";
+	#endif
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline const std::string& basic_shared_library<lock_policy, error_policy, cache_policy>::get_path(){
 	return lib_path;
 }
 
-inline void * shared_library::get_platform_handle(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_platform_handle(){
 	return lib_handle;
 }
 
-inline std::string shared_library::get_platform_suffix(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline const load_report& basic_shared_library<lock_policy, error_policy, cache_policy>::get_load_report(){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+	}
+	return lib_report;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline library_memory_usage basic_shared_library<lock_policy, error_policy, cache_policy>::memory_usage(){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return library_memory_usage();
+	}
+
+	#ifdef RLL_PLATFORM_IS_ELF
+	detail::elf_module module;
+	std::vector<detail::smaps_entry> smaps;
+	if(detail::elf_find_module(lib_handle, module) && detail::elf_read_smaps(smaps)){
+		library_memory_usage usage = detail::elf_memory_usage(module, smaps);
+		usage.path = lib_path;
+		return usage;
+	}
+	#endif
+	error_policy::template raise<exception::not_supported>("shared_library::memory_usage() needs dl_iterate_phdr and /proc/self/smaps.");
+	return library_memory_usage();
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::vector<library_memory_usage> basic_shared_library<lock_policy, error_policy, cache_policy>::process_memory_usage(){
+	#ifdef RLL_PLATFORM_IS_ELF
+	std::vector<detail::smaps_entry> smaps;
+	if(detail::elf_read_smaps(smaps)){
+		std::vector<library_memory_usage> usages;
+		for(auto& module : detail::elf_loaded_modules()){
+			usages.push_back(detail::elf_memory_usage(module, smaps));
+		}
+		return usages;
+	}
+	#endif
+	error_policy::template raise<exception::not_supported>("shared_library::process_memory_usage() needs dl_iterate_phdr and /proc/self/smaps.");
+	return std::vector<library_memory_usage>();
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::shared_ptr<const address_index> basic_shared_library<lock_policy, error_policy, cache_policy>::get_address_index(bool demangle){
+	RLL_TRACE_LOCK(lock, lib_lock);
+
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return nullptr;
+	}
+	if(lib_address_index){
+		return lib_address_index;
+	}
+
+	#ifdef RLL_PLATFORM_IS_ELF
+	detail::elf_module module;
+	if(detail::elf_find_module(lib_handle, module)){
+		std::shared_ptr<address_index> index = std::make_shared<address_index>();
+		detail::elf_build_address_index(*index, module, demangle);
+		index->finish(lib_path);
+		lib_address_index = index;
+		return lib_address_index;
+	}
+	#else
+	(void) demangle;
+	#endif
+	error_policy::template raise<exception::not_supported>("shared_library::get_address_index() needs the ELF dynamic symbol table.");
+	return nullptr;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_warm_pool_limits(const warm_pool_limits& limits){
+	RLL_TRACE_LOCK(lock, detail::loader_mutex());
+	std::vector<void *> evicted;
+	detail::get_warm_pool().set_limits(limits, evicted);
+	for(void * handle : evicted){
+		dlclose(handle);
+	}
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::trim_warm_pool(){
+	RLL_TRACE_LOCK(lock, detail::loader_mutex());
+	std::vector<void *> evicted;
+	detail::get_warm_pool().trim(evicted);
+	for(void * handle : evicted){
+		dlclose(handle);
+	}
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::size_t basic_shared_library<lock_policy, error_policy, cache_policy>::warm_pool_size(){
+	return detail::get_warm_pool().size();
+}
+
+namespace detail {
+//The file a platform handle was loaded from and its build-id (if it has one).
+inline void describe_library(void * handle, std::string& resolved_path, std::string& build_id){
+	#ifdef RLL_PLATFORM_IS_ELF
+	elf_module module;
+	if(elf_find_module(handle, module)){
+		resolved_path = module.path;
+		build_id = elf_build_id(module);
+	}
+	#else
+	(void) handle;
+	(void) resolved_path;
+	(void) build_id;
+	#endif
+}
+
+inline std::string file_build_id(const std::string& path){
+	#ifdef RLL_PLATFORM_IS_ELF
+	return elf_file_build_id(path);
+	#else
+	(void) path;
+	return "";
+	#endif
+}
+
+//Asks the kernel to read a whole file into the page cache.
+inline void prefetch_file(const std::string& path){
+	#ifdef RLL_PLATFORM_IS_ELF
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd >= 0){
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+	#else
+	(void) path;
+	#endif
+}
+} //detail
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::string basic_shared_library<lock_policy, error_policy, cache_policy>::get_platform_suffix(){
 	#if defined(__APPLE__)
 		return ".dylib";
 	#elif defined(__CYGWIN__)
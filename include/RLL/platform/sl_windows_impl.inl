@@ -2,24 +2,45 @@
 // It is public domain:
 // Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
 
-inline std::mutex shared_library::_mutex;
-
-inline shared_library::shared_library(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline basic_shared_library<lock_policy, error_policy, cache_policy>::basic_shared_library(){
 	lib_handle = nullptr;
 }
 
-inline shared_library::~shared_library(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline basic_shared_library<lock_policy, error_policy, cache_policy>::~basic_shared_library(){
 	unload();
 }
 
-inline void shared_library::load(const std::string& path, int flags){
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline bool basic_shared_library<lock_policy, error_policy, cache_policy>::load(const std::string& path, int flags, unsigned int options){
+	RLL_TRACE_SCOPE("load", path);
+	if(options & rll_flags::VERIFY_INTEGRITY){
+		error_policy::template raise<exception::not_supported>("rll_flags::VERIFY_INTEGRITY needs /proc/self/fd.");
+		return false;
+	}
+	if(options & rll_flags::NEW_NAMESPACE){
+		error_policy::template raise<exception::not_supported>("rll_flags::NEW_NAMESPACE needs dlmopen.");
+		return false;
+	}
+	RLL_TRACE_LOCK(loader_lock, detail::loader_mutex());
+	RLL_TRACE_LOCK(lock, lib_lock);
 
 	if(lib_handle != nullptr){ 
-		throw exception::library_already_loaded(lib_path);
+		error_policy::template raise<exception::library_already_loaded>(lib_path);
+		return false;
 	}
 
-	lib_handle = LoadLibraryExA(path.c_str(), 0, flags);
+	std::vector<void *> evicted;
+	auto start = std::chrono::steady_clock::now();
+	lib_handle = detail::get_warm_pool().take(path, flags, evicted);
+	if(lib_handle == nullptr){
+		lib_handle = LoadLibraryExA(path.c_str(), 0, flags);
+	}
+	auto load_time = std::chrono::steady_clock::now() - start;
+	for(void * handle : evicted){
+		FreeLibrary((HMODULE) handle);
+	}
 	
 	if(!lib_handle){
 		DWORD error_code = GetLastError();
@@ -30,62 +51,267 @@ inline void shared_library::load(const std::string& path, int flags){
 			(LPSTR)&message_buffer, 0, nullptr);
 		std::string error_message(message_buffer, size);
 		LocalFree(message_buffer);
-		throw exception::library_loading_error(error_message);
+		error_policy::template raise<exception::library_loading_error>(error_message);
+		return false;
 	}
 
 	lib_path = path;
+	lib_flags = flags;
+	lib_symbols.clear();
+	if(cache_policy::enabled){
+		startup_manifest::get_resolved_symbols(lib_handle, lib_symbols);
+	}
+	if(startup_manifest * manifest = startup_manifest::get_recording()){
+		manifest->record_load(path, lib_handle, static_cast<unsigned int>(flags), options);
+	}
+	lib_report = load_report();
+	lib_report.path = path;
+	lib_report.load_time = std::chrono::duration_cast<std::chrono::nanoseconds>(load_time);
+	return true;
 }
 
-inline void shared_library::load(const std::string& path, loader_flags flags){
-	load(path, flags.get_windows_flags());
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::load(const std::string& path, loader_flags flags){
+	load(path, flags.get_windows_flags(), flags.get_rll_flags());
 }
 
-inline void shared_library::unload(){
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::unload(){
+	unload(true);
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::unload(bool park){
+	RLL_TRACE_SCOPE("unload", lib_path);
+	RLL_TRACE_LOCK(loader_lock, detail::loader_mutex());
+	RLL_TRACE_LOCK(lock, lib_lock);
 
 	if(lib_handle != nullptr){
-		FreeLibrary((HMODULE) lib_handle);
+		std::vector<void *> evicted;
+		if(park){
+			detail::get_warm_pool().park(lib_path, lib_flags, lib_handle, 0, evicted);
+		} else {
+			evicted.push_back(lib_handle);
+		}
+		for(void * handle : evicted){
+			FreeLibrary((HMODULE) handle);
+		}
 		lib_handle = nullptr;
 	}
 
 	lib_path.clear();
+	lib_report = load_report();
+	lib_address_index.reset();
+	lib_demangled.reset();
+	lib_symbols.clear();
 }
 
 
-inline bool shared_library::is_loaded(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline unload_verification basic_shared_library<lock_policy, error_policy, cache_policy>::unload_and_verify(bool bypass_warm_pool){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return unload_verification();
+	}
+	unload(!bypass_warm_pool);
+	error_policy::template raise<exception::not_supported>("shared_library::unload_and_verify() needs dl_iterate_phdr, the library was unloaded without verifying it.");
+	return unload_verification();
+}
+
+//Forgets the library without closing it, for shutting down without running its
+//finalizers.
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::leak(){
+	RLL_TRACE_LOCK(lock, lib_lock);
+	lib_handle = nullptr;
+	lib_path.clear();
+	lib_report = load_report();
+	lib_address_index.reset();
+	lib_demangled.reset();
+	lib_symbols.clear();
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline bool basic_shared_library<lock_policy, error_policy, cache_policy>::is_loaded(){
 	return lib_handle != nullptr;
 }
 
 
-inline void * shared_library::get_symbol(const std::string& name){
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_symbol(const std::string& name){
+	//Held across the platform lookup so an unload can't FreeLibrary() the
+	//handle under it.
+	RLL_TRACE_SHARED_LOCK(lock, lib_lock);
+	if constexpr(cache_policy::enabled){
+		if(!lib_symbols.empty()){
+			auto cached = lib_symbols.find(name);
+			if(cached != lib_symbols.end()){
+				return cached->second;
+			}
+		}
+	}
 
 	if(lib_handle != nullptr){
-		return reinterpret_cast<void *>(GetProcAddress((HMODULE) lib_handle, name.c_str()));
+		RLL_TRACE_SCOPE("get_symbol miss", name);
+		void * result = reinterpret_cast<void *>(GetProcAddress((HMODULE) lib_handle, name.c_str()));
+		if(result != nullptr){
+			if(startup_manifest * manifest = startup_manifest::get_recording()){
+				manifest->record_symbol(lib_handle, name);
+			}
+		}
+		return result;
 	} else {
-		throw exception::library_not_loaded();
+		error_policy::template raise<exception::library_not_loaded>();
+		return nullptr;
 	}
 }
 
-inline void * shared_library::get_symbol_fast(const std::string& name) noexcept {
-	std::lock_guard<std::mutex> lock(_mutex);
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_symbol_fast(const std::string& name) noexcept {
+	//Held across the platform lookup so an unload can't FreeLibrary() the
+	//handle under it.
+	RLL_TRACE_SHARED_LOCK(lock, lib_lock);
+	if constexpr(cache_policy::enabled){
+		if(!lib_symbols.empty()){
+			auto cached = lib_symbols.find(name);
+			if(cached != lib_symbols.end()){
+				return cached->second;
+			}
+		}
+	}
 
 	if(lib_handle != nullptr){
-		return reinterpret_cast<void *>(GetProcAddress((HMODULE) lib_handle, name.c_str()));
+		RLL_TRACE_SCOPE("get_symbol miss", name);
+		void * result = reinterpret_cast<void *>(GetProcAddress((HMODULE) lib_handle, name.c_str()));
+		startup_manifest * manifest = startup_manifest::get_recording();
+		if(manifest != nullptr && result != nullptr){
+			detail::ignore_exceptions([&](){ manifest->record_symbol(lib_handle, name); });
+		}
+		return result;
 	} else {
 		return nullptr;
 	}
 }
 
-inline const std::string& shared_library::get_path(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_demangled_symbol(const std::string&){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return nullptr;
+	}
+	error_policy::template raise<exception::not_supported>("shared_library::get_demangled_symbol() needs the ELF dynamic symbol table.");
+	return nullptr;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_demangle_cache_directory(const std::string& directory){
+	detail::demangle_cache_directory().set(directory);
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_offset_cache_directory(const std::string& directory){
+	detail::offset_cache_directory().set(directory);
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_trusted_digests(const std::vector<std::string>&){}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_integrity_cache_file(const std::string&){}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::string basic_shared_library<lock_policy, error_policy, cache_policy>::get_file_digest(const std::string&){
+	error_policy::template raise<exception::not_supported>("shared_library::get_file_digest() needs /proc/self/fd.");
+	return "";
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline const std::string& basic_shared_library<lock_policy, error_policy, cache_policy>::get_path(){
 	return lib_path;
 }
 
 
-inline void * shared_library::get_platform_handle(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void * basic_shared_library<lock_policy, error_policy, cache_policy>::get_platform_handle(){
 	return lib_handle;
 }
 
-inline std::string shared_library::get_platform_suffix(){
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline const load_report& basic_shared_library<lock_policy, error_policy, cache_policy>::get_load_report(){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+	}
+	return lib_report;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline library_memory_usage basic_shared_library<lock_policy, error_policy, cache_policy>::memory_usage(){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return library_memory_usage();
+	}
+	error_policy::template raise<exception::not_supported>("shared_library::memory_usage() isn't supported on Windows.");
+	return library_memory_usage();
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::vector<library_memory_usage> basic_shared_library<lock_policy, error_policy, cache_policy>::process_memory_usage(){
+	error_policy::template raise<exception::not_supported>("shared_library::process_memory_usage() isn't supported on Windows.");
+	return std::vector<library_memory_usage>();
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::shared_ptr<const address_index> basic_shared_library<lock_policy, error_policy, cache_policy>::get_address_index(bool){
+	if(lib_handle == nullptr){
+		error_policy::template raise<exception::library_not_loaded>();
+		return nullptr;
+	}
+	error_policy::template raise<exception::not_supported>("shared_library::get_address_index() isn't supported on Windows.");
+	return nullptr;
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::set_warm_pool_limits(const warm_pool_limits& limits){
+	RLL_TRACE_LOCK(lock, detail::loader_mutex());
+	std::vector<void *> evicted;
+	detail::get_warm_pool().set_limits(limits, evicted);
+	for(void * handle : evicted){
+		FreeLibrary((HMODULE) handle);
+	}
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline void basic_shared_library<lock_policy, error_policy, cache_policy>::trim_warm_pool(){
+	RLL_TRACE_LOCK(lock, detail::loader_mutex());
+	std::vector<void *> evicted;
+	detail::get_warm_pool().trim(evicted);
+	for(void * handle : evicted){
+		FreeLibrary((HMODULE) handle);
+	}
+}
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::size_t basic_shared_library<lock_policy, error_policy, cache_policy>::warm_pool_size(){
+	return detail::get_warm_pool().size();
+}
+
+namespace detail {
+inline void describe_library(void * handle, std::string& resolved_path, std::string&){
+	char buffer[MAX_PATH];
+	DWORD size = GetModuleFileNameA((HMODULE) handle, buffer, MAX_PATH);
+	if(size > 0 && size < MAX_PATH){
+		resolved_path.assign(buffer, size);
+	}
+}
+
+inline std::string file_build_id(const std::string&){
+	return "";
+}
+
+inline void prefetch_file(const std::string&){}
+} //detail
+
+template<typename lock_policy, typename error_policy, typename cache_policy>
+inline std::string basic_shared_library<lock_policy, error_policy, cache_policy>::get_platform_suffix(){
 	return ".dll";
 }
@@ -0,0 +1,862 @@
+// This is RLL. A Runtime Library Loader.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//--------------------------------HEADER_GUARD--------------------------------//
+#ifndef RLL_PLUGIN_HOST_HPP_
+#define RLL_PLUGIN_HOST_HPP_
+//----------------------------------INCLUDES----------------------------------//
+#include "RLL.hpp"
+
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <unistd.h>
+#include <climits>
+#include <ctime>
+//-------------------------------PLUGIN_HOST----------------------------------//
+namespace rll {
+
+namespace exception {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If the process hosting a remote library died or couldn't be started
+/// this exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(plugin_host_error, std::string, message, return message.c_str();)
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If a remote function threw an exception inside the host this
+/// exception is thrown with its message.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(remote_call_error, std::string, message, return message.c_str();)
+} //exception
+
+namespace detail {
+
+//The call channel lives in a MAP_SHARED memory file that both processes map.
+//It is a bounded multi-producer ring (one slot per in-flight call) drained in
+//order by the single host thread. Each slot's sequence number moves through:
+//  ticket       free, owned by the producer that claims `ticket`
+//  ticket + 1   request published, owned by the host
+//  ticket + 2   response published, owned by the producer again
+//  ticket + N   released, free for the next lap
+//Waiting spins briefly and then sleeps on the sequence word with a futex.
+constexpr std::uint32_t channel_slot_count = 64;
+constexpr std::size_t channel_payload_size = 256;
+
+enum channel_status : std::uint32_t {
+	CHANNEL_OK,
+	CHANNEL_EXCEPTION
+};
+
+//The invoker reads the arguments from the payload and writes the result over
+//them. Host and client are the same program image (the host is forked), so
+//a function pointer means the same thing in both.
+using channel_invoker = void (*)(void * function, unsigned char * payload);
+
+struct alignas(64) channel_slot {
+	std::atomic<std::uint32_t> sequence;
+	std::atomic<std::uint32_t> waiters;
+	channel_invoker invoker;
+	void * function;
+	std::uint32_t status;
+	alignas(16) unsigned char payload[channel_payload_size];
+};
+
+struct channel {
+	alignas(64) std::atomic<std::uint32_t> head;
+	alignas(64) std::uint32_t tail;
+	channel_slot slots[channel_slot_count];
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "The call channel needs address-free 32-bit atomics.");
+
+inline void futex_wait(std::atomic<std::uint32_t>& word, std::uint32_t value, const struct timespec * timeout){
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, value, timeout, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<std::uint32_t>& word){
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+inline void channel_publish(channel_slot& slot, std::uint32_t sequence){
+	slot.sequence.store(sequence);
+	if(slot.waiters.load() != 0){
+		futex_wake(slot.sequence);
+	}
+}
+
+//Waits until `done` accepts the slot's sequence number. `alive` is polled
+//between sleeps; returns false if it reports that the other side is gone.
+template<typename done_type, typename alive_type>
+inline bool channel_wait_until(channel_slot& slot, done_type done, alive_type alive){
+	for(int spin = 0; spin < 2000; spin++){
+		if(done(slot.sequence.load(std::memory_order_acquire))){
+			return true;
+		}
+	}
+
+	const struct timespec timeout { 0, 50 * 1000 * 1000 };
+	slot.waiters.fetch_add(1);
+	for(;;){
+		std::uint32_t current = slot.sequence.load();
+		if(done(current)){
+			break;
+		}
+		futex_wait(slot.sequence, current, &timeout);
+		if(!done(slot.sequence.load()) && !alive()){
+			slot.waiters.fetch_sub(1);
+			return false;
+		}
+	}
+	slot.waiters.fetch_sub(1);
+	return true;
+}
+
+//Waits until the slot reaches `sequence`.
+template<typename alive_type>
+inline bool channel_wait(channel_slot& slot, std::uint32_t sequence, alive_type alive){
+	return channel_wait_until(slot, [sequence](std::uint32_t current){ return current == sequence; }, alive);
+}
+
+//Waits until the slot moves on from `sequence`, to whatever value.
+template<typename alive_type>
+inline bool channel_wait_change(channel_slot& slot, std::uint32_t sequence, alive_type alive){
+	return channel_wait_until(slot, [sequence](std::uint32_t current){ return current != sequence; }, alive);
+}
+
+template<typename... argument_types>
+struct remote_arguments_are_valid : std::true_type {};
+
+template<typename first_type, typename... argument_types>
+struct remote_arguments_are_valid<first_type, argument_types...> : std::integral_constant<bool,
+	std::is_trivially_copyable<typename std::decay<first_type>::type>::value &&
+	!std::is_pointer<typename std::decay<first_type>::type>::value &&
+	remote_arguments_are_valid<argument_types...>::value> {};
+
+template<typename return_type, typename... argument_types>
+struct remote_invoker {
+	using arguments = std::tuple<typename std::decay<argument_types>::type...>;
+
+	template<std::size_t... indices>
+	static return_type call(void * function, arguments& values, std::index_sequence<indices...>){
+		return reinterpret_cast<return_type (*)(argument_types...)>(function)(std::get<indices>(values)...);
+	}
+
+	static void invoke(void * function, unsigned char * payload){
+		arguments values;
+		std::memcpy(static_cast<void *>(&values), payload, sizeof(arguments));
+		invoke_into(function, values, payload, std::is_void<return_type>());
+	}
+
+	static void invoke_into(void * function, arguments& values, unsigned char *, std::true_type){
+		call(function, values, std::index_sequence_for<argument_types...>());
+	}
+
+	static void invoke_into(void * function, arguments& values, unsigned char * payload, std::false_type){
+		return_type result = call(function, values, std::index_sequence_for<argument_types...>());
+		std::memcpy(payload, &result, sizeof(return_type));
+	}
+};
+
+//The process hosts are forked from once `start_launcher` ran, and how long a
+//host gets to report whether it loaded its library.
+struct plugin_launcher {
+	std::mutex mutex;
+	int socket = -1;
+	std::atomic<long long> start_timeout { 10000 };
+};
+
+inline plugin_launcher& get_plugin_launcher(){
+	static plugin_launcher launcher;
+	return launcher;
+}
+
+inline bool write_report(int fd, const std::string& error){
+	std::uint32_t size = static_cast<std::uint32_t>(error.size());
+	std::string message(reinterpret_cast<const char *>(&size), sizeof(size));
+	message += error;
+	const char * data = message.data();
+	std::size_t left = message.size();
+	while(left != 0){
+		ssize_t written = write(fd, data, left);
+		if(written < 0 && errno == EINTR){
+			continue;
+		}
+		if(written <= 0){
+			return false;
+		}
+		data += written;
+		left -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+enum report_status {
+	REPORT_RECEIVED,
+	REPORT_TIMED_OUT,
+	REPORT_MISSING
+};
+
+//Reads a host's report, giving up once `timeout` milliseconds have passed.
+inline report_status read_report(int fd, std::string& error, long long timeout){
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	std::string message;
+	std::size_t expected = sizeof(std::uint32_t);
+	while(message.size() < expected){
+		long long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		struct pollfd waiting { fd, POLLIN, 0 };
+		int ready = poll(&waiting, 1, static_cast<int>(std::max(0LL, std::min(left, static_cast<long long>(INT_MAX)))));
+		if(ready < 0 && errno == EINTR){
+			continue;
+		}
+		if(ready == 0){
+			return REPORT_TIMED_OUT;
+		}
+		char buffer[256];
+		ssize_t size = ready < 0 ? -1 : read(fd, buffer, std::min(sizeof(buffer), expected - message.size()));
+		if(size < 0 && errno == EINTR){
+			continue;
+		}
+		if(size <= 0){
+			return REPORT_MISSING;
+		}
+		message.append(buffer, static_cast<std::size_t>(size));
+		if(message.size() == sizeof(std::uint32_t)){
+			std::uint32_t length;
+			std::memcpy(&length, message.data(), sizeof(length));
+			expected += length;
+		}
+	}
+	error = message.substr(sizeof(std::uint32_t));
+	return REPORT_RECEIVED;
+}
+
+//Sends `data` along with the descriptors in `fds`.
+inline bool send_with_fds(int socket, const void * data, std::size_t size, const int * fds, std::size_t count){
+	struct iovec vector { const_cast<void *>(data), size };
+	alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)] = {};
+	struct msghdr message {};
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+	struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+	std::memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+	ssize_t sent;
+	do {
+		sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+	} while(sent < 0 && errno == EINTR);
+	return sent == static_cast<ssize_t>(size);
+}
+
+//Receives a message sent with `send_with_fds`. Returns the message size, or -1
+//if the socket failed, closed, or `count` descriptors didn't come along.
+inline ssize_t receive_with_fds(int socket, void * data, std::size_t size, int * fds, std::size_t count){
+	struct iovec vector { data, size };
+	alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 2)];
+	struct msghdr message {};
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+	ssize_t received;
+	do {
+		received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+	} while(received < 0 && errno == EINTR);
+	if(received <= 0){
+		return -1;
+	}
+	struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+	std::size_t got = 0;
+	if(header != nullptr && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS){
+		got = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		std::memcpy(fds, CMSG_DATA(header), sizeof(int) * std::min(got, count));
+	}
+	if(got != count){
+		for(std::size_t i = 0; i < std::min(got, count); i++){
+			close(fds[i]);
+		}
+		return -1;
+	}
+	return received;
+}
+
+} //detail
+
+template<typename signature>
+class remote_function;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A shared library that is loaded and run in a separate host process.
+///
+/// @details `load` forks a host process that loads the library with a
+/// `shared_library` and then serves calls from a lock-free ring in shared
+/// memory, sleeping on futexes when idle. A crash inside the library only
+/// takes down the host; calls then throw `plugin_host_error` instead of
+/// bringing down the caller. A host that doesn't report whether it loaded the
+/// library within the start timeout (`set_start_timeout`) is killed.
+///
+/// Any number of threads can call at once. Calls are served one at a time, in
+/// order, by the host.
+///
+/// Only functions whose arguments and return value are trivially copyable and
+/// aren't pointers can be called, since the host can't see the caller's
+/// memory. Arguments and results are limited to 256 bytes.
+///
+/// @warning The host is forked without `exec`, so only the forking thread
+/// exists in it. If another thread held a lock the host needs (in `malloc`, the
+/// dynamic loader or RLL) at the time, the host deadlocks and `load` fails
+/// after the start timeout. Call `start_launcher` while the program is still
+/// single threaded (e.g. first thing in `main`) to fork every host from a
+/// clean, single threaded launcher instead. Hosts started by the launcher only
+/// know the code that was loaded when it started, so call remote functions from
+/// that code.
+///
+/// ```cpp
+/// rll::remote_library plugin;
+/// plugin.load("./untrusted.so");
+/// std::function<int(int, int)> add = plugin.get_function_symbol<int(int, int)>("add");
+/// add(2, 2); //Runs in the host process.
+/// ```
+////////////////////////////////////////////////////////////////////////////////
+class remote_library {
+	private:
+		remote_library(const remote_library&);
+		remote_library& operator=(const remote_library&);
+		//
+		std::string lib_path;
+		pid_t host_pid;
+		//The host's end of the report pipe stays open until it exits.
+		int host_report;
+		bool host_is_child;
+		detail::channel * lib_channel;
+		std::atomic<bool> host_dead;
+		//
+		//Past `deadline` the host counts as gone.
+		void call(detail::channel_invoker invoker, void * function, unsigned char * payload, std::size_t in_size, std::size_t out_size,
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+		[[noreturn]] static void run_host(const std::string& path, loader_flags flags, detail::channel * channel, int report, pid_t parent);
+		[[noreturn]] static void launch_hosts(int socket);
+		static void serve(detail::channel * channel, shared_library& library, pid_t parent);
+	public:
+		remote_library() : host_pid(-1), host_report(-1), host_is_child(false), lib_channel(nullptr), host_dead(false){}
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Stops the host process.
+		////////////////////////////////////////////////////////////////////////////////
+		virtual ~remote_library(){ unload(); }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Starts a host process and loads a shared library into it.
+		///
+		/// @param path The path to the shared library.
+		/// @param flags The flags that are used by the host's platform backend.
+		///
+		/// @throw rll::exception::library_loading_error
+		/// @throw rll::exception::library_already_loaded
+		/// @throw rll::exception::plugin_host_error
+		////////////////////////////////////////////////////////////////////////////////
+		void load(const std::string& path, loader_flags flags = loader_flags());
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Fork the launcher that every later host is forked from.
+		///
+		/// @details Call it while the program is single threaded, from the
+		/// thread that stays alive the longest (the launcher and its hosts are
+		/// killed when that thread exits). Does nothing if it already ran.
+		///
+		/// @throw rll::exception::plugin_host_error
+		////////////////////////////////////////////////////////////////////////////////
+		static void start_launcher();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Set how long a host gets to load its library, and to exit
+		/// when it is unloaded. 10 seconds by default.
+		////////////////////////////////////////////////////////////////////////////////
+		static void set_start_timeout(std::chrono::milliseconds timeout){ detail::get_plugin_launcher().start_timeout.store(timeout.count()); }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Stops the host process, if there is one.
+		///
+		/// @details A host that hasn't exited within the start timeout (it may
+		/// be stuck in a call) is killed.
+		////////////////////////////////////////////////////////////////////////////////
+		void unload();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Returns whether a host has been started for a library.
+		////////////////////////////////////////////////////////////////////////////////
+		bool is_loaded(){ return lib_channel != nullptr; }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Returns whether the host process is still running.
+		////////////////////////////////////////////////////////////////////////////////
+		bool is_alive();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the process id of the host, or -1.
+		////////////////////////////////////////////////////////////////////////////////
+		pid_t get_host_pid(){ return host_pid; }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the path of the library the host loaded.
+		////////////////////////////////////////////////////////////////////////////////
+		const std::string& get_path(){ return lib_path; }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Returns whether the library in the host has a symbol.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::plugin_host_error
+		////////////////////////////////////////////////////////////////////////////////
+		bool has_symbol(const std::string& name){ return get_remote_address(name) != nullptr; }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get the address of a symbol in the host's address space.
+		///
+		/// @details Only meaningful as an argument to `remote_function`.
+		///
+		/// @return void * The address, or a null pointer if it wasn't found.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::plugin_host_error
+		////////////////////////////////////////////////////////////////////////////////
+		void * get_remote_address(const std::string& name);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Attempts to get a function that calls a symbol in the host.
+		///
+		/// @tparam signature The function signature.
+		/// @param name The name of the symbol.
+		/// @return remote_function<signature> The remote function.
+		///
+		/// @throw rll::exception::library_not_loaded
+		/// @throw rll::exception::symbol_not_found
+		/// @throw rll::exception::plugin_host_error
+		////////////////////////////////////////////////////////////////////////////////
+		template<typename signature>
+		remote_function<signature> get_remote_function(const std::string& name){
+			void * address = get_remote_address(name);
+			if(address == nullptr){
+				throw exception::symbol_not_found(name);
+			}
+			return remote_function<signature>(*this, address);
+		}
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Attempts to get a std::function that calls a symbol in the host.
+		///
+		/// @see get_remote_function
+		////////////////////////////////////////////////////////////////////////////////
+		template<typename signature>
+		std::function<signature> get_function_symbol(const std::string& name){
+			return get_remote_function<signature>(name);
+		}
+
+		template<typename signature>
+		friend class remote_function;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A typed function that is called inside a `remote_library`'s host.
+///
+/// @tparam return_type The function's return type.
+/// @tparam argument_types The function's parameter types.
+////////////////////////////////////////////////////////////////////////////////
+template<typename return_type, typename... argument_types>
+class remote_function<return_type(argument_types...)> {
+	private:
+		using invoker = detail::remote_invoker<return_type, argument_types...>;
+		using arguments = typename invoker::arguments;
+		using result = typename std::conditional<std::is_void<return_type>::value, char, return_type>::type;
+
+		static_assert(detail::remote_arguments_are_valid<argument_types...>::value,
+			"Remote function arguments must be trivially copyable and not pointers.");
+		static_assert(std::is_void<return_type>::value || (std::is_trivially_copyable<result>::value && !std::is_pointer<result>::value),
+			"Remote function results must be trivially copyable and not pointers.");
+		static_assert(sizeof(arguments) <= detail::channel_payload_size && sizeof(result) <= detail::channel_payload_size,
+			"Remote function arguments and results are limited to the channel payload size.");
+
+		remote_library * library;
+		void * function;
+	public:
+		remote_function(remote_library& library, void * function) : library(&library), function(function){}
+
+		return_type operator()(argument_types... values) const {
+			alignas(16) unsigned char payload[detail::channel_payload_size];
+			arguments packed(values...);
+			std::memcpy(payload, static_cast<const void *>(&packed), sizeof(arguments));
+			library->call(&invoker::invoke, function, payload, sizeof(arguments), std::is_void<return_type>::value ? 0 : sizeof(result));
+			return unpack(payload, std::is_void<return_type>());
+		}
+	private:
+		static void unpack(unsigned char *, std::true_type){}
+		static return_type unpack(unsigned char * payload, std::false_type){
+			result value;
+			std::memcpy(static_cast<void *>(&value), payload, sizeof(result));
+			return value;
+		}
+};
+
+//---------------------------PLUGIN_HOST_DEFINITIONS--------------------------//
+inline void remote_library::load(const std::string& path, loader_flags flags){
+	if(lib_channel != nullptr){
+		throw exception::library_already_loaded(lib_path);
+	}
+
+	//The channel is a memory file so that a host forked by the launcher can map it too.
+	int memory_fd = memfd_create("rll:plugin-channel", MFD_CLOEXEC);
+	if(memory_fd < 0 || ftruncate(memory_fd, sizeof(detail::channel)) != 0){
+		std::string error = std::strerror(errno);
+		if(memory_fd >= 0){
+			close(memory_fd);
+		}
+		throw exception::plugin_host_error("Couldn't create the call channel: " + error);
+	}
+	void * memory = mmap(nullptr, sizeof(detail::channel), PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+	if(memory == MAP_FAILED){
+		close(memory_fd);
+		throw exception::plugin_host_error(std::string("Couldn't map the call channel: ") + std::strerror(errno));
+	}
+	detail::channel * channel = new (memory) detail::channel();
+	for(std::uint32_t i = 0; i < detail::channel_slot_count; i++){
+		channel->slots[i].sequence.store(i);
+	}
+
+	//The host reports whether loading worked through a pipe.
+	int report[2];
+	if(pipe2(report, O_CLOEXEC) != 0){
+		close(memory_fd);
+		munmap(memory, sizeof(detail::channel));
+		throw exception::plugin_host_error(std::string("Couldn't create a pipe: ") + std::strerror(errno));
+	}
+
+	pid_t pid = -1;
+	bool is_child = false;
+	std::string start_error;
+	detail::plugin_launcher& launcher = detail::get_plugin_launcher();
+	{
+		std::lock_guard<std::mutex> lock(launcher.mutex);
+		if(launcher.socket >= 0){
+			std::string request(reinterpret_cast<const char *>(&flags), sizeof(flags));
+			request += path;
+			int fds[2] = { memory_fd, report[1] };
+			int error = 0;
+			if(!detail::send_with_fds(launcher.socket, request.data(), request.size(), fds, 2)
+				|| recv(launcher.socket, &pid, sizeof(pid), 0) != sizeof(pid)
+				|| recv(launcher.socket, &error, sizeof(error), 0) != sizeof(error)){
+				pid = -1;
+				start_error = "Couldn't reach the plugin host launcher.";
+			} else if(pid < 0){
+				start_error = std::string("Couldn't fork the plugin host: ") + std::strerror(error);
+			}
+		} else {
+			pid_t parent = getpid();
+			pid = fork();
+			if(pid == 0){
+				close(report[0]);
+				run_host(path, flags, channel, report[1], parent);
+			}
+			is_child = true;
+			if(pid < 0){
+				start_error = std::string("Couldn't fork the plugin host: ") + std::strerror(errno);
+			}
+		}
+	}
+	close(memory_fd);
+	close(report[1]);
+	if(pid < 0){
+		close(report[0]);
+		munmap(memory, sizeof(detail::channel));
+		throw exception::plugin_host_error(start_error);
+	}
+
+	std::string error;
+	detail::report_status status = detail::read_report(report[0], error, launcher.start_timeout.load());
+	if(status != detail::REPORT_RECEIVED || !error.empty()){
+		close(report[0]);
+		if(status == detail::REPORT_TIMED_OUT){
+			kill(pid, SIGKILL);
+		}
+		if(is_child){
+			waitpid(pid, nullptr, 0);
+		}
+		munmap(memory, sizeof(detail::channel));
+		if(status == detail::REPORT_TIMED_OUT){
+			throw exception::plugin_host_error("The plugin host for " + path + " didn't start in time and was killed.");
+		}
+		if(status == detail::REPORT_MISSING){
+			throw exception::plugin_host_error("The plugin host for " + path + " exited while loading it.");
+		}
+		throw exception::library_loading_error(error);
+	}
+
+	lib_path = path;
+	host_pid = pid;
+	host_report = report[0];
+	host_is_child = is_child;
+	lib_channel = channel;
+	host_dead.store(false);
+}
+
+inline void remote_library::run_host(const std::string& path, loader_flags flags, detail::channel * channel, int report, pid_t parent){
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if(getppid() != parent){
+		_exit(1);
+	}
+	std::string error;
+	shared_library library;
+	if(channel == nullptr){
+		error = "The plugin host couldn't map the call channel.";
+	} else {
+		try {
+			library.load(path, flags);
+		} catch(exception::rll_exception& e){
+			error = e.what();
+			if(error.empty()){
+				error = " ";
+			}
+		}
+	}
+	//The pipe stays open while serving, the caller sees it close when the host exits.
+	if(detail::write_report(report, error) && error.empty()){
+		serve(channel, library, parent);
+	}
+	_exit(0);
+}
+
+inline void remote_library::start_launcher(){
+	detail::plugin_launcher& launcher = detail::get_plugin_launcher();
+	std::lock_guard<std::mutex> lock(launcher.mutex);
+	if(launcher.socket >= 0){
+		return;
+	}
+	int sockets[2];
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0){
+		throw exception::plugin_host_error(std::string("Couldn't create the launcher socket: ") + std::strerror(errno));
+	}
+	pid_t parent = getpid();
+	pid_t pid = fork();
+	if(pid == 0){
+		close(sockets[0]);
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		if(getppid() != parent){
+			_exit(1);
+		}
+		launch_hosts(sockets[1]);
+	}
+	close(sockets[1]);
+	if(pid < 0){
+		close(sockets[0]);
+		throw exception::plugin_host_error(std::string("Couldn't fork the plugin host launcher: ") + std::strerror(errno));
+	}
+	launcher.socket = sockets[0];
+}
+
+inline void remote_library::launch_hosts(int socket){
+	//Nobody waits for the hosts here, the kernel reaps them.
+	signal(SIGCHLD, SIG_IGN);
+	pid_t self = getpid();
+	for(;;){
+		char request[sizeof(loader_flags) + PATH_MAX];
+		int fds[2];
+		ssize_t size = detail::receive_with_fds(socket, request, sizeof(request), fds, 2);
+		if(size < static_cast<ssize_t>(sizeof(loader_flags))){
+			//The caller is gone.
+			_exit(0);
+		}
+		static_assert(std::is_trivially_copyable<loader_flags>::value, "The loader flags are sent as bytes.");
+		loader_flags flags;
+		std::memcpy(static_cast<void *>(&flags), request, sizeof(flags));
+		std::string path(request + sizeof(flags), static_cast<std::size_t>(size) - sizeof(flags));
+
+		pid_t pid = fork();
+		if(pid == 0){
+			close(socket);
+			signal(SIGCHLD, SIG_DFL);
+			void * memory = mmap(nullptr, sizeof(detail::channel), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+			close(fds[0]);
+			run_host(path, flags, memory == MAP_FAILED ? nullptr : static_cast<detail::channel *>(memory), fds[1], self);
+		}
+		int error = pid < 0 ? errno : 0;
+		close(fds[0]);
+		close(fds[1]);
+		if(send(socket, &pid, sizeof(pid), MSG_NOSIGNAL) != sizeof(pid) || send(socket, &error, sizeof(error), MSG_NOSIGNAL) != sizeof(error)){
+			_exit(0);
+		}
+	}
+}
+
+inline void remote_library::serve(detail::channel * channel, shared_library& library, pid_t parent){
+	auto parent_alive = [parent](){ return getppid() == parent; };
+
+	for(;;){
+		std::uint32_t ticket = channel->tail;
+		detail::channel_slot& slot = channel->slots[ticket % detail::channel_slot_count];
+		if(!detail::channel_wait(slot, ticket + 1, parent_alive)){
+			return;
+		}
+
+		bool shutdown = false;
+		if(slot.invoker == nullptr){
+			//Without an invoker it is either a symbol lookup or, with a
+			//non-null function, a shutdown request.
+			shutdown = slot.function != nullptr;
+			if(!shutdown){
+				void * address = library.get_symbol_fast(reinterpret_cast<const char *>(slot.payload));
+				std::memcpy(slot.payload, &address, sizeof(address));
+			}
+			slot.status = detail::CHANNEL_OK;
+		} else {
+			try {
+				slot.invoker(slot.function, slot.payload);
+				slot.status = detail::CHANNEL_OK;
+			} catch(std::exception& e){
+				slot.status = detail::CHANNEL_EXCEPTION;
+				std::strncpy(reinterpret_cast<char *>(slot.payload), e.what(), detail::channel_payload_size - 1);
+				slot.payload[detail::channel_payload_size - 1] = '\0';
+			} catch(...){
+				slot.status = detail::CHANNEL_EXCEPTION;
+				std::strcpy(reinterpret_cast<char *>(slot.payload), "Unknown exception.");
+			}
+		}
+
+		channel->tail = ticket + 1;
+		detail::channel_publish(slot, ticket + 2);
+		if(shutdown){
+			return;
+		}
+	}
+}
+
+inline void remote_library::call(detail::channel_invoker invoker, void * function, unsigned char * payload, std::size_t in_size, std::size_t out_size,
+	std::chrono::steady_clock::time_point deadline){
+	if(lib_channel == nullptr){
+		throw exception::library_not_loaded();
+	}
+	if(host_dead.load(std::memory_order_relaxed)){
+		throw exception::plugin_host_error("The plugin host for " + lib_path + " has exited.");
+	}
+	auto alive = [this, deadline](){ return is_alive() && std::chrono::steady_clock::now() < deadline; };
+
+	//Claim a ticket once its slot has been released by the previous lap.
+	std::uint32_t ticket = lib_channel->head.load(std::memory_order_relaxed);
+	detail::channel_slot * slot;
+	for(;;){
+		slot = &lib_channel->slots[ticket % detail::channel_slot_count];
+		std::uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+		std::int32_t difference = static_cast<std::int32_t>(sequence - ticket);
+		if(difference == 0){
+			if(lib_channel->head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed)){
+				break;
+			}
+		} else if(difference < 0){
+			//The previous lap still owns the slot. Another producer can claim
+			//`ticket` and move the slot past it before this one looks again, so
+			//wait for any change and start over from `head`.
+			if(!detail::channel_wait_change(*slot, sequence, alive)){
+				throw exception::plugin_host_error("The plugin host for " + lib_path + " has exited.");
+			}
+			ticket = lib_channel->head.load(std::memory_order_relaxed);
+		} else {
+			ticket = lib_channel->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->invoker = invoker;
+	slot->function = function;
+	std::memcpy(slot->payload, payload, in_size);
+	detail::channel_publish(*slot, ticket + 1);
+
+	if(!detail::channel_wait(*slot, ticket + 2, alive)){
+		throw exception::plugin_host_error("The plugin host for " + lib_path + " has exited.");
+	}
+	std::uint32_t status = slot->status;
+	if(status == detail::CHANNEL_EXCEPTION){
+		//The host is untrusted, the message may not be terminated.
+		const char * text = reinterpret_cast<const char *>(slot->payload);
+		std::string message(text, strnlen(text, detail::channel_payload_size));
+		detail::channel_publish(*slot, ticket + detail::channel_slot_count);
+		throw exception::remote_call_error(message);
+	}
+	std::memcpy(payload, slot->payload, out_size);
+	detail::channel_publish(*slot, ticket + detail::channel_slot_count);
+}
+
+inline void * remote_library::get_remote_address(const std::string& name){
+	alignas(16) unsigned char payload[detail::channel_payload_size];
+	if(name.size() >= sizeof(payload)){
+		throw exception::symbol_not_found(name);
+	}
+	std::memcpy(payload, name.c_str(), name.size() + 1);
+	call(nullptr, nullptr, payload, name.size() + 1, sizeof(void *));
+	void * address;
+	std::memcpy(&address, payload, sizeof(address));
+	return address;
+}
+
+inline bool remote_library::is_alive(){
+	if(host_pid <= 0 || host_dead.load()){
+		return false;
+	}
+	//The host isn't necessarily a child (see `start_launcher`), so its end of
+	//the report pipe closing is what tells that it exited.
+	struct pollfd waiting { host_report, POLLIN, 0 };
+	int ready = poll(&waiting, 1, 0);
+	if(ready == 0 || (ready < 0 && errno == EINTR)){
+		return true;
+	}
+	if(!host_dead.exchange(true) && host_is_child){
+		waitpid(host_pid, nullptr, 0);
+	}
+	return false;
+}
+
+inline void remote_library::unload(){
+	if(lib_channel == nullptr){
+		return;
+	}
+	if(is_alive()){
+		//A host stuck in a call or on its way out gets the start timeout to
+		//exit, then it is killed.
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(detail::get_plugin_launcher().start_timeout.load());
+		alignas(16) unsigned char payload[detail::channel_payload_size];
+		try {
+			call(nullptr, reinterpret_cast<void *>(1), payload, 0, 0, deadline);
+		} catch(exception::plugin_host_error&){}
+		struct pollfd waiting { host_report, POLLIN, 0 };
+		for(;;){
+			long long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			int ready = poll(&waiting, 1, static_cast<int>(std::max(0LL, std::min(left, static_cast<long long>(INT_MAX)))));
+			if(ready < 0 && errno == EINTR){
+				continue;
+			}
+			if(ready == 0){
+				kill(host_pid, SIGKILL);
+				while(poll(&waiting, 1, -1) < 0 && errno == EINTR){}
+			}
+			break;
+		}
+		is_alive();
+	}
+
+	close(host_report);
+	munmap(lib_channel, sizeof(detail::channel));
+	lib_channel = nullptr;
+	host_pid = -1;
+	host_report = -1;
+	lib_path.clear();
+}
+
+} //rll
+//-----------------------------------END_IF-----------------------------------//
+#endif //RLL_PLUGIN_HOST_HPP_
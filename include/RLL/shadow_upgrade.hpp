@@ -0,0 +1,409 @@
+// This is RLL. A Runtime Library Loader.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//--------------------------------HEADER_GUARD--------------------------------//
+#ifndef RLL_SHADOW_UPGRADE_HPP_
+#define RLL_SHADOW_UPGRADE_HPP_
+//----------------------------------INCLUDES----------------------------------//
+#include "RLL.hpp"
+
+#include <limits>
+//------------------------------SHADOW_UPGRADE--------------------------------//
+namespace rll {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief How a candidate version compared to the current one.
+////////////////////////////////////////////////////////////////////////////////
+struct shadow_verdict {
+    std::string current;
+    std::string candidate;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Whether the candidate was judged. If not, it is still sampling.
+    ////////////////////////////////////////////////////////////////////////////////
+    bool decided = false;
+    bool promoted = false;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The number of calls that ran on both versions.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t samples = 0;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The latencies at the compared percentile.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::chrono::nanoseconds current_latency{0};
+    std::chrono::nanoseconds candidate_latency{0};
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief `candidate_latency / current_latency`.
+    ////////////////////////////////////////////////////////////////////////////////
+    double slowdown = 0;
+
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Describe the verdict in one line of text.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::string describe() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief When calls are mirrored to a candidate and when it is good enough.
+////////////////////////////////////////////////////////////////////////////////
+struct shadow_options {
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The fraction of calls that also run on the candidate, 0 to 1.
+    ////////////////////////////////////////////////////////////////////////////////
+    double sample_rate = 0.01;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The mirrored calls needed before the candidate is judged.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::size_t min_samples = 1000;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief The latency percentile that is compared, 0 to 100.
+    ////////////////////////////////////////////////////////////////////////////////
+    double percentile = 99;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief How much slower the candidate may be at that percentile: 1.05
+    /// allows 5%. The histograms are only accurate to ~6%, so values close to
+    /// 1 mostly promote candidates that land in the same bucket.
+    ////////////////////////////////////////////////////////////////////////////////
+    double max_slowdown = 1.05;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Judge the candidate in the call that takes the last sample it
+    /// needs. Otherwise only `evaluate()` judges it.
+    ////////////////////////////////////////////////////////////////////////////////
+    bool automatic = true;
+    ////////////////////////////////////////////////////////////////////////////////
+    /// @brief Called with every verdict, from the thread that reached it.
+    ////////////////////////////////////////////////////////////////////////////////
+    std::function<void(const shadow_verdict&)> on_verdict;
+};
+
+namespace detail {
+//A per-thread xorshift, so sampling doesn't share any state between threads.
+inline bool shadow_sample(double rate) noexcept {
+    thread_local std::uint64_t state = 0x9E3779B97F4A7C15ull ^ reinterpret_cast<std::uintptr_t>(&state);
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<double>(state >> 11) * (1.0 / 9007199254740992.0) < rate;
+}
+
+inline std::size_t shadow_thread_shard(std::size_t shard_count) noexcept {
+    static std::atomic<std::size_t> next_shard{0};
+    thread_local std::size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed);
+    return shard % shard_count;
+}
+} //detail
+
+template<typename signature>
+class shadow_upgrade;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A function symbol whose library can be upgraded to a new build
+/// once the new build has shown it isn't slower.
+///
+/// @details `stage` loads a candidate build into its own link-map namespace
+/// (`rll_flags::NEW_NAMESPACE`), so it runs next to the current build without
+/// sharing any of its state, even if it is the same file. From then on a
+/// sample of the calls also runs the candidate with the same arguments, and
+/// both versions' latencies on those calls are recorded. Which version runs
+/// first alternates, so neither always finds the caches warmed by the other.
+/// Once enough calls were sampled the candidate is judged: if it is within
+/// `max_slowdown` of the current version at the compared percentile it
+/// replaces it, otherwise it is unloaded.
+///
+/// Calls never block: they announce themselves on per-thread sharded counters
+/// (like `symbol_index`) and the version they started on stays loaded until
+/// they return. Promotion switches every new call over at once.
+///
+/// Mirrored calls run on the calling thread and their results are dropped,
+/// so the entry point must be safe to call twice with the same arguments.
+/// It also must not throw: exceptions can't cross link-map namespaces.
+///
+/// ```cpp
+/// rll::shadow_options options;
+/// options.on_verdict = [](const rll::shadow_verdict& verdict){ log(verdict.describe()); };
+/// rll::shadow_upgrade<int(const request *)> handle("plugin.so", "handle", options);
+/// handle.stage("plugin-2.so");
+/// int status = handle(&next_request); //Served by plugin.so until plugin-2.so is promoted.
+/// ```
+///
+/// @tparam return_type The function's return type.
+/// @tparam argument_types The function's parameter types.
+////////////////////////////////////////////////////////////////////////////////
+template<typename return_type, typename... argument_types>
+class shadow_upgrade<return_type(argument_types...)> {
+    public:
+        using function_type = return_type(*)(argument_types...);
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Loads the current version and binds the entry point.
+        ///
+        /// @param path The library.
+        /// @param name The entry point's (mangled) name.
+        /// @param options When calls are mirrored and when candidates pass.
+        /// @param flags The loader flags of this and of the candidates, which
+        /// also get `NEW_NAMESPACE` (so not `LOAD_GLOBAL`).
+        ///
+        /// @throw rll::exception::library_loading_error
+        /// @throw rll::exception::symbol_not_found
+        ////////////////////////////////////////////////////////////////////////////////
+        shadow_upgrade(const std::string& path, const std::string& name, shadow_options options = shadow_options(), loader_flags flags = loader_flags())
+            : name(name), options(std::move(options)), flags(flags), current_slot(open(path, name, flags)), current(current_slot.get()){}
+        shadow_upgrade(const shadow_upgrade&) = delete;
+        shadow_upgrade& operator=(const shadow_upgrade&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Calls the current version, and sometimes the candidate.
+        ////////////////////////////////////////////////////////////////////////////////
+        return_type operator()(argument_types... arguments){
+            //Declared before the guard so it runs after the guard is gone:
+            //judging waits for the calls in flight.
+            judge_on_exit judge{this, 0};
+            read_guard guard(*this);
+            version_slot * active = current.load();
+            version_slot * shadow = candidate.load();
+            if(shadow == nullptr || !detail::shadow_sample(options.sample_rate)){
+                return active->function(std::forward<argument_types>(arguments)...);
+            }
+
+            std::size_t sample = sampled.fetch_add(1, std::memory_order_relaxed);
+            if(options.automatic && sample + 1 == options.min_samples){
+                judge.generation = shadow->generation;
+            }
+            if(sample & 1){
+                {
+                    call_timer timer{candidate_latency};
+                    shadow->function(arguments...);
+                }
+                call_timer timer{current_latency};
+                return active->function(arguments...);
+            }
+            auto mirror = [&](){
+                call_timer timer{candidate_latency};
+                shadow->function(arguments...);
+            };
+            //Destroyed in reverse: the current call is timed, then mirrored.
+            run_on_exit<decltype(mirror)> after{mirror};
+            call_timer timer{current_latency};
+            return active->function(arguments...);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Loads a candidate version and starts mirroring calls to it.
+        ///
+        /// @details A candidate that is already staged is discarded first,
+        /// and the samples start over.
+        ///
+        /// @throw rll::exception::library_loading_error
+        /// @throw rll::exception::symbol_not_found
+        /// @throw rll::exception::not_supported
+        ////////////////////////////////////////////////////////////////////////////////
+        void stage(const std::string& path){
+            loader_flags candidate_flags = flags;
+            candidate_flags.add_flag(rll_flags::NEW_NAMESPACE);
+            std::unique_ptr<version_slot> staged = open(path, name, candidate_flags);
+
+            std::lock_guard<std::mutex> lock(writer);
+            retire(candidate_slot, nullptr);
+            current_latency.reset();
+            candidate_latency.reset();
+            sampled.store(0, std::memory_order_relaxed);
+            staged->generation = ++generations;
+            candidate_slot = std::move(staged);
+            candidate.store(candidate_slot.get());
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Judges the candidate, promoting or discarding it.
+        ///
+        /// @param force Judge it even if it has fewer than `min_samples`
+        /// samples. A candidate without any samples is discarded.
+        /// @return shadow_verdict The verdict. Not `decided` if there is no
+        /// candidate or it needs more samples.
+        ////////////////////////////////////////////////////////////////////////////////
+        shadow_verdict evaluate(bool force = false){ return decide(force, 0); }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Unloads the candidate without judging it.
+        ////////////////////////////////////////////////////////////////////////////////
+        void discard(){
+            std::lock_guard<std::mutex> lock(writer);
+            retire(candidate_slot, nullptr);
+        }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the latest verdict without judging anything.
+        ////////////////////////////////////////////////////////////////////////////////
+        shadow_verdict progress(){
+            std::lock_guard<std::mutex> lock(writer);
+            if(!candidate_slot){
+                return last;
+            }
+            return compare();
+        }
+
+        bool has_candidate() const noexcept { return candidate.load() != nullptr; }
+
+        ////////////////////////////////////////////////////////////////////////////////
+        /// @brief Get the path of the version that serves the calls.
+        ////////////////////////////////////////////////////////////////////////////////
+        std::string current_path(){
+            std::lock_guard<std::mutex> lock(writer);
+            return current_slot->library->get_path();
+        }
+    private:
+        static constexpr std::size_t shard_count = 16;
+
+        struct version_slot {
+            std::unique_ptr<shared_library> library;
+            function_type function;
+            std::size_t generation = 0;
+        };
+        struct alignas(64) read_indicator {
+            std::atomic<std::size_t> readers{0};
+        };
+        //Marks the calling thread as calling one of the versions while alive.
+        class read_guard {
+            public:
+                read_guard(shadow_upgrade& upgrade) noexcept
+                    : indicator(upgrade.indicators[upgrade.version.load() & 1][detail::shadow_thread_shard(shard_count)].readers) {
+                    indicator.fetch_add(1);
+                }
+                ~read_guard(){ indicator.fetch_sub(1, std::memory_order_release); }
+            private:
+                std::atomic<std::size_t>& indicator;
+        };
+        struct call_timer {
+            latency_histogram& histogram;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ~call_timer(){ histogram.record(std::chrono::steady_clock::now() - start); }
+        };
+        template<typename action_type>
+        struct run_on_exit {
+            action_type& action;
+            ~run_on_exit(){ action(); }
+        };
+        //Judges the candidate the call sampled last, unless it was replaced.
+        struct judge_on_exit {
+            shadow_upgrade * upgrade;
+            std::size_t generation;
+            ~judge_on_exit(){
+                if(generation != 0){
+                    try {
+                        upgrade->decide(true, generation);
+                    } catch(...){
+                    }
+                }
+            }
+        };
+
+        std::string name;
+        shadow_options options;
+        loader_flags flags;
+        std::unique_ptr<version_slot> current_slot;
+        std::unique_ptr<version_slot> candidate_slot;
+        std::atomic<version_slot *> current;
+        std::atomic<version_slot *> candidate{nullptr};
+        std::atomic<unsigned int> version{0};
+        std::array<std::array<read_indicator, shard_count>, 2> indicators;
+        latency_histogram current_latency;
+        latency_histogram candidate_latency;
+        std::atomic<std::size_t> sampled{0};
+        std::size_t generations = 0;
+        std::mutex writer;
+        shadow_verdict last;
+
+        static std::unique_ptr<version_slot> open(const std::string& path, const std::string& name, loader_flags flags){
+            std::unique_ptr<version_slot> slot(new version_slot());
+            slot->library.reset(new shared_library());
+            slot->library->load(path, flags);
+            slot->function = reinterpret_cast<function_type>(slot->library->get_symbol(name));
+            return slot;
+        }
+
+        //Judges the candidate if it is of `generation` (0 for any).
+        shadow_verdict decide(bool force, std::size_t generation){
+            shadow_verdict verdict;
+            {
+                std::lock_guard<std::mutex> lock(writer);
+                if(!candidate_slot || (generation != 0 && candidate_slot->generation != generation)){
+                    verdict.current = current_slot->library->get_path();
+                    return verdict;
+                }
+                verdict = compare();
+                if(verdict.samples < options.min_samples && !force){
+                    return verdict;
+                }
+                verdict.decided = true;
+                verdict.promoted = verdict.samples != 0 && verdict.slowdown <= options.max_slowdown;
+                if(verdict.promoted){
+                    std::unique_ptr<version_slot> promoted = std::move(candidate_slot);
+                    candidate.store(nullptr);
+                    retire(current_slot, promoted.get());
+                    current_slot = std::move(promoted);
+                } else {
+                    retire(candidate_slot, nullptr);
+                }
+                last = verdict;
+            }
+            if(options.on_verdict){
+                options.on_verdict(verdict);
+            }
+            return verdict;
+        }
+
+        shadow_verdict compare() const {
+            shadow_verdict verdict;
+            verdict.current = current_slot->library->get_path();
+            verdict.candidate = candidate_slot->library->get_path();
+            latency_histogram::snapshot before = current_latency.merge();
+            latency_histogram::snapshot after = candidate_latency.merge();
+            verdict.samples = static_cast<std::size_t>(std::min(before.count, after.count));
+            verdict.current_latency = before.percentile(options.percentile);
+            verdict.candidate_latency = after.percentile(options.percentile);
+            if(verdict.current_latency.count() != 0){
+                verdict.slowdown = static_cast<double>(verdict.candidate_latency.count()) / verdict.current_latency.count();
+            } else {
+                verdict.slowdown = verdict.candidate_latency.count() == 0 ? 1 : std::numeric_limits<double>::infinity();
+            }
+            return verdict;
+        }
+
+        //Swaps `slot` out for `replacement` (which stays owned by the caller),
+        //waits for the calls that may still be using it, then unloads it.
+        void retire(std::unique_ptr<version_slot>& slot, version_slot * replacement){
+            if(!slot){
+                return;
+            }
+            if(slot.get() == current.load()){
+                current.store(replacement);
+            } else {
+                candidate.store(replacement);
+            }
+
+            auto drain = [this](unsigned int which){
+                for(auto& shard : indicators[which]){
+                    while(shard.readers.load(std::memory_order_acquire) != 0){
+                        std::this_thread::yield();
+                    }
+                }
+            };
+            unsigned int old_version = version.load() & 1;
+            drain(old_version ^ 1);
+            version.store(old_version ^ 1);
+            drain(old_version);
+            slot.reset();
+        }
+};
+
+inline std::string shadow_verdict::describe() const {
+    char latencies[128];
+    std::snprintf(latencies, sizeof(latencies), "%lldns vs %lldns (%.2fx) over %zu samples",
+        static_cast<long long>(candidate_latency.count()), static_cast<long long>(current_latency.count()), slowdown, samples);
+    if(!decided){
+        return candidate.empty() ? current + ": no candidate" : candidate + ": sampling, " + latencies;
+    }
+    return candidate + (promoted ? ": promoted over " : ": discarded in favour of ") + current + ", " + latencies;
+}
+
+} //rll
+//-----------------------------------END_IF-----------------------------------//
+#endif //RLL_SHADOW_UPGRADE_HPP_
@@ -0,0 +1,400 @@
+// This is RLL. A Runtime Library Loader.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//--------------------------------HEADER_GUARD--------------------------------//
+#ifndef RLL_ZYGOTE_HPP_
+#define RLL_ZYGOTE_HPP_
+//----------------------------------INCLUDES----------------------------------//
+#include "RLL.hpp"
+
+#include <cerrno>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+//---------------------------------ZYGOTE-------------------------------------//
+namespace rll {
+
+namespace exception {
+////////////////////////////////////////////////////////////////////////////////
+/// @brief If the zygote couldn't create its socket, fork, or be reached this
+/// exception is thrown.
+////////////////////////////////////////////////////////////////////////////////
+RLL_DEFINE_EXCEPTION_W_METADATA(zygote_error, std::string, message, return message.c_str();)
+} //exception
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief A process that loads a set of plugins once and forks ready workers.
+///
+/// @details Declare the plugins with `add_library`, load and bind them all with
+/// `preload`, and then fork workers either directly (`fork_worker`) or on
+/// request over a Unix socket (`start`/`serve` with `request_worker`). Workers
+/// inherit the mapped and relocated libraries copy-on-write, so they start
+/// without loading anything.
+///
+/// Libraries are loaded with `LOAD_NOW` by default so that all the lazy
+/// binding is done once in the zygote instead of in every worker.
+///
+/// ```cpp
+/// rll::zygote plugins;
+/// plugins.add_library("./filter.so");
+/// plugins.preload();
+/// plugins.start("/tmp/plugins.sock", [](rll::zygote& z, int connection){
+///     auto process = z.get_library("./filter.so").get_function_symbol<int()>("process");
+///     return process();
+/// });
+///
+/// //Anywhere, even in another process:
+/// int connection = rll::zygote::request_worker("/tmp/plugins.sock");
+/// ```
+////////////////////////////////////////////////////////////////////////////////
+class zygote {
+	public:
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief What a worker runs. It gets the zygote (for its libraries) and
+		/// its end of the requester's connection (-1 for `fork_worker`). The
+		/// return value is the worker's exit status.
+		////////////////////////////////////////////////////////////////////////////////
+		using worker_main = std::function<int(zygote&, int)>;
+	private:
+		zygote(const zygote&);
+		zygote& operator=(const zygote&);
+		//
+		struct declared_library {
+			std::string path;
+			loader_flags flags;
+			std::unique_ptr<shared_library> library;
+		};
+		std::vector<declared_library> libraries;
+		pid_t server_pid;
+		int listener;
+		//
+		void run_worker(const worker_main& main, int connection);
+		void listen_on(const std::string& socket_path);
+	public:
+		zygote() : server_pid(-1), listener(-1){}
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Stops the server process if one was started.
+		////////////////////////////////////////////////////////////////////////////////
+		virtual ~zygote(){ stop(); }
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Declare a library to preload.
+		///
+		/// @param path The path to the shared library.
+		/// @param flags The loader flags, `LOAD_NOW` by default.
+		////////////////////////////////////////////////////////////////////////////////
+		void add_library(const std::string& path, loader_flags flags = loader_flags({ unix_flags::LOAD_NOW }, {}));
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Load every declared library that isn't loaded yet.
+		///
+		/// @throw rll::exception::library_loading_error
+		////////////////////////////////////////////////////////////////////////////////
+		void preload();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Get a preloaded library by the path it was declared with.
+		///
+		/// @throw rll::exception::library_not_loaded If it wasn't declared or
+		/// hasn't been preloaded.
+		////////////////////////////////////////////////////////////////////////////////
+		shared_library& get_library(const std::string& path);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Fork a worker from the calling process.
+		///
+		/// @param main What the worker runs. Its return value is the exit status.
+		/// @return pid_t The worker's process id. Reap it with `waitpid`.
+		///
+		/// @throw rll::exception::zygote_error
+		////////////////////////////////////////////////////////////////////////////////
+		pid_t fork_worker(const worker_main& main);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Serve worker requests on a Unix socket in the calling process.
+		///
+		/// @details Every connection gets a freshly forked worker that owns the
+		/// connection. It only returns if the socket fails. The workers it forked
+		/// are reaped while serving, other children of the process aren't.
+		///
+		/// @param socket_path The filesystem path of the socket. An existing
+		/// file there is replaced.
+		/// @param main What each worker runs.
+		///
+		/// @throw rll::exception::zygote_error
+		////////////////////////////////////////////////////////////////////////////////
+		void serve(const std::string& socket_path, const worker_main& main);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Fork a server process that runs `serve`.
+		///
+		/// @details The socket is listening by the time this returns.
+		///
+		/// @return pid_t The server's process id.
+		///
+		/// @throw rll::exception::zygote_error
+		////////////////////////////////////////////////////////////////////////////////
+		pid_t start(const std::string& socket_path, const worker_main& main);
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Stop the server process started by `start`, if any.
+		////////////////////////////////////////////////////////////////////////////////
+		void stop();
+
+		////////////////////////////////////////////////////////////////////////////////
+		/// @brief Ask a zygote for a worker.
+		///
+		/// @param socket_path The zygote's socket.
+		/// @param worker_pid Set to the worker's process id if not null.
+		/// @return int The connection to the worker. Close it when done.
+		///
+		/// @throw rll::exception::zygote_error
+		////////////////////////////////////////////////////////////////////////////////
+		static int request_worker(const std::string& socket_path, pid_t * worker_pid = nullptr);
+};
+
+//------------------------------ZYGOTE_DEFINITIONS----------------------------//
+namespace detail {
+inline bool make_unix_address(const std::string& path, struct sockaddr_un& address){
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if(path.size() >= sizeof(address.sun_path)){
+		return false;
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return true;
+}
+
+inline bool write_all(int fd, const void * data, std::size_t size){
+	const char * bytes = static_cast<const char *>(data);
+	while(size > 0){
+		ssize_t written = write(fd, bytes, size);
+		if(written < 0 && errno == EINTR){
+			continue;
+		}
+		if(written <= 0){
+			return false;
+		}
+		bytes += written;
+		size -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+inline bool read_all(int fd, void * data, std::size_t size){
+	char * bytes = static_cast<char *>(data);
+	while(size > 0){
+		ssize_t got = read(fd, bytes, size);
+		if(got < 0 && errno == EINTR){
+			continue;
+		}
+		if(got <= 0){
+			return false;
+		}
+		bytes += got;
+		size -= static_cast<std::size_t>(got);
+	}
+	return true;
+}
+} //detail
+
+inline void zygote::add_library(const std::string& path, loader_flags flags){
+	declared_library declared;
+	declared.path = path;
+	declared.flags = flags;
+	libraries.push_back(std::move(declared));
+}
+
+inline void zygote::preload(){
+	for(auto& declared : libraries){
+		if(!declared.library){
+			std::unique_ptr<shared_library> library(new shared_library());
+			library->load(declared.path, declared.flags);
+			declared.library = std::move(library);
+		}
+	}
+}
+
+inline shared_library& zygote::get_library(const std::string& path){
+	for(auto& declared : libraries){
+		if(declared.path == path && declared.library){
+			return *declared.library;
+		}
+	}
+	throw exception::library_not_loaded();
+}
+
+inline void zygote::run_worker(const worker_main& main, int connection){
+	int status = 1;
+	try {
+		status = main(*this, connection);
+	} catch(...){}
+	if(connection >= 0){
+		close(connection);
+	}
+	//Skip the zygote's destructors and exit handlers, they belong to the zygote.
+	_exit(status);
+}
+
+inline pid_t zygote::fork_worker(const worker_main& main){
+	pid_t pid = fork();
+	if(pid == 0){
+		run_worker(main, -1);
+	}
+	if(pid < 0){
+		throw exception::zygote_error(std::string("Couldn't fork a worker: ") + std::strerror(errno));
+	}
+	return pid;
+}
+
+inline void zygote::listen_on(const std::string& socket_path){
+	struct sockaddr_un address;
+	if(!detail::make_unix_address(socket_path, address)){
+		throw exception::zygote_error("The socket path is too long: " + socket_path);
+	}
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(socket_path.c_str());
+	if(listener < 0
+		|| bind(listener, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0
+		|| listen(listener, 128) != 0){
+		std::string error = std::strerror(errno);
+		if(listener >= 0){
+			close(listener);
+			listener = -1;
+		}
+		throw exception::zygote_error("Couldn't listen on " + socket_path + ": " + error);
+	}
+}
+
+inline void zygote::serve(const std::string& socket_path, const worker_main& main){
+	if(listener < 0){
+		listen_on(socket_path);
+	}
+
+	//Only the workers forked here are reaped. Other children (`fork_worker`'s,
+	//a `remote_library`'s host) belong to whoever waits for them.
+	std::vector<pid_t> workers;
+	for(;;){
+		workers.erase(std::remove_if(workers.begin(), workers.end(), [](pid_t worker){
+			return waitpid(worker, nullptr, WNOHANG) != 0;
+		}), workers.end());
+
+		struct pollfd waiting { listener, POLLIN, 0 };
+		int ready = poll(&waiting, 1, 100);
+		if(ready < 0 && errno != EINTR){
+			break;
+		}
+		if(ready <= 0){
+			continue;
+		}
+
+		int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if(connection < 0){
+			if(errno == EINTR || errno == ECONNABORTED){
+				continue;
+			}
+			break;
+		}
+
+		pid_t pid = fork();
+		if(pid == 0){
+			close(listener);
+			pid_t self = getpid();
+			if(!detail::write_all(connection, &self, sizeof(self))){
+				_exit(1);
+			}
+			run_worker(main, connection);
+		}
+		if(pid < 0){
+			pid_t failed = -1;
+			detail::write_all(connection, &failed, sizeof(failed));
+		} else {
+			workers.push_back(pid);
+		}
+		close(connection);
+	}
+
+	std::string error = std::strerror(errno);
+	close(listener);
+	listener = -1;
+	throw exception::zygote_error("The zygote socket failed: " + error);
+}
+
+inline pid_t zygote::start(const std::string& socket_path, const worker_main& main){
+	if(server_pid > 0){
+		throw exception::zygote_error("The zygote server is already running.");
+	}
+
+	//Listen before forking so that requests can be made as soon as this returns.
+	int ready[2];
+	if(pipe(ready) != 0){
+		throw exception::zygote_error(std::string("Couldn't create a pipe: ") + std::strerror(errno));
+	}
+	pid_t pid = fork();
+	if(pid == 0){
+		close(ready[0]);
+		try {
+			listen_on(socket_path);
+			char ok = 1;
+			detail::write_all(ready[1], &ok, 1);
+			close(ready[1]);
+			serve(socket_path, main);
+		} catch(...){}
+		_exit(1);
+	}
+	close(ready[1]);
+	if(pid < 0){
+		close(ready[0]);
+		throw exception::zygote_error(std::string("Couldn't fork the zygote server: ") + std::strerror(errno));
+	}
+
+	char ok = 0;
+	bool listening = detail::read_all(ready[0], &ok, 1);
+	close(ready[0]);
+	if(!listening){
+		waitpid(pid, nullptr, 0);
+		throw exception::zygote_error("The zygote server couldn't listen on " + socket_path);
+	}
+	server_pid = pid;
+	return pid;
+}
+
+inline void zygote::stop(){
+	if(server_pid > 0){
+		kill(server_pid, SIGTERM);
+		waitpid(server_pid, nullptr, 0);
+		server_pid = -1;
+	}
+}
+
+inline int zygote::request_worker(const std::string& socket_path, pid_t * worker_pid){
+	struct sockaddr_un address;
+	if(!detail::make_unix_address(socket_path, address)){
+		throw exception::zygote_error("The socket path is too long: " + socket_path);
+	}
+	int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(connection < 0 || connect(connection, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0){
+		std::string error = std::strerror(errno);
+		if(connection >= 0){
+			close(connection);
+		}
+		throw exception::zygote_error("Couldn't connect to the zygote at " + socket_path + ": " + error);
+	}
+
+	pid_t pid = -1;
+	if(!detail::read_all(connection, &pid, sizeof(pid)) || pid <= 0){
+		close(connection);
+		throw exception::zygote_error("The zygote at " + socket_path + " couldn't fork a worker.");
+	}
+	if(worker_pid != nullptr){
+		*worker_pid = pid;
+	}
+	return connection;
+}
+
+} //rll
+//-----------------------------------END_IF-----------------------------------//
+#endif //RLL_ZYGOTE_HPP_
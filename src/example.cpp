@@ -1,40 +1,407 @@
 #include <RLL/RLL.hpp>
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <cstring>
 
-void use_example_lib(std::string path);
+//rll-inspect: loads a library over and over and reports what that costs.
+
+struct inspect_options {
+    std::string path;
+    std::size_t iterations = 20;
+    std::size_t lookups = 1000;
+    std::vector<std::string> symbols;
+    bool json = false;
+    std::string call;
+};
+
+struct mode_result {
+    std::string mode;
+    rll::latency_histogram::snapshot load;
+    rll::latency_histogram::snapshot unload;
+    std::chrono::nanoseconds first_load{0};
+};
+
+struct lookup_result {
+    std::string name;
+    bool found = false;
+    std::chrono::nanoseconds first{0};
+    std::chrono::nanoseconds locked{0};
+    std::chrono::nanoseconds unlocked{0};
+};
+
+struct inspect_result {
+    std::vector<mode_result> modes;
+    rll::load_report report;
+    bool have_memory = false;
+    rll::library_memory_usage memory;
+    bool have_symbols = false;
+    std::size_t exported_symbols = 0;
+    std::vector<lookup_result> lookups;
+    bool have_verification = false;
+    rll::unload_verification verification;
+};
+
+//Both libraries look symbols up with dlsym (nothing fills `lib`'s symbol cache
+//here), so the columns show what the default policies' locking costs.
+using unlocked_library = rll::basic_shared_library<rll::lock_policies::no_lock, rll::error_policies::throw_errors, rll::cache_policies::no_cache>;
+
+bool parse_arguments(int argc, char const * argv[], inspect_options& options);
+mode_result measure_mode(const inspect_options& options, const std::string& name, rll::unix_flag flag);
+lookup_result measure_lookup(const inspect_options& options, rll::shared_library& lib, unlocked_library& raw, const std::string& name);
+inspect_result inspect(const inspect_options& options);
+void print_table(const inspect_options& options, const inspect_result& result);
+void print_json(const inspect_options& options, const inspect_result& result);
 void print_help();
 
 int main(int argc, char const * argv[]){
-    if(argc != 2){
-        std::cout << "Invalid number of arguments.\n\n";
-        print_help();
+    inspect_options options;
+    if(!parse_arguments(argc, argv, options)){
         return 1;
     }
 
-    if(strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0){
-        print_help();
-        return 1;
-    } 
+    try {
+        inspect_result result = inspect(options);
+        if(options.json){
+            print_json(options, result);
+        } else {
+            print_table(options, result);
+        }
 
-    use_example_lib(argv[1]);
+        if(!options.call.empty()){
+            rll::shared_library lib;
+            lib.load(options.path);
+            ((void (*)())lib.get_symbol(options.call))(); //Ignore this wizardry...
+        }
+    } catch(std::exception& e){
+        std::cerr << "rll-inspect: " << e.what() << "\n";
+        return 1;
+    }
 
     return 0;
 }
 
 void print_help(){
-    std::cout << "Usage: ./example <path-to-library>\n";
-    std::cout << "The library must be a *shared* library compiled for the same system.\n";
-    std::cout << "It must have a void function \"example_func\" that takes no arguments and is wrapped in extern \"C\" if it is a C++ library.";
-    std::cout << "This program will run that function (not safely) if that symbol exists. It's nice for Hello World libraries or the sort.\n";
+    std::cout << "Usage: ./rll-inspect [options] <path-to-library>\n";
+    std::cout << "Loads a *shared* library compiled for the same system over and over and reports\n";
+    std::cout << "what loading it costs.\n\n";
+    std::cout << "Options:\n";
+    std::cout << "  -n, --iterations <count>  Load/unload cycles per mode (default 20).\n";
+    std::cout << "  -s, --symbols <a,b,...>   Symbols to time the lookup of. Can be repeated.\n";
+    std::cout << "      --lookups <count>     Lookups per symbol to average over (default 1000).\n";
+    std::cout << "      --json                Print JSON instead of a table.\n";
+    std::cout << "      --call <symbol>       Afterwards, call a void function that takes no arguments\n";
+    std::cout << "                            (wrapped in extern \"C\" if it is a C++ library). Not safely.\n";
+    std::cout << "  -h, --help                Print this.\n";
+}
+
+bool parse_count(const char * text, std::size_t& out){
+    char * end = nullptr;
+    unsigned long long value = std::strtoull(text, &end, 10);
+    if(end == text || *end != '\0' || value == 0){
+        return false;
+    }
+    out = static_cast<std::size_t>(value);
+    return true;
+}
+
+bool parse_arguments(int argc, char const * argv[], inspect_options& options){
+    for(int i = 1; i < argc; i++){
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if(argument == "-h" || argument == "--help"){
+            print_help();
+            return false;
+        } else if(argument == "--json"){
+            options.json = true;
+        } else if((argument == "-n" || argument == "--iterations") && has_value){
+            if(!parse_count(argv[++i], options.iterations)){
+                std::cout << "Invalid iteration count: " << argv[i] << "\n\n";
+                print_help();
+                return false;
+            }
+        } else if(argument == "--lookups" && has_value){
+            if(!parse_count(argv[++i], options.lookups)){
+                std::cout << "Invalid lookup count: " << argv[i] << "\n\n";
+                print_help();
+                return false;
+            }
+        } else if((argument == "-s" || argument == "--symbols") && has_value){
+            std::stringstream list(argv[++i]);
+            std::string name;
+            while(std::getline(list, name, ',')){
+                if(!name.empty()){
+                    options.symbols.push_back(name);
+                }
+            }
+        } else if(argument == "--call" && has_value){
+            options.call = argv[++i];
+        } else if(argument.size() > 1 && argument[0] == '-'){
+            std::cout << "Invalid argument: " << argument << "\n\n";
+            print_help();
+            return false;
+        } else if(options.path.empty()){
+            options.path = argument;
+        } else {
+            std::cout << "Invalid number of arguments.\n\n";
+            print_help();
+            return false;
+        }
+    }
+    if(options.path.empty()){
+        std::cout << "Invalid number of arguments.\n\n";
+        print_help();
+        return false;
+    }
+    return true;
+}
+
+mode_result measure_mode(const inspect_options& options, const std::string& name, rll::unix_flag flag){
+    mode_result result;
+    result.mode = name;
+    rll::latency_histogram load;
+    rll::latency_histogram unload;
+
+    for(std::size_t i = 0; i < options.iterations; i++){
+        rll::shared_library lib;
+        auto start = std::chrono::steady_clock::now();
+        lib.load(options.path, rll::loader_flags({ flag }, {}));
+        auto loaded = std::chrono::steady_clock::now();
+        load.record(loaded - start);
+        if(i == 0){
+            result.first_load = loaded - start;
+        }
+
+        start = std::chrono::steady_clock::now();
+        lib.unload();
+        unload.record(std::chrono::steady_clock::now() - start);
+    }
+
+    result.load = load.merge();
+    result.unload = unload.merge();
+    return result;
 }
 
-void use_example_lib(std::string path){
+lookup_result measure_lookup(const inspect_options& options, rll::shared_library& lib, unlocked_library& raw, const std::string& name){
+    lookup_result result;
+    result.name = name;
+
+    auto start = std::chrono::steady_clock::now();
+    void * symbol = lib.get_symbol_fast(name);
+    result.first = std::chrono::steady_clock::now() - start;
+    result.found = symbol != nullptr;
+
+    //Kept so the optimizer can't drop the lookups.
+    void * volatile sink = nullptr;
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < options.lookups; i++){
+        sink = lib.get_symbol_fast(name);
+    }
+    result.locked = (std::chrono::steady_clock::now() - start) / options.lookups;
+
+    start = std::chrono::steady_clock::now();
+    for(std::size_t i = 0; i < options.lookups; i++){
+        sink = raw.get_symbol_fast(name);
+    }
+    result.unlocked = (std::chrono::steady_clock::now() - start) / options.lookups;
+    (void) sink;
+    return result;
+}
+
+inspect_result inspect(const inspect_options& options){
+    inspect_result result;
+#if defined(RLL_PLATFORM_IS_UNIX)
+    result.modes.push_back(measure_mode(options, "lazy", rll::unix_flags::LOAD_LAZY));
+    result.modes.push_back(measure_mode(options, "now", rll::unix_flags::LOAD_NOW));
+#else
+    //Windows has no lazy binding, the flag is ignored there.
+    result.modes.push_back(measure_mode(options, "default", rll::unix_flags::LOAD_LAZY));
+#endif
+
     rll::shared_library lib;
+    lib.load(options.path, rll::loader_flags({ rll::unix_flags::LOAD_NOW }, {}, { rll::rll_flags::RECORD_LOAD_REPORT }));
+    result.report = lib.get_load_report();
+
+    try {
+        result.memory = lib.memory_usage();
+        result.have_memory = true;
+    } catch(rll::exception::not_supported&){
+    }
+    try {
+        result.exported_symbols = lib.get_address_index()->size();
+        result.have_symbols = true;
+    } catch(rll::exception::not_supported&){
+    }
 
-    lib.load(path);
+    if(!options.symbols.empty()){
+        unlocked_library raw;
+        raw.load(options.path, rll::loader_flags({ rll::unix_flags::LOAD_NOW }, {}));
+        for(auto& name : options.symbols){
+            result.lookups.push_back(measure_lookup(options, lib, raw, name));
+        }
+    }
+
+    try {
+        result.verification = lib.unload_and_verify();
+        result.have_verification = true;
+    } catch(rll::exception::not_supported&){
+    }
+    return result;
+}
+
+std::string format_duration(std::chrono::nanoseconds duration){
+    std::ostringstream out;
+    double value = static_cast<double>(duration.count());
+    out << std::fixed << std::setprecision(1);
+    if(value < 1000){
+        out << value << "ns";
+    } else if(value < 1000000){
+        out << value / 1000 << "us";
+    } else {
+        out << value / 1000000 << "ms";
+    }
+    return out.str();
+}
+
+std::string format_size(std::size_t size){
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if(size < 1024){
+        out << size << "B";
+    } else if(size < 1024 * 1024){
+        out << size / 1024.0 << "KiB";
+    } else {
+        out << size / (1024.0 * 1024.0) << "MiB";
+    }
+    return out.str();
+}
+
+void print_latencies(const std::string& label, const rll::latency_histogram::snapshot& latencies){
+    std::cout << "  " << std::left << std::setw(12) << label << std::right
+        << std::setw(10) << format_duration(latencies.percentile(50))
+        << std::setw(10) << format_duration(latencies.percentile(90))
+        << std::setw(10) << format_duration(latencies.percentile(99))
+        << std::setw(10) << format_duration(std::chrono::nanoseconds(latencies.max_ns))
+        << std::setw(10) << format_duration(latencies.mean()) << "\n";
+}
+
+void print_table(const inspect_options& options, const inspect_result& result){
+    std::cout << "Library: " << options.path << "\n";
+    std::cout << "Iterations: " << options.iterations << " per mode\n\n";
+
+    std::cout << "Latency" << std::string(7, ' ')
+        << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+        << std::setw(10) << "max" << std::setw(10) << "mean" << "\n";
+    for(auto& mode : result.modes){
+        print_latencies("load " + mode.mode, mode.load);
+        print_latencies("unload " + mode.mode, mode.unload);
+    }
+    std::cout << "\n";
+    for(auto& mode : result.modes){
+        std::cout << "First load (" << mode.mode << "): " << format_duration(mode.first_load) << "\n";
+    }
+    if(result.have_verification){
+        std::cout << "Unload: " << result.verification.describe() << "\n";
+    }
+    std::cout << "\n";
+
+    if(result.have_symbols){
+        std::cout << "Exported symbols: " << result.exported_symbols << "\n\n";
+    }
 
-    void * example_function = lib.get_symbol("example_func");
+    std::cout << "Dependencies (" << result.report.entries.size() << ", " << format_size(result.report.newly_mapped_size()) << " newly mapped):\n";
+    for(auto& entry : result.report.entries){
+        std::cout << "  " << std::left << std::setw(32) << entry.name << std::right
+            << std::setw(12) << format_size(entry.mapped_size)
+            << (entry.newly_mapped ? "  new     " : "  shared  ")
+            << (entry.resolved ? entry.path : "(not resolved)") << "\n";
+    }
+    std::cout << "\n";
+
+    if(result.have_memory){
+        const rll::library_memory_usage& memory = result.memory;
+        std::cout << "Memory:\n";
+        std::cout << "  text " << format_size(memory.text) << ", rodata " << format_size(memory.rodata)
+            << ", data " << format_size(memory.data) << ", bss " << format_size(memory.bss) << "\n";
+        std::cout << "  rss " << format_size(memory.rss) << ", pss " << format_size(memory.pss)
+            << ", dirty " << format_size(memory.dirty) << "\n\n";
+    }
+
+    if(!result.lookups.empty()){
+        std::cout << "Symbol lookups" << std::string(18, ' ')
+            << std::setw(10) << "first" << std::setw(10) << "locked" << std::setw(10) << "unlocked" << "\n";
+        for(auto& lookup : result.lookups){
+            std::cout << "  " << std::left << std::setw(30) << lookup.name << std::right;
+            if(!lookup.found){
+                std::cout << std::setw(10) << format_duration(lookup.first) << "  (not found)\n";
+                continue;
+            }
+            std::cout << std::setw(10) << format_duration(lookup.first)
+                << std::setw(10) << format_duration(lookup.locked)
+                << std::setw(10) << format_duration(lookup.unlocked) << "\n";
+        }
+    }
+}
+
+std::string latencies_json(const rll::latency_histogram::snapshot& latencies){
+    return "{\"count\":" + std::to_string(latencies.count)
+        + ",\"p50_ns\":" + std::to_string(latencies.percentile(50).count())
+        + ",\"p90_ns\":" + std::to_string(latencies.percentile(90).count())
+        + ",\"p99_ns\":" + std::to_string(latencies.percentile(99).count())
+        + ",\"max_ns\":" + std::to_string(latencies.max_ns)
+        + ",\"mean_ns\":" + std::to_string(latencies.mean().count()) + "}";
+}
 
-    ((void (*)())example_function)(); //Ignore this wizardry...
-}
\ No newline at end of file
+void print_json(const inspect_options& options, const inspect_result& result){
+    std::string json = "{\"path\":\"" + rll::detail::json_escape(options.path) + "\"";
+    json += ",\"iterations\":" + std::to_string(options.iterations);
+
+    json += ",\"modes\":[";
+    for(std::size_t i = 0; i < result.modes.size(); i++){
+        const mode_result& mode = result.modes[i];
+        json += i == 0 ? "{" : ",{";
+        json += "\"mode\":\"" + mode.mode + "\"";
+        json += ",\"first_load_ns\":" + std::to_string(mode.first_load.count());
+        json += ",\"load\":" + latencies_json(mode.load);
+        json += ",\"unload\":" + latencies_json(mode.unload);
+        json += "}";
+    }
+    json += "]";
+
+    if(result.have_symbols){
+        json += ",\"exported_symbols\":" + std::to_string(result.exported_symbols);
+    }
+    json += ",\"load_report\":" + result.report.to_json();
+    if(result.have_verification){
+        json += std::string(",\"unmapped\":") + (result.verification.unmapped ? "true" : "false");
+        json += ",\"unload\":\"" + rll::detail::json_escape(result.verification.describe()) + "\"";
+    }
+
+    if(result.have_memory){
+        const rll::library_memory_usage& memory = result.memory;
+        json += ",\"memory\":{\"text\":" + std::to_string(memory.text);
+        json += ",\"rodata\":" + std::to_string(memory.rodata);
+        json += ",\"data\":" + std::to_string(memory.data);
+        json += ",\"bss\":" + std::to_string(memory.bss);
+        json += ",\"rss\":" + std::to_string(memory.rss);
+        json += ",\"pss\":" + std::to_string(memory.pss);
+        json += ",\"dirty\":" + std::to_string(memory.dirty) + "}";
+    }
+
+    json += ",\"lookups\":[";
+    for(std::size_t i = 0; i < result.lookups.size(); i++){
+        const lookup_result& lookup = result.lookups[i];
+        json += i == 0 ? "{" : ",{";
+        json += "\"name\":\"" + rll::detail::json_escape(lookup.name) + "\"";
+        json += std::string(",\"found\":") + (lookup.found ? "true" : "false");
+        json += ",\"first_ns\":" + std::to_string(lookup.first.count());
+        if(lookup.found){
+            json += ",\"locked_ns\":" + std::to_string(lookup.locked.count());
+            json += ",\"unlocked_ns\":" + std::to_string(lookup.unlocked.count());
+        }
+        json += "}";
+    }
+    json += "]}";
+
+    std::cout << json << "\n";
+}
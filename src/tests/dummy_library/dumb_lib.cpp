@@ -2,12 +2,20 @@
 Dis be a dummy library for RLL's test framework.
 */
 
+#include <stdexcept>
+
 #ifdef WIN32
     #define API_EXPORT __declspec(dllexport)
 #else 
     #define API_EXPORT 
 #endif
 
+//Built a second time as "other_library" with a different id, so tests can tell
+//two loaded libraries apart.
+#ifndef DUMMY_LIBRARY_ID
+    #define DUMMY_LIBRARY_ID 1
+#endif
+
 extern "C" {
 
 API_EXPORT int add(int a, int b){
@@ -16,4 +24,23 @@ API_EXPORT int add(int a, int b){
 
 API_EXPORT extern const char abc[4] = "abc";
 
+API_EXPORT int divide(int a, int b){
+    if(b == 0){
+        throw std::domain_error("division by zero");
+    }
+    return a / b;
+}
+
+API_EXPORT int which(){
+    return DUMMY_LIBRARY_ID;
+}
+
+}
+
+namespace dummy {
+
+API_EXPORT int multiply(int a, int b){
+    return a * b;
+}
+
 }
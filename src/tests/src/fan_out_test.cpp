@@ -0,0 +1,107 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/RLL.hpp>
+#include <RLL/fan_out.hpp>
+
+#include <stdexcept>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//-------------------------------FAN_OUT_TEST---------------------------------//
+using namespace rll;
+
+TEST_CASE("The pool runs every task of concurrent batches once"){
+    work_stealing_pool pool(3);
+    REQUIRE(pool.size() == 3);
+
+    std::vector<std::thread> callers;
+    std::atomic<bool> failed{false};
+    for(int caller = 0; caller < 4; caller++){
+        callers.emplace_back([&pool, &failed](){
+            for(int round = 0; round < 50; round++){
+                std::vector<std::atomic<int>> runs(37);
+                pool.run(runs.size(), [&runs](std::size_t i){ runs[i]++; });
+                for(auto& count : runs){
+                    if(count != 1){
+                        failed = true;
+                    }
+                }
+            }
+        });
+    }
+    for(auto& caller : callers){
+        caller.join();
+    }
+    REQUIRE(!failed);
+    pool.run(0, [](std::size_t){});
+}
+
+TEST_CASE("Slow tasks don't serialize the batch"){
+    work_stealing_pool pool(4);
+    auto start = std::chrono::steady_clock::now();
+    pool.run(4, [](std::size_t){ std::this_thread::sleep_for(std::chrono::milliseconds(50)); });
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(150));
+}
+
+TEST_CASE("Fan-out calls every bound library"){
+    work_stealing_pool pool(2);
+    std::vector<std::unique_ptr<shared_library>> libraries;
+    std::vector<shared_library *> pointers;
+    for(int i = 0; i < 6; i++){
+        libraries.emplace_back(new shared_library());
+        libraries.back()->load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+        pointers.push_back(libraries.back().get());
+    }
+
+    fan_out<int(int, int)> add(pool);
+    REQUIRE(add.bind_all(pointers, "add") == 6);
+    REQUIRE(add.bind_all(pointers, "not_a_symbol") == 0);
+
+    auto outcomes = add(2, 3);
+    REQUIRE(outcomes.size() == 6);
+    for(std::size_t i = 0; i < outcomes.size(); i++){
+        REQUIRE(outcomes[i].ok());
+        REQUIRE(outcomes[i].value == 5);
+        REQUIRE(outcomes[i].library == pointers[i]);
+    }
+    REQUIRE(add.aggregate(0, [](int sum, int value){ return sum + value; }, 1, 1) == 12);
+
+    bool exception_state = false;
+    try {
+        add.bind(*pointers[0], "not_a_symbol");
+    } catch(exception::symbol_not_found&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(add.size() == 6);
+}
+
+TEST_CASE("Fan-out captures exceptions per call"){
+    work_stealing_pool pool(1);
+    shared_library first, second;
+    first.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    second.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+
+    fan_out<int(int, int)> divide(pool);
+    REQUIRE(divide(1, 1).empty());
+    divide.bind(first, "divide");
+    divide.bind(second, "divide");
+
+    auto outcomes = divide(6, 0);
+    REQUIRE(outcomes.size() == 2);
+    bool exception_state = false;
+    try {
+        std::rethrow_exception(outcomes[1].error);
+    } catch(std::domain_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!outcomes[0].ok());
+    REQUIRE(divide.aggregate(0, [](int sum, int value){ return sum + value; }, 6, 0) == 0);
+    REQUIRE(divide.aggregate(0, [](int sum, int value){ return sum + value; }, 6, 3) == 4);
+
+    fan_out<void(int)> nothing(pool);
+    REQUIRE(nothing(1).empty());
+}
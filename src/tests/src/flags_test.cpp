@@ -113,3 +113,17 @@ TEST_CASE("Clearing flags works"){
     flags.clear_windows_flags();
     REQUIRE(flags.get_windows_flags() == 0);
 }
+
+TEST_CASE("RLL flags are kept apart from platform flags"){
+    loader_flags flags { {}, {}, { rll_flags::RECORD_LOAD_REPORT } };
+    REQUIRE(flags.has_flag(rll_flags::RECORD_LOAD_REPORT));
+    REQUIRE(flags.get_unix_flags() == 0);
+    REQUIRE(flags.get_windows_flags() == 0);
+
+    flags.remove_flag(rll_flags::RECORD_LOAD_REPORT);
+    REQUIRE(flags.get_rll_flags() == 0);
+
+    flags.add_flag(rll_flags::RECORD_LOAD_REPORT);
+    flags.clear_rll_flags();
+    REQUIRE(flags.has_flag(rll_flags::RECORD_LOAD_REPORT) == false);
+}
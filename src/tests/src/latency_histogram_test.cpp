@@ -0,0 +1,68 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/RLL.hpp>
+
+#include <thread>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//--------------------------LATENCY_HISTOGRAM_TEST----------------------------//
+using namespace rll;
+
+TEST_CASE("Histogram buckets are continuous and bounded"){
+    for(std::uint64_t value = 0; value < 100000; value += 7){
+        std::size_t bucket = latency_histogram::bucket_of(value);
+        REQUIRE(latency_histogram::bucket_upper_bound(bucket) >= value);
+        if(bucket > 0){
+            REQUIRE(latency_histogram::bucket_upper_bound(bucket - 1) < value);
+        }
+    }
+    REQUIRE(latency_histogram::bucket_of(UINT64_MAX) == latency_histogram::bucket_count - 1);
+}
+
+TEST_CASE("Histograms merge the values of all threads"){
+    latency_histogram histogram;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++){
+        threads.emplace_back([&histogram](){
+            for(int value = 1; value <= 1000; value++){
+                histogram.record(std::chrono::nanoseconds(value));
+            }
+        });
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+
+    latency_histogram::snapshot merged = histogram.merge();
+    REQUIRE(merged.count == 4000);
+    REQUIRE(merged.max_ns == 1000);
+    REQUIRE(merged.mean().count() == 500);
+    REQUIRE(merged.percentile(50).count() >= 500);
+    REQUIRE(merged.percentile(50).count() <= 532);
+    REQUIRE(merged.percentile(100).count() == 1000);
+
+    histogram.reset();
+    REQUIRE(histogram.merge().count == 0);
+}
+
+TEST_CASE("Timed function symbols record only while enabled"){
+    shared_library library;
+    library.load("./dummy_library.library");
+
+    latency_histogram histogram;
+    timed_function<int(int, int)> add = library.get_timed_function_symbol<int(int, int)>("add", histogram);
+    REQUIRE(add(2, 3) == 5);
+    REQUIRE(add(4, 4) == 8);
+    REQUIRE(histogram.merge().count == 2);
+
+    histogram.disable();
+    REQUIRE(add(1, 1) == 2);
+    REQUIRE(histogram.merge().count == 2);
+
+    histogram.enable();
+    REQUIRE(add(1, 1) == 2);
+    REQUIRE(histogram.merge().count == 3);
+}
@@ -0,0 +1,37 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/RLL.hpp>
+
+#include <cstdio>
+//-----------------------------NO_EXCEPTIONS_TEST-----------------------------//
+//Built with -fno-exceptions, so catch-mini (which throws its failures) can't
+//be used here.
+using namespace rll;
+
+static int failures = 0;
+
+#define CHECK(expression) \
+    if(!(expression)){ \
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expression); \
+        failures++; \
+    }
+
+int main(){
+    using library_type = basic_shared_library<lock_policies::no_lock, error_policies::return_errors>;
+    library_type library;
+    library.load("./not_a_library.library");
+    CHECK(!library.is_loaded());
+    CHECK(!error_policies::return_errors::last_error().empty());
+
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    CHECK(library.is_loaded());
+    int (*add)(int, int) = reinterpret_cast<int (*)(int, int)>(library.get_symbol_fast("add"));
+    CHECK(add != nullptr && add(2, 3) == 5);
+    CHECK(library.get_symbol("not_a_symbol") == nullptr);
+    library.unload();
+    CHECK(!library.is_loaded());
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/plugin_host.hpp>
+
+#include <thread>
+#include <sys/stat.h>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//-----------------------------PLUGIN_HOST_TEST-------------------------------//
+using namespace rll;
+
+TEST_CASE("Remote libraries are called in a separate process"){
+    remote_library library;
+    library.load("./dummy_library.library");
+    REQUIRE(library.is_loaded());
+    REQUIRE(library.is_alive());
+    REQUIRE(library.get_host_pid() != getpid());
+    REQUIRE(library.has_symbol("add"));
+    REQUIRE(!library.has_symbol("not_a_symbol"));
+
+    std::function<int(int, int)> add = library.get_function_symbol<int(int, int)>("add");
+    REQUIRE(add(2, 2) == 4);
+
+    std::vector<std::thread> threads;
+    std::atomic<int> failures{0};
+    for(int i = 0; i < 4; i++){
+        threads.emplace_back([&add, &failures, i](){
+            for(int j = 0; j < 1000; j++){
+                if(add(i, j) != i + j){
+                    failures++;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+
+    library.unload();
+    REQUIRE(!library.is_loaded());
+}
+
+TEST_CASE("Many callers can share one remote library"){
+    remote_library library;
+    library.load("./dummy_library.library");
+    remote_function<int(int, int)> add = library.get_remote_function<int(int, int)>("add");
+
+    //Callers race for the same tickets, and 100 of them outnumber the slots.
+    for(int count : { 16, 100 }){
+        std::vector<std::thread> threads;
+        std::atomic<int> failures{0};
+        for(int i = 0; i < count; i++){
+            threads.emplace_back([&add, &failures, i](){
+                for(int j = 0; j < 100; j++){
+                    if(add(i, j) != i + j){
+                        failures++;
+                    }
+                }
+            });
+        }
+        for(auto& thread : threads){
+            thread.join();
+        }
+        REQUIRE(failures == 0);
+    }
+    library.unload();
+}
+
+TEST_CASE("Remote library failures are reported"){
+    bool exception_state = false;
+    remote_library missing;
+    try {
+        missing.load("./not_a_library.library");
+    } catch(exception::library_loading_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+
+    remote_library library;
+    library.load("./dummy_library.library");
+    remote_function<int(int, int)> add = library.get_remote_function<int(int, int)>("add");
+    kill(library.get_host_pid(), SIGKILL);
+
+    exception_state = false;
+    try {
+        add(1, 1);
+    } catch(exception::plugin_host_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!library.is_alive());
+}
+
+TEST_CASE("Plugin hosts that don't start in time are killed"){
+    //Opening a FIFO without a writer blocks the host's dlopen for good.
+    unlink("./plugin_host.fifo");
+    REQUIRE(mkfifo("./plugin_host.fifo", 0600) == 0);
+    remote_library::set_start_timeout(std::chrono::milliseconds(200));
+
+    bool exception_state = false;
+    remote_library library;
+    try {
+        library.load("./plugin_host.fifo");
+    } catch(exception::plugin_host_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!library.is_loaded());
+
+    remote_library::set_start_timeout(std::chrono::seconds(10));
+    unlink("./plugin_host.fifo");
+}
+
+TEST_CASE("Unloading kills a host that doesn't exit in time"){
+    remote_library library;
+    library.load("./dummy_library.library");
+    //A stopped host neither serves the shutdown request nor exits.
+    kill(library.get_host_pid(), SIGSTOP);
+
+    remote_library::set_start_timeout(std::chrono::milliseconds(300));
+    auto start = std::chrono::steady_clock::now();
+    library.unload();
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    REQUIRE(!library.is_loaded());
+    remote_library::set_start_timeout(std::chrono::seconds(10));
+}
+
+TEST_CASE("Plugin hosts are forked from the launcher once it is started"){
+    remote_library::start_launcher();
+
+    remote_library library;
+    library.load("./dummy_library.library");
+    //The host is the launcher's child, not ours.
+    REQUIRE(waitpid(library.get_host_pid(), nullptr, WNOHANG) == -1);
+    REQUIRE(errno == ECHILD);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(2, 3) == 5);
+
+    bool exception_state = false;
+    remote_library missing;
+    try {
+        missing.load("./not_a_library.library");
+    } catch(exception::library_loading_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+
+    remote_function<int(int, int)> add = library.get_remote_function<int(int, int)>("add");
+    kill(library.get_host_pid(), SIGKILL);
+    exception_state = false;
+    try {
+        add(1, 1);
+    } catch(exception::plugin_host_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!library.is_alive());
+    library.unload();
+
+    library.load("./dummy_library.library");
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(4, 4) == 8);
+    library.unload();
+}
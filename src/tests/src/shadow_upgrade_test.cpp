@@ -0,0 +1,97 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/shadow_upgrade.hpp>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//----------------------------SHADOW_UPGRADE_TEST-----------------------------//
+using namespace rll;
+
+TEST_CASE("A candidate within the threshold is promoted"){
+    std::vector<shadow_verdict> verdicts;
+    shadow_options options;
+    options.sample_rate = 1;
+    options.min_samples = 400;
+    options.max_slowdown = 1000;
+    options.on_verdict = [&verdicts](const shadow_verdict& verdict){ verdicts.push_back(verdict); };
+
+    shadow_upgrade<int(int, int)> add("./dummy_library.library", "add", options);
+    REQUIRE(add(2, 3) == 5);
+    REQUIRE(!add.has_candidate());
+    add.stage("./dummy_library.library");
+    REQUIRE(add.has_candidate());
+
+    std::vector<std::thread> callers;
+    std::atomic<bool> failed{false};
+    for(int caller = 0; caller < 4; caller++){
+        callers.emplace_back([&add, &failed, caller](){
+            for(int i = 0; i < 200; i++){
+                if(add(caller, i) != caller + i){
+                    failed = true;
+                }
+            }
+        });
+    }
+    for(auto& caller : callers){
+        caller.join();
+    }
+    REQUIRE(!failed);
+    REQUIRE(!add.has_candidate());
+    REQUIRE(verdicts.size() == 1);
+    REQUIRE(verdicts[0].decided);
+    REQUIRE(verdicts[0].promoted);
+    REQUIRE(verdicts[0].samples > 0);
+    REQUIRE(verdicts[0].describe().find("promoted") != std::string::npos);
+    REQUIRE(add.progress().promoted);
+    REQUIRE(add(40, 2) == 42);
+}
+
+TEST_CASE("A slower candidate is discarded"){
+    shadow_options options;
+    options.sample_rate = 1;
+    options.min_samples = 100;
+    options.max_slowdown = 0;
+    options.automatic = false;
+
+    shadow_upgrade<int(int, int)> add("./dummy_library.library", "add", options);
+    REQUIRE(!add.evaluate().decided);
+    add.stage("./dummy_library.library");
+    for(int i = 0; i < 50; i++){
+        add(i, i);
+    }
+    shadow_verdict verdict = add.evaluate();
+    REQUIRE(!verdict.decided);
+    REQUIRE(verdict.samples == 50);
+    REQUIRE(add.has_candidate());
+
+    verdict = add.evaluate(true);
+    REQUIRE(verdict.decided);
+    REQUIRE(!verdict.promoted);
+    REQUIRE(!add.has_candidate());
+    REQUIRE(add(1, 2) == 3);
+}
+
+TEST_CASE("Unsampled calls only run the current version"){
+    shadow_options options;
+    options.sample_rate = 0;
+    shadow_upgrade<int(int, int)> add("./dummy_library.library", "add", options);
+    add.stage("./dummy_library.library");
+    for(int i = 0; i < 100; i++){
+        add(i, 1);
+    }
+    REQUIRE(add.progress().samples == 0);
+    add.discard();
+    REQUIRE(!add.has_candidate());
+    REQUIRE(add.current_path() == "./dummy_library.library");
+
+    bool exception_state = false;
+    try {
+        add.stage("./not_a_library.library");
+    } catch(exception::library_loading_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!add.has_candidate());
+}
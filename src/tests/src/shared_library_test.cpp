@@ -6,6 +6,11 @@
 
 #include <cstring>
 #include <functional>
+#include <iterator>
+#ifdef __unix__
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 #define CATCH_CONFIG_MAIN 1
 #include <catch-mini/catch-mini.hpp>
@@ -50,3 +55,874 @@ TEST_CASE("Opening and using a shared library works"){
     REQUIRE(exception_state == false);
     REQUIRE(abc == "abc");
 }
+
+TEST_CASE("Load reports describe the dependency tree"){
+    shared_library library;
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::RECORD_LOAD_REPORT }));
+
+    const load_report& report = library.get_load_report();
+    REQUIRE(report.path == "./dummy_library.library");
+    REQUIRE(report.load_time.count() > 0);
+    #ifdef RLL_PLATFORM_IS_ELF
+    REQUIRE(report.entries.size() >= 1);
+    REQUIRE(report.entries[0].resolved);
+    REQUIRE(report.entries[0].newly_mapped);
+    REQUIRE(report.entries[0].mapped_size > 0);
+    for(auto& entry : report.entries){
+        for(auto index : entry.needed){
+            REQUIRE(index < report.entries.size());
+        }
+    }
+    REQUIRE(report.newly_mapped_size() >= report.entries[0].mapped_size);
+    REQUIRE(report.to_json().find("\"newly_mapped\":true") != std::string::npos);
+    #endif
+
+    library.unload();
+    bool exception_state = false;
+    try {
+        library.get_load_report();
+    } catch(exception::library_not_loaded&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+}
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Memory usage is accounted per segment"){
+    shared_library library;
+    library.load("./dummy_library.library");
+
+    library_memory_usage usage = library.memory_usage();
+    REQUIRE(usage.path == "./dummy_library.library");
+    REQUIRE(usage.segments.size() > 0);
+    REQUIRE(usage.text > 0);
+    REQUIRE(usage.rss > 0);
+    REQUIRE(usage.pss <= usage.rss);
+
+    bool found = false;
+    for(auto& other : shared_library::process_memory_usage()){
+        if(other.text == usage.text && other.rss >= usage.rss && other.path.find("dummy_library") != std::string::npos){
+            found = true;
+        }
+    }
+    REQUIRE(found);
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Address index maps addresses back to symbols"){
+    shared_library library;
+    library.load("./dummy_library.library");
+
+    std::shared_ptr<const address_index> index = library.get_address_index(true);
+    REQUIRE(index->size() >= 3);
+    REQUIRE(library.get_address_index() == index);
+
+    const char * add = static_cast<const char *>(library.get_symbol("add"));
+    address_index::symbol_info info = index->lookup(add + 1);
+    REQUIRE(info);
+    REQUIRE(std::strcmp(info.name, "add") == 0);
+    REQUIRE(info.offset == 1);
+    REQUIRE(std::string(info.library) == "./dummy_library.library");
+
+    info = index->lookup(library.get_symbol("_ZN5dummy8multiplyEii"));
+    REQUIRE(info);
+    REQUIRE(std::string(info.demangled_name) == "dummy::multiply(int, int)");
+
+    REQUIRE(!index->lookup(nullptr));
+}
+#endif
+
+TEST_CASE("Startup manifests record and replay loads"){
+    const std::string manifest_file = "./rll_manifest_test.txt";
+    {
+        startup_manifest manifest;
+        manifest.start_recording();
+        shared_library library;
+        library.load("./dummy_library.library");
+        REQUIRE(library.get_symbol("add") != nullptr);
+        REQUIRE(library.has_symbol("abc"));
+        REQUIRE(!library.has_symbol("not_a_symbol"));
+        manifest.stop_recording();
+        library.get_symbol("_ZN5dummy8multiplyEii");
+
+        std::vector<startup_manifest::library_entry> libraries = manifest.get_libraries();
+        REQUIRE(libraries.size() == 1);
+        REQUIRE(libraries[0].path == "./dummy_library.library");
+        REQUIRE(libraries[0].symbols.size() == 2);
+        REQUIRE(libraries[0].symbols[0] == "add");
+        REQUIRE(manifest.save(manifest_file));
+    }
+
+    startup_manifest manifest;
+    REQUIRE(manifest.open(manifest_file));
+    startup_manifest::replay_result result = manifest.replay();
+    REQUIRE(result.libraries_loaded == 1);
+    REQUIRE(result.libraries_stale == 0);
+    REQUIRE(result.symbols_resolved == 2);
+
+    shared_library library;
+    library.load("./dummy_library.library");
+    auto add = library.get_function_symbol<int(int, int)>("add");
+    REQUIRE(add(1, 2) == 3);
+    manifest.release();
+    REQUIRE(add(2, 2) == 4);
+
+    #ifdef RLL_PLATFORM_IS_ELF
+    //A changed build-id invalidates the entry.
+    std::vector<startup_manifest::library_entry> libraries = manifest.get_libraries();
+    REQUIRE(!libraries[0].build_id.empty());
+    {
+        std::ofstream out(manifest_file, std::ios::trunc);
+        out << "RLL-MANIFEST 1\nL\t1\t0\t00\t./dummy_library.library\t" << libraries[0].resolved_path << "\nS\tadd\n";
+    }
+    startup_manifest stale;
+    REQUIRE(stale.open(manifest_file));
+    result = stale.replay(1);
+    REQUIRE(result.libraries_stale == 1);
+    REQUIRE(result.libraries_loaded == 0);
+    REQUIRE(stale.get_libraries().empty());
+    #endif
+    std::remove(manifest_file.c_str());
+}
+
+#if defined(RLL_PLATFORM_IS_ELF) && defined(RLL_HAS_USERSPACE_LOADER)
+TEST_CASE("The userspace loader maps libraries without dlopen"){
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::USERSPACE_LOADER, rll_flags::RECORD_LOAD_REPORT });
+    shared_library library;
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.is_loaded());
+    REQUIRE(dlopen("./dummy_library.library", RTLD_NOLOAD | RTLD_LAZY) == nullptr);
+
+    auto add = library.get_function_symbol<int(int, int)>("add");
+    REQUIRE(add(2, 3) == 5);
+    auto multiply = library.get_function_symbol<int(int, int)>("_ZN5dummy8multiplyEii");
+    REQUIRE(multiply(4, 5) == 20);
+    REQUIRE(std::strcmp(static_cast<const char *>(library.get_symbol("abc")), "abc") == 0);
+    REQUIRE(!library.has_symbol("not_a_symbol"));
+
+    REQUIRE(library.get_load_report().entries.size() >= 1);
+    REQUIRE(library.get_load_report().entries[0].newly_mapped);
+    REQUIRE(!library.memory_usage().segments.empty());
+    REQUIRE(library.get_address_index()->lookup(library.get_symbol("add")));
+
+    bool exception_state = false;
+    try {
+        library.load("./dummy_library.library", flags);
+    } catch(exception::library_already_loaded&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    library.unload();
+    REQUIRE(!library.is_loaded());
+
+    //Independent loads don't serialize on each other.
+    std::vector<std::thread> threads;
+    std::atomic<int> loaded{0};
+    for(int i = 0; i < 4; i++){
+        threads.emplace_back([&flags, &loaded](){
+            for(int j = 0; j < 16; j++){
+                shared_library copy;
+                copy.load("./dummy_library.library", flags);
+                if(copy.get_function_symbol<int(int, int)>("add")(j, 1) == j + 1){
+                    loaded++;
+                }
+            }
+        });
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+    REQUIRE(loaded == 64);
+}
+#endif
+
+TEST_CASE("Unloaded libraries are parked in the warm pool"){
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {});
+    warm_pool_limits limits;
+    limits.max_libraries = 1;
+    shared_library::set_warm_pool_limits(limits);
+
+    shared_library library;
+    library.load("./dummy_library.library", flags);
+    void * handle = library.get_platform_handle();
+    library.unload();
+    REQUIRE(shared_library::warm_pool_size() == 1);
+
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_platform_handle() == handle);
+    REQUIRE(shared_library::warm_pool_size() == 0);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(1, 1) == 2);
+    library.unload();
+
+    //Over the limit, the least recently used library is closed.
+    shared_library first, second;
+    first.load("./dummy_library.library", flags);
+    second.load("./dummy_library.library", flags);
+    first.unload();
+    second.unload();
+    REQUIRE(shared_library::warm_pool_size() == 1);
+
+    limits.keep_alive = std::chrono::milliseconds(1);
+    shared_library::set_warm_pool_limits(limits);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    shared_library::trim_warm_pool();
+    REQUIRE(shared_library::warm_pool_size() == 0);
+
+    shared_library::set_warm_pool_limits(warm_pool_limits());
+    library.load("./dummy_library.library", flags);
+    library.unload();
+    REQUIRE(shared_library::warm_pool_size() == 0);
+}
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("The symbol index finds providers across libraries"){
+    symbol_index& index = symbol_index::global();
+    REQUIRE(!index.find("add"));
+
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::INDEX_SYMBOLS });
+    shared_library first, second;
+    first.load("./dummy_library.library", flags);
+    symbol_provider provider = index.find("add");
+    REQUIRE(provider.library == &first);
+    REQUIRE(provider.address == first.get_symbol("add"));
+    REQUIRE(index.find("_ZN5dummy8multiplyEii"));
+    REQUIRE(!index.find("not_a_symbol"));
+
+    //The first library loaded takes precedence.
+    second.load("./dummy_library.library", flags);
+    REQUIRE(index.find_all("add").size() == 2);
+    REQUIRE(index.find("add").library == &first);
+    first.unload();
+    REQUIRE(index.find("add").library == &second);
+
+    //Readers run while libraries come and go.
+    std::atomic<bool> done{false};
+    std::atomic<bool> torn{false};
+    std::thread reader([&](){
+        while(!done){
+            symbol_provider found = index.find("add");
+            if(found && found.library != &first && found.library != &second){
+                torn = true;
+            }
+        }
+    });
+    for(int i = 0; i < 50; i++){
+        first.load("./dummy_library.library", flags);
+        first.unload();
+    }
+    done = true;
+    reader.join();
+    REQUIRE(!torn);
+
+    second.unload();
+    REQUIRE(!index.find("add"));
+    REQUIRE(index.size() == 0);
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Demangled names look up C++ symbols"){
+    shared_library library;
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_demangled_symbol("dummy::multiply(int, int)") == library.get_symbol("_ZN5dummy8multiplyEii"));
+    REQUIRE(library.get_demangled_function_symbol<int(int, int)>("dummy::multiply(int, int)")(3, 4) == 12);
+
+    bool exception_state = false;
+    try {
+        library.get_demangled_symbol("dummy::multiply(long, long)");
+    } catch(exception::symbol_not_found&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    library.unload();
+
+    //The cache file is keyed by the build-id and used by later loads.
+    const std::string cache = "./rll_demangle_cache";
+    mkdir(cache.c_str(), 0755);
+    shared_library::set_demangle_cache_directory(cache);
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_demangled_symbol("dummy::multiply(int, int)") != nullptr);
+    library.unload();
+
+    std::vector<std::string> files;
+    if(DIR * directory = opendir(cache.c_str())){
+        while(dirent * file = readdir(directory)){
+            if(file->d_name[0] != '.'){
+                files.push_back(cache + "/" + file->d_name);
+            }
+        }
+        closedir(directory);
+    }
+    REQUIRE(files.size() == 1);
+    REQUIRE(files[0].find(".demangled") != std::string::npos);
+
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_demangled_function_symbol<int(int, int)>("dummy::multiply(int, int)")(5, 5) == 25);
+    library.unload();
+
+    shared_library::set_demangle_cache_directory("");
+    for(auto& file : files){
+        std::remove(file.c_str());
+    }
+    rmdir(cache.c_str());
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Library sets shut down under a policy"){
+    const char * path = "./dummy_library.library";
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {});
+    auto resident = [path](){
+        void * handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+        if(handle != nullptr){
+            dlclose(handle);
+        }
+        return handle != nullptr;
+    };
+    REQUIRE(!resident());
+
+    //Shutting down closes the libraries instead of parking them.
+    warm_pool_limits limits;
+    limits.max_libraries = 16;
+    shared_library::set_warm_pool_limits(limits);
+    for(shutdown_policy policy : { shutdown_policies::CLOSE, shutdown_policies::PARALLEL }){
+        library_set set(policy, 4);
+        for(int i = 0; i < 8; i++){
+            REQUIRE(set.load(path, flags).get_function_symbol<int(int, int)>("add")(i, i) == 2 * i);
+        }
+        REQUIRE(set.size() == 8);
+        set.shutdown();
+        REQUIRE(set.size() == 0);
+        REQUIRE(shared_library::warm_pool_size() == 0);
+        REQUIRE(!resident());
+    }
+    shared_library::set_warm_pool_limits(warm_pool_limits());
+
+    {
+        library_set set(shutdown_policies::HYBRID);
+        shared_library& finalized = set.load(path, flags, true);
+        shared_library& leaked = set.load(path, flags);
+        REQUIRE(set.set_needs_finalization(leaked, false));
+        REQUIRE(finalized.is_loaded());
+    }
+    REQUIRE(resident());
+
+    //Drop the reference the HYBRID set leaked.
+    void * handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+    dlclose(handle);
+    dlclose(handle);
+    REQUIRE(!resident());
+
+    {
+        library_set set(shutdown_policies::LEAK);
+        set.load(path, flags);
+    }
+    REQUIRE(resident());
+    handle = dlopen(path, RTLD_LAZY | RTLD_NOLOAD);
+    dlclose(handle);
+    dlclose(handle);
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Symbol offsets are cached by build-id"){
+    const std::string cache = "./rll_offset_cache";
+    mkdir(cache.c_str(), 0755);
+    shared_library::set_offset_cache_directory(cache);
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::CACHE_SYMBOL_OFFSETS });
+
+    shared_library library;
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_symbol("add") != nullptr);
+    REQUIRE(library.has_symbol("_ZN5dummy8multiplyEii"));
+    REQUIRE(!library.has_symbol("not_a_symbol"));
+    library.unload();
+
+    std::vector<std::string> files;
+    if(DIR * directory = opendir(cache.c_str())){
+        while(dirent * file = readdir(directory)){
+            if(file->d_name[0] != '.'){
+                files.push_back(cache + "/" + file->d_name);
+            }
+        }
+        closedir(directory);
+    }
+    REQUIRE(files.size() == 1);
+    REQUIRE(files[0].find(".offsets") != std::string::npos);
+
+    //Swap the two cached offsets: answers that come from the cache are swapped too.
+    std::string contents;
+    {
+        std::ifstream in(files[0], std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    const std::size_t header_size = 8 + 128 + 8 + 8, entry_size = 24;
+    REQUIRE(contents.size() > header_size + 2 * entry_size);
+    std::string first_offset = contents.substr(header_size + 16, 8);
+    contents.replace(header_size + 16, 8, contents.substr(header_size + entry_size + 16, 8));
+    contents.replace(header_size + entry_size + 16, 8, first_offset);
+    {
+        std::ofstream out(files[0], std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(3, 4) == 12);
+    library.unload();
+
+    //A different build-id falls back to normal lookups.
+    const char build_id_start = contents[8];
+    contents[8] = contents[8] == 'x' ? 'y' : 'x';
+    {
+        std::ofstream out(files[0], std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(3, 4) == 7);
+    library.unload();
+
+    //Offsets that point outside the library are never returned.
+    contents[8] = build_id_start;
+    contents.replace(header_size + 16, 8, std::string(8, '\x7f'));
+    contents.replace(header_size + entry_size + 16, 8, std::string(8, '\x7f'));
+    {
+        std::ofstream out(files[0], std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(3, 4) == 7);
+    REQUIRE(library.get_symbol_fast("_ZN5dummy8multiplyEii") != nullptr);
+    library.unload();
+
+    //Unloads save and drop the cache while lookups read it.
+    std::atomic<bool> done{false};
+    std::thread lookups([&](){
+        while(!done){
+            library.get_symbol_fast("add");
+            library.get_symbol_fast("_ZN5dummy8multiplyEii");
+        }
+    });
+    for(int i = 0; i < 100; i++){
+        library.load("./dummy_library.library", flags);
+        library.unload();
+    }
+    done = true;
+    lookups.join();
+
+    shared_library::set_offset_cache_directory("");
+    std::remove(files[0].c_str());
+    rmdir(cache.c_str());
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Unload verification reports what keeps a library mapped"){
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {});
+    shared_library library;
+    library.load("./dummy_library.library", flags);
+    unload_verification result = library.unload_and_verify();
+    REQUIRE(result.unmapped);
+    REQUIRE(result.blockers == 0);
+    REQUIRE(!library.is_loaded());
+
+    //A handle RLL doesn't know about.
+    void * other = dlopen("./dummy_library.library", RTLD_LAZY);
+    REQUIRE(other != nullptr);
+    library.load("./dummy_library.library", flags);
+    result = library.unload_and_verify();
+    REQUIRE(!result.unmapped);
+    REQUIRE(result.has_blocker(unload_blockers::OTHER_REFERENCES));
+    REQUIRE(result.describe().find("other handles") != std::string::npos);
+    dlclose(other);
+
+    warm_pool_limits limits;
+    limits.max_libraries = 1;
+    shared_library::set_warm_pool_limits(limits);
+    library.load("./dummy_library.library", flags);
+    result = library.unload_and_verify(false);
+    REQUIRE(result.blockers == unload_blockers::WARM_POOL);
+    shared_library::set_warm_pool_limits(warm_pool_limits());
+    REQUIRE(shared_library::warm_pool_size() == 0);
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.unload_and_verify().unmapped);
+
+    //A copy, since a NODELETE library stays for the rest of the process.
+    {
+        std::ifstream in("./dummy_library.library", std::ios::binary);
+        std::ofstream out("./dummy_library_nodelete.library", std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+    }
+    library.load("./dummy_library_nodelete.library", loader_flags({ unix_flags::LOAD_LAZY, unix_flags::LOAD_NODELETE }, {}));
+    result = library.unload_and_verify();
+    REQUIRE(!result.unmapped);
+    REQUIRE(result.has_blocker(unload_blockers::NODELETE_LOAD));
+    REQUIRE(!result.has_blocker(unload_blockers::OTHER_REFERENCES));
+    std::remove("./dummy_library_nodelete.library");
+
+    bool exception_state = false;
+    try {
+        library.unload_and_verify();
+    } catch(exception::library_not_loaded&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+}
+#endif
+
+TEST_CASE("Policies pick the locking, error handling and caching"){
+    using quiet_library = basic_shared_library<lock_policies::no_lock, error_policies::return_errors, cache_policies::no_cache>;
+    quiet_library quiet;
+    REQUIRE(quiet.get_symbol("add") == nullptr);
+    REQUIRE(!error_policies::return_errors::last_error().empty());
+
+    quiet.load("./not_a_library.library");
+    REQUIRE(!quiet.is_loaded());
+    quiet.load("./dummy_library.library");
+    REQUIRE(quiet.is_loaded());
+    REQUIRE(quiet.get_function_symbol<int(int, int)>("add")(2, 3) == 5);
+    REQUIRE(quiet.get_symbol("not_a_symbol") == nullptr);
+    REQUIRE(std::string(error_policies::return_errors::last_error()) == "not_a_symbol");
+    quiet.load("./dummy_library.library");
+    REQUIRE(error_policies::return_errors::last_error() == "./dummy_library.library");
+    quiet.unload();
+
+    basic_shared_library<lock_policies::spin_lock> spinning;
+    basic_shared_library<lock_policies::shared_mutex_lock> shared;
+    spinning.load("./dummy_library.library");
+    shared.load("./dummy_library.library");
+    std::vector<std::thread> threads;
+    std::atomic<int> sum{0};
+    for(int i = 0; i < 4; i++){
+        threads.emplace_back([&](){
+            for(int j = 0; j < 100; j++){
+                sum += spinning.get_function_symbol<int(int, int)>("add")(1, 0);
+                sum += shared.get_function_symbol<int(int, int)>("add")(0, 1);
+            }
+        });
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+    REQUIRE(sum == 800);
+
+    bool exception_state = false;
+    try {
+        shared.get_symbol("not_a_symbol");
+    } catch(exception::symbol_not_found&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+}
+
+TEST_CASE("Lookups racing an unload never use a closed handle"){
+    basic_shared_library<lock_policies::mutex_lock, error_policies::return_errors, cache_policies::no_cache> uncached;
+    shared_library cached;
+    std::atomic<bool> done{false};
+    std::thread lookups([&](){
+        while(!done){
+            uncached.get_symbol_fast("add");
+            uncached.get_symbol("add");
+            cached.get_symbol_fast("not_a_symbol");
+        }
+    });
+    for(int i = 0; i < 200; i++){
+        uncached.load("./dummy_library.library");
+        cached.load("./dummy_library.library");
+        uncached.unload();
+        cached.unload();
+    }
+    done = true;
+    lookups.join();
+    REQUIRE(!uncached.is_loaded());
+    REQUIRE(!cached.is_loaded());
+
+    #if defined(RLL_PLATFORM_IS_ELF) && defined(RLL_HAS_USERSPACE_LOADER)
+    //Images are freed by the unload.
+    done = false;
+    std::thread image_lookups([&](){
+        while(!done){
+            uncached.get_symbol_fast("add");
+            cached.get_symbol_fast("not_a_symbol");
+        }
+    });
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::USERSPACE_LOADER });
+    for(int i = 0; i < 50; i++){
+        uncached.load("./dummy_library.library", flags);
+        cached.load("./dummy_library.library", flags);
+        uncached.unload();
+        cached.unload();
+    }
+    done = true;
+    image_lookups.join();
+    REQUIRE(!cached.is_loaded());
+    #endif
+}
+
+#ifdef RLL_HAS_COMPRESSED_LIBRARIES
+TEST_CASE("LZ4 compressed libraries are decompressed transparently"){
+    std::string contents;
+    {
+        std::ifstream in("./dummy_library.library", std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto put32 = [](std::string& out, std::uint32_t value){
+        for(int i = 0; i < 4; i++){
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    };
+    auto checksum = [](const std::string& data){
+        return detail::xxh32_digest(reinterpret_cast<const unsigned char *>(data.data()), data.size());
+    };
+
+    //A frame of stored (uncompressed) 4 KiB blocks with every checksum on.
+    std::string frame;
+    put32(frame, 0x184D2204);
+    std::string descriptor = { '\x74', '\x40' };
+    frame += descriptor;
+    frame += static_cast<char>((checksum(descriptor) >> 8) & 0xFF);
+    for(std::size_t offset = 0; offset < contents.size(); offset += 4096){
+        std::string block = contents.substr(offset, 4096);
+        put32(frame, static_cast<std::uint32_t>(block.size()) | 0x80000000u);
+        frame += block;
+        put32(frame, checksum(block));
+    }
+    put32(frame, 0);
+    put32(frame, checksum(contents));
+    {
+        std::ofstream out("./dummy_library.stored.lz4", std::ios::binary | std::ios::trunc);
+        out << frame;
+    }
+
+    shared_library library;
+    library.load("./dummy_library.stored.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(2, 3) == 5);
+    REQUIRE(library.get_path() == "./dummy_library.stored.lz4");
+    library.unload();
+
+    //Skippable frames are skipped, and one claiming nearly 4 GiB is reported
+    //as truncated rather than allocated.
+    std::string skippable;
+    put32(skippable, 0x184D2A5Au);
+    put32(skippable, 10000);
+    skippable += std::string(10000, '\x55');
+    {
+        std::ofstream out("./dummy_library.stored.lz4", std::ios::binary | std::ios::trunc);
+        out << frame << skippable;
+    }
+    library.load("./dummy_library.stored.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(2, 3) == 5);
+    library.unload();
+    skippable.replace(4, 4, std::string(4, '\xFF'));
+    {
+        std::ofstream out("./dummy_library.stored.lz4", std::ios::binary | std::ios::trunc);
+        out << frame << skippable;
+    }
+    bool exception_state = false;
+    try {
+        library.load("./dummy_library.stored.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    } catch(exception::library_loading_error& e){
+        exception_state = std::string(e.what()).find("Truncated LZ4 skippable frame") != std::string::npos;
+    }
+    REQUIRE(exception_state);
+
+    frame[frame.size() - 1] ^= 1;
+    {
+        std::ofstream out("./dummy_library.stored.lz4", std::ios::binary | std::ios::trunc);
+        out << frame;
+    }
+    exception_state = false;
+    try {
+        library.load("./dummy_library.stored.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    } catch(exception::library_loading_error& e){
+        exception_state = std::string(e.what()).find("checksum") != std::string::npos;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!library.is_loaded());
+    std::remove("./dummy_library.stored.lz4");
+
+    //The reader thread's failure is reported, not whatever `errno` this thread holds.
+    {
+        int directory = ::open(".", O_RDONLY);
+        std::string error;
+        {
+            detail::read_ahead input(directory);
+            errno = 0;
+            REQUIRE(!detail::lz4_decompress(input, -1, error));
+        }
+        REQUIRE(error.find(std::strerror(EISDIR)) != std::string::npos);
+        ::close(directory);
+    }
+
+    #ifdef RLL_TESTS_HAVE_LZ4
+    for(const char * path : { "./dummy_library.library.lz4", "./dummy_library.linked.lz4" }){
+        library.load(path, loader_flags({ unix_flags::LOAD_LAZY }, {}));
+        REQUIRE(library.get_function_symbol<int(int, int)>("add")(4, 5) == 9);
+        REQUIRE(library.get_function_symbol<int(int, int)>("_ZN5dummy8multiplyEii")(4, 5) == 20);
+        library.unload();
+    }
+
+    //Both are loaded through a /proc/self/fd path, and the first one's
+    //descriptor number is free again by the time the second one loads.
+    shared_library other;
+    library.load("./dummy_library.library.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    other.load("./other_library.library.lz4", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_platform_handle() != other.get_platform_handle());
+    REQUIRE(library.get_function_symbol<int()>("which")() == 1);
+    REQUIRE(other.get_function_symbol<int()>("which")() == 2);
+    other.unload();
+    library.unload();
+    #endif
+}
+#endif
+
+#ifdef RLL_HAS_INTEGRITY_VERIFICATION
+TEST_CASE("Integrity verification checks cached XXH64 digests"){
+    auto digest = [](const std::string& text){
+        return detail::format_digest(detail::xxh64::digest(reinterpret_cast<const unsigned char *>(text.data()), text.size()));
+    };
+    REQUIRE(digest("") == "ef46db3751d8e999");
+    REQUIRE(digest("a") == "d24ec4f1a98c6e5b");
+    REQUIRE(digest("abc") == "44bc2cf5ad770999");
+    REQUIRE(digest("Nobody inspects the spammish repetition") == "fbcea83c8a378bf1");
+
+    const std::string cache = "./rll_integrity_cache";
+    std::remove(cache.c_str());
+    shared_library::set_integrity_cache_file(cache);
+    loader_flags flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::VERIFY_INTEGRITY });
+
+    shared_library library;
+    shared_library::set_trusted_digests({});
+    bool exception_state = false;
+    try {
+        library.load("./dummy_library.library", flags);
+    } catch(exception::library_loading_error& e){
+        exception_state = std::string(e.what()).find("integrity") != std::string::npos;
+    }
+    REQUIRE(exception_state);
+    REQUIRE(!library.is_loaded());
+
+    std::string trusted = shared_library::get_file_digest("./dummy_library.library");
+    REQUIRE(trusted.size() == 16);
+    for(char& c : trusted){
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    shared_library::set_trusted_digests({ trusted });
+    library.load("./dummy_library.library", flags);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(2, 2) == 4);
+    library.unload();
+
+    //The digest was hashed once and stored.
+    std::string contents;
+    {
+        std::ifstream in(cache);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    REQUIRE(contents.find("RLL-INTEGRITY 1\n") == 0);
+    REQUIRE(std::count(contents.begin(), contents.end(), '\n') == 2);
+
+    //A different file with the same name isn't trusted.
+    {
+        std::ifstream in("./dummy_library.library", std::ios::binary);
+        std::ofstream out("./dummy_library.modified.library", std::ios::binary | std::ios::trunc);
+        out << in.rdbuf() << '\0';
+    }
+    exception_state = false;
+    try {
+        library.load("./dummy_library.modified.library", flags);
+    } catch(exception::library_loading_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+
+    //Both are loaded through a /proc/self/fd path, and the first one's
+    //descriptor number is free again by the time the second one loads.
+    shared_library::set_trusted_digests({ trusted, shared_library::get_file_digest("./other_library.library") });
+    shared_library other;
+    library.load("./dummy_library.library", flags);
+    other.load("./other_library.library", flags);
+    REQUIRE(library.get_platform_handle() != other.get_platform_handle());
+    REQUIRE(library.get_function_symbol<int()>("which")() == 1);
+    REQUIRE(other.get_function_symbol<int()>("which")() == 2);
+    other.unload();
+    library.unload();
+
+    //A cache file others can write is neither read nor written, so a forged
+    //digest in it isn't believed.
+    const std::string forged = "./rll_integrity_cache.forged";
+    {
+        struct stat status;
+        REQUIRE(stat("./dummy_library.library", &status) == 0);
+        detail::file_identity identity = detail::identify_file(status);
+        std::ofstream out(forged, std::ios::trunc);
+        out << "RLL-INTEGRITY 1\n" << identity.device << " " << identity.inode << " " << identity.size << " "
+            << identity.mtime << " " << identity.ctime << " 0123456789abcdef\n";
+    }
+    REQUIRE(chmod(forged.c_str(), 0666) == 0);
+    shared_library::set_integrity_cache_file(forged);
+    shared_library::set_trusted_digests({ "0123456789abcdef" });
+    exception_state = false;
+    try {
+        library.load("./dummy_library.library", flags);
+    } catch(exception::library_loading_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    shared_library::set_trusted_digests({ trusted });
+    library.load("./dummy_library.library", flags);
+    library.unload();
+    {
+        std::ifstream in(forged);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    REQUIRE(std::count(contents.begin(), contents.end(), '\n') == 2);
+    std::remove(forged.c_str());
+
+    shared_library::set_integrity_cache_file("");
+    shared_library::set_trusted_digests({});
+    std::remove("./dummy_library.modified.library");
+    std::remove(cache.c_str());
+}
+#endif
+
+#ifdef RLL_PLATFORM_IS_ELF
+TEST_CASE("Latency-critical loads prefault and lock the library"){
+    shared_library library;
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::PREFAULT, rll_flags::LOCK_MEMORY, rll_flags::WARM_BINDINGS }));
+    const load_report& report = library.get_load_report();
+    library_memory_usage usage = library.memory_usage();
+    std::size_t mapped = 0;
+    for(auto& segment : usage.segments){
+        mapped += segment.size;
+    }
+    REQUIRE(report.prefaulted_size > 0);
+    REQUIRE(report.prefaulted_size == mapped);
+    REQUIRE(report.locked_size <= report.prefaulted_size);
+    REQUIRE(usage.rss == mapped);
+    REQUIRE(report.to_json().find("\"prefaulted_size\":") != std::string::npos);
+    REQUIRE(library.get_function_symbol<int(int, int)>("add")(1, 2) == 3);
+    library.unload();
+
+    library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    REQUIRE(library.get_load_report().prefaulted_size == 0);
+    library.unload();
+}
+#endif
+
+#ifdef RLL_HAS_LINK_MAP_NAMESPACES
+TEST_CASE("Libraries load into new link-map namespaces"){
+    shared_library shared;
+    shared.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+    shared_library isolated;
+    isolated.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}, { rll_flags::NEW_NAMESPACE }));
+    REQUIRE(isolated.get_symbol("add") != shared.get_symbol("add"));
+    REQUIRE(isolated.get_function_symbol<int(int, int)>("add")(2, 3) == 5);
+
+    //A namespaced handle isn't parked for plain loads.
+    warm_pool_limits limits;
+    limits.max_libraries = 4;
+    shared_library::set_warm_pool_limits(limits);
+    isolated.unload();
+    REQUIRE(shared_library::warm_pool_size() == 0);
+    shared_library::set_warm_pool_limits(warm_pool_limits());
+}
+#endif
@@ -0,0 +1,65 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#define RLL_ENABLE_TRACING 1
+#include <RLL/RLL.hpp>
+
+#include <thread>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//-------------------------------TRACING_TEST---------------------------------//
+using namespace rll;
+
+static std::size_t count_of(const std::string& text, const std::string& needle){
+    std::size_t count = 0;
+    for(std::size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1)){
+        count++;
+    }
+    return count;
+}
+
+TEST_CASE("Loads and lookups are traced"){
+    tracing::export_chrome_json();
+    {
+        shared_library library;
+        library.load("./dummy_library.library", loader_flags({ unix_flags::LOAD_LAZY }, {}));
+        library.get_symbol("add");
+        library.has_symbol("not_a_symbol");
+    }
+
+    std::string json = tracing::export_chrome_json();
+    REQUIRE(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+    REQUIRE(count_of(json, "\"name\":\"load\"") == 2);
+    REQUIRE(count_of(json, "\"name\":\"unload\"") == 2);
+    REQUIRE(count_of(json, "\"name\":\"get_symbol miss\"") == 4);
+    REQUIRE(count_of(json, "\"detail\":\"./dummy_library.library\"") == 2);
+    REQUIRE(count_of(json, "\"ph\":\"B\"") == count_of(json, "\"ph\":\"E\""));
+
+    //Exporting drains the rings.
+    REQUIRE(count_of(tracing::export_chrome_json(), "\"name\"") == 0);
+}
+
+TEST_CASE("Every thread records into its own ring"){
+    std::vector<std::thread> threads;
+    for(int i = 0; i < 4; i++){
+        threads.emplace_back([](){
+            for(int j = 0; j < 100; j++){
+                tracing::scope span("work");
+            }
+        });
+    }
+    for(auto& thread : threads){
+        thread.join();
+    }
+    std::string json = tracing::export_chrome_json();
+    REQUIRE(count_of(json, "\"name\":\"work\"") == 800);
+    REQUIRE(tracing::dropped_events() == 0);
+
+    for(std::size_t i = 0; i < 3000; i++){
+        tracing::scope span("overflow");
+    }
+    REQUIRE(tracing::dropped_events() > 0);
+    tracing::export_chrome_json();
+}
@@ -0,0 +1,90 @@
+// This is an RLL test script.
+// It is public domain:
+// Copyright (c) 2020 Elijah Hopp, No Rights Reserved.
+//----------------------------------INCLUDES----------------------------------//
+#include <RLL/zygote.hpp>
+
+#include <thread>
+
+#define CATCH_CONFIG_MAIN 1
+#include <catch-mini/catch-mini.hpp>
+//--------------------------------ZYGOTE_TEST---------------------------------//
+using namespace rll;
+
+int call_add(zygote& z, int connection){
+    auto add = z.get_library("./dummy_library.library").get_function_symbol<int(int, int)>("add");
+    int result = add(2, 3);
+    if(connection >= 0){
+        return detail::write_all(connection, &result, sizeof(result)) ? 0 : 1;
+    }
+    return result;
+}
+
+TEST_CASE("Forked workers inherit the preloaded libraries"){
+    zygote z;
+    z.add_library("./dummy_library.library");
+    z.preload();
+    REQUIRE(z.get_library("./dummy_library.library").is_loaded());
+
+    pid_t worker = z.fork_worker(call_add);
+    int status = 0;
+    REQUIRE(waitpid(worker, &status, 0) == worker);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 5);
+}
+
+TEST_CASE("Workers can be requested over a socket"){
+    std::string socket_path = "./rll_zygote_test.sock";
+    zygote z;
+    z.add_library("./dummy_library.library");
+    z.preload();
+    REQUIRE(z.start(socket_path, call_add) > 0);
+
+    for(int i = 0; i < 3; i++){
+        pid_t worker = -1;
+        int connection = zygote::request_worker(socket_path, &worker);
+        REQUIRE(worker > 0);
+        int result = 0;
+        REQUIRE(detail::read_all(connection, &result, sizeof(result)));
+        REQUIRE(result == 5);
+        close(connection);
+    }
+
+    z.stop();
+    bool exception_state = false;
+    try {
+        zygote::request_worker(socket_path);
+    } catch(exception::zygote_error&){
+        exception_state = true;
+    }
+    REQUIRE(exception_state);
+    unlink(socket_path.c_str());
+}
+
+TEST_CASE("Serving only reaps the workers it forked"){
+    std::string socket_path = "./rll_zygote_serve_test.sock";
+    //Serving never returns, so it runs in a child process that exits when done.
+    pid_t server = fork();
+    if(server == 0){
+        zygote z;
+        z.add_library("./dummy_library.library");
+        z.preload();
+        std::thread([&z, socket_path](){
+            try {
+                z.serve(socket_path, call_add);
+            } catch(...){}
+        }).detach();
+        pid_t worker = z.fork_worker(call_add);
+        //Serving polls and reaps every 100 ms.
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        int status = 0;
+        bool reaped_here = waitpid(worker, &status, 0) == worker && WIFEXITED(status) && WEXITSTATUS(status) == 5;
+        _exit(reaped_here ? 0 : 1);
+    }
+    REQUIRE(server > 0);
+    int status = 0;
+    REQUIRE(waitpid(server, &status, 0) == server);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    unlink(socket_path.c_str());
+}